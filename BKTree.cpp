@@ -64,17 +64,16 @@ void BKTree::insert(const FileInfo &f){
 
 void BKTree::findSimilar(uint64_t targetHash, int maxDistance, 
     std::vector<FileInfo>& result, 
-    std::set<std::filesystem::path> &visited, 
+    const std::vector<bool> &visited, 
     BKTreeNode* node) const{
     if(!node){
         node=m_root.get();
     }
     if(!node){
-        std::cout<<"Tree is empty. No files to filter"<<"\n";
         return ;
     }
     int dist=hammingDistance(targetHash, node->m_data.getImgHash());
-    if(dist<=maxDistance && visited.find(node->m_data.getPath())==visited.end()){
+    if(dist<=maxDistance && !visited[node->m_data.getPathId()]){
         //std::cout<<dist<<"\n";
         result.push_back(node->m_data);
     }
@@ -85,4 +84,22 @@ void BKTree::findSimilar(uint64_t targetHash, int maxDistance,
         }
     }
 
-}
\ No newline at end of file
+}
+
+void BKTree::findSimilarIds(uint64_t targetHash, int maxDistance, std::vector<PathId>& result,
+                            const BKTreeNode* node) const{
+    if(!node){
+        node=m_root.get();
+        if(!node) return;
+    }
+    int dist=hammingDistance(targetHash, node->m_data.getImgHash());
+    if(dist<=maxDistance){
+        result.push_back(node->m_data.getPathId());
+    }
+    for(int i=std::max(0, dist-maxDistance); i<=dist+maxDistance; ++i){
+        auto it=node->children.find(i);
+        if(it!=node->children.end()){
+            findSimilarIds(targetHash, maxDistance, result, it->second.get());
+        }
+    }
+}
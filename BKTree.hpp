@@ -29,8 +29,17 @@ class BKTree{
         void insertVideoHashes(const FileInfo& f);
         void findSimilar(uint64_t targetHash, int maxDistance,
                         std::vector<FileInfo>& result,
-                        std::set<std::filesystem::path>& visited,
+                        const std::vector<bool>& visited,
                     BKTreeNode *node=nullptr) const;
+
+        /**
+         * @brief Collects the path ids of all files within maxDistance of targetHash.
+         *
+         * Read-only, so any number of threads may query a built tree at once. The
+         * ids come in the order findSimilar returns the files, without copying them.
+         */
+        void findSimilarIds(uint64_t targetHash, int maxDistance, std::vector<PathId>& result,
+                            const BKTreeNode *node=nullptr) const;
         //void printSimilarGroups(const std::vector<FileInfo>& fileList, const BKTree &tree, int threshold=10);
 
 };
@@ -0,0 +1,105 @@
+#include "BufferedWriter.hpp"
+
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+BufferedWriter::BufferedWriter(const std::string& file, std::size_t capacity)
+    : m_fd(STDOUT_FILENO), m_ownsFd(false), m_buffer(capacity > 0 ? capacity : 1)
+{
+    if (!file.empty() && file != "-") {
+        m_fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        m_ownsFd = true;
+        if (m_fd < 0) {
+            std::cerr << "Cannot open " << file << " for writing: " << std::strerror(errno) << "\n";
+        }
+    }
+}
+
+BufferedWriter::~BufferedWriter() {
+    flush();
+    if (m_ownsFd && m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+void BufferedWriter::write(const void* data, std::size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    if (size > m_buffer.size() - m_used) {
+        flush();
+        //Too large to be worth copying, hand it straight to the file.
+        if (size >= m_buffer.size()) {
+            std::size_t done = 0;
+            while (m_fd >= 0 && !m_failed && done < size) {
+                ssize_t n = ::write(m_fd, bytes + done, size - done);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) m_failed = true;
+                else done += (std::size_t)n;
+            }
+            return;
+        }
+    }
+    std::memcpy(m_buffer.data() + m_used, bytes, size);
+    m_used += size;
+}
+
+void BufferedWriter::writeNumber(std::uint64_t value) {
+    char digits[24];
+    auto res = std::to_chars(digits, digits + sizeof(digits), value);
+    write(digits, (std::size_t)(res.ptr - digits));
+}
+
+void BufferedWriter::writeJsonString(std::string_view text) {
+    put('"');
+    std::size_t plain = 0;     // Start of the run of characters which need no escaping.
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = (unsigned char)text[i];
+        if (c != '"' && c != '\\' && c >= 0x20) continue;
+        write(text.data() + plain, i - plain);
+        plain = i + 1;
+        if (c == '"' || c == '\\') {
+            put('\\');
+            put((char)c);
+        } else {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            write(escaped, 6);
+        }
+    }
+    write(text.data() + plain, text.size() - plain);
+    put('"');
+}
+
+void BufferedWriter::writeQuoted(std::string_view text) {
+    put('"');
+    for (char c : text) {
+        if (c == '"' || c == '\\') put('\\');
+        put(c);
+    }
+    put('"');
+}
+
+void BufferedWriter::writeLE(std::uint64_t value, int bytes) {
+    char out[8];
+    for (int i = 0; i < bytes; ++i) {
+        out[i] = (char)((value >> (8 * i)) & 0xFF);
+    }
+    write(out, (std::size_t)bytes);
+}
+
+bool BufferedWriter::flush() {
+    std::size_t done = 0;
+    while (m_fd >= 0 && !m_failed && done < m_used) {
+        ssize_t n = ::write(m_fd, m_buffer.data() + done, m_used - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) m_failed = true;
+        else done += (std::size_t)n;
+    }
+    m_used = 0;
+    return ok();
+}
@@ -0,0 +1,68 @@
+#ifndef BUFFEREDWRITER_HPP
+#define BUFFEREDWRITER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class BufferedWriter
+ * @brief Output file with one large buffer, written with plain write(2) calls.
+ *
+ * Meant for reports with millions of lines: formatting appends to the buffer
+ * and the data only reaches the file when the buffer is full or flush() is called.
+ */
+class BufferedWriter {
+public:
+    /**
+     * @brief Opens (truncates) the output.
+     * @param file File name; empty or "-" writes to standard output.
+     * @param capacity Buffer size in bytes.
+     */
+    explicit BufferedWriter(const std::string& file, std::size_t capacity = 1 << 20);
+    ~BufferedWriter();
+
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    /**
+     * @brief Whether the output could be opened and all writes so far succeeded.
+     */
+    bool ok() const { return m_fd >= 0 && !m_failed; }
+
+    void write(const void* data, std::size_t size);
+    void write(std::string_view text) { write(text.data(), text.size()); }
+    void put(char c) {
+        if (m_used == m_buffer.size()) flush();
+        m_buffer[m_used++] = c;
+    }
+
+    /// Writes the decimal representation of value.
+    void writeNumber(std::uint64_t value);
+
+    /// Writes text as a JSON string literal, quotes included.
+    void writeJsonString(std::string_view text);
+
+    /// Writes text in double quotes the way std::quoted does (used for paths in the text report).
+    void writeQuoted(std::string_view text);
+
+    /// Writes value as little endian binary.
+    void writeLE(std::uint64_t value, int bytes);
+
+    /**
+     * @brief Hands the buffered data to the file.
+     * @return false if a write failed.
+     */
+    bool flush();
+
+private:
+    int m_fd;
+    bool m_ownsFd;
+    bool m_failed = false;
+    std::vector<char> m_buffer;
+    std::size_t m_used = 0;
+};
+
+#endif // BUFFEREDWRITER_HPP
@@ -2,6 +2,7 @@
 
 #include "Checksum.hpp"
 #include "blake3.h"           // BLAKE3 hash function
+#include "ExifThumbnail.hpp"
 
 #include <fstream>            // For std::ifstream
 #include <sstream>            // For output string formatting
@@ -13,45 +14,263 @@
 #include <algorithm>              
 #include <stdexcept>              // For std::runtime_error when image loading fails / For throwing file read exceptions.
 #include <string>                 // For std::string in function parameter
+#include <cerrno>
+#include <ctime>
 
+#include <fcntl.h>                // open, lseek(SEEK_DATA/SEEK_HOLE) for sparse files
+#include <sys/stat.h>
+#include <unistd.h>               // pread
 
-std::string Checksum::compute(const std::string& filePath) {
-    std::ifstream file(filePath, std::ios::binary); // Open file in binary mode
-    if (!file){
-        std::cerr<<"Failed to open file "<<filePath<<". Removed it from the hashing process\n";
-        return "";
-    }
-
-    // Initialize the BLAKE3 hasher context
-    blake3_hasher hasher;
-    blake3_hasher_init(&hasher);
-
-    // Buffer to read file chunks (16 KB)
-    std::vector<char> buffer(16384);
-    while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
-        // Feed read bytes to the hasher (even if less than full buffer)
-        //buffer.data() input pointer.
-        //file.gcount() input length().
-        //.gcount() returns how many bytes were read by the .read function in its last attempt.
-        blake3_hasher_update(&hasher, buffer.data(), file.gcount());
-    }
 
-    // Finalize the hash computation and get the 32-byte digest
-    uint8_t output[BLAKE3_OUT_LEN];
-    blake3_hasher_finalize(&hasher, output, BLAKE3_OUT_LEN);
+std::string Checksum::toHex(const uint8_t digest[DigestSize]) {
+    return toHex(digest, DigestSize);
+}
 
+std::string Checksum::toHex(const uint8_t* digest, int size) {
     // Convert hash bytes to hex string (2 characters per byte)
     std::ostringstream oss;
-    for (int i = 0; i < BLAKE3_OUT_LEN; ++i)
+    for (int i = 0; i < size; ++i)
         oss << std::hex                // Use hexadecimal output
             << std::setw(2)            // Always print 2 characters
             << std::setfill('0')       // Pad with '0' if needed (e.g., 0a instead of a)
-            << (int)(output[i]); // Cast byte to int for correct formatting
+            << (int)(digest[i]); // Cast byte to int for correct formatting
 
     //64 character long hash.
     return oss.str();
 }
 
+uint64_t Checksum::fingerprint(const char* data, size_t size) {
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, data, size);
+    uint8_t out[8];
+    blake3_hasher_finalize(&hasher, out, sizeof(out));
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | out[i];
+    }
+    return value;
+}
+
+//Finalizes the hasher and converts the 32-byte digest to a 64 character hex string.
+static std::string finalizeHex(const blake3_hasher& hasher) {
+    uint8_t output[BLAKE3_OUT_LEN];
+    blake3_hasher_finalize(&hasher, output, BLAKE3_OUT_LEN);
+    return Checksum::toHex(output);
+}
+
+//CLOCK_MONOTONIC in nanoseconds, the clock of Metrics::nowNs() and of the deadlines.
+static uint64_t monotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static bool pastDeadline(uint64_t deadlineNs) {
+    return deadlineNs != UINT64_MAX && monotonicNs() >= deadlineNs;
+}
+
+//Feeds length zero bytes to the hasher, for a hole which is never read. Returns false at the deadline.
+template <class Hasher>
+static bool hashZeros(Hasher& hasher, uint64_t length, uint64_t deadlineNs) {
+    //One shared run of zeros; large updates let BLAKE3 use its wide SIMD paths.
+    static const std::vector<uint8_t> zeros(1 << 20, 0);
+    while (length > 0) {
+        if (pastDeadline(deadlineNs)) return false;
+        size_t n = (size_t)std::min<uint64_t>(length, zeros.size());
+        hasher.update(zeros.data(), n);
+        length -= n;
+    }
+    return true;
+}
+
+//Hashes [offset, end) with pread, stopping early if the file got shorter or the deadline passed.
+//Returns the offset reached.
+template <class Hasher>
+static uint64_t hashData(int fd, Hasher& hasher, std::vector<char>& buffer, uint64_t offset, uint64_t end,
+                         uint64_t deadlineNs) {
+    while (offset < end) {
+        if (pastDeadline(deadlineNs)) break;
+        size_t want = (size_t)std::min<uint64_t>(end - offset, buffer.size());
+        ssize_t got = pread(fd, buffer.data(), want, (off_t)offset);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        hasher.update(buffer.data(), (size_t)got);
+        offset += (uint64_t)got;
+    }
+    return offset;
+}
+
+/**
+ * @brief digestFile with a deadline, checked before every read.
+ * @return 1 if the digest was computed, 0 if the deadline passed first, -1 if the file couldn't be opened.
+ */
+template <class Hasher>
+static int digestBefore(const std::string& filePath, uint8_t* digest, uint64_t deadlineNs) {
+    int fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0){
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+
+    Hasher hasher;
+
+    //Only the data extents are read; holes are hashed as the zeros they read as,
+    //so the digest is the same as reading every byte. A file system without
+    //SEEK_DATA support (EINVAL) is read in full.
+    std::vector<char> buffer(1 << 16);
+    const uint64_t size = (uint64_t)st.st_size;
+    uint64_t offset = 0;
+    bool sparse = true;
+    while (offset < size) {
+        uint64_t data = offset;
+        if (sparse) {
+            off_t found = lseek(fd, (off_t)offset, SEEK_DATA);
+            if (found >= 0) {
+                data = std::min<uint64_t>((uint64_t)found, size);
+            } else if (errno == ENXIO) {
+                data = size;            // Nothing but a hole up to the end of the file.
+            } else {
+                sparse = false;
+            }
+        }
+        if (!hashZeros(hasher, data - offset, deadlineNs)) {
+            ::close(fd);
+            return 0;
+        }
+        offset = data;
+        if (offset >= size) break;
+
+        uint64_t hole = size;
+        if (sparse) {
+            off_t found = lseek(fd, (off_t)offset, SEEK_HOLE);
+            if (found >= 0) hole = std::min<uint64_t>((uint64_t)found, size);
+        }
+        uint64_t reached = hashData(fd, hasher, buffer, offset, hole, deadlineNs);
+        if (reached < hole) {
+            if (pastDeadline(deadlineNs)) {
+                ::close(fd);
+                return 0;
+            }
+            //Shorter than when it was opened, hash what there was like a plain read would.
+            offset = reached;
+            break;
+        }
+        offset = hole;
+    }
+    //Data appended after fstat is hashed too, as a read to the end would.
+    if (offset >= size) {
+        offset = hashData(fd, hasher, buffer, offset, UINT64_MAX, deadlineNs);
+        if (pastDeadline(deadlineNs)) {
+            ::close(fd);
+            return 0;
+        }
+    }
+    ::close(fd);
+
+    hasher.finalize(digest);
+    return 1;
+}
+
+template <class Hasher>
+bool Checksum::digestFile(const std::string& filePath, uint8_t digest[Hasher::DigestSize]) {
+    return digestBefore<Hasher>(filePath, digest, UINT64_MAX) > 0;
+}
+
+template bool Checksum::digestFile<Checksum::Blake3>(const std::string&, uint8_t*);
+template bool Checksum::digestFile<FastHash>(const std::string&, uint8_t*);
+
+bool Checksum::computeDigest(const std::string& filePath, uint8_t digest[DigestSize]) {
+    return digestFile<Blake3>(filePath, digest);
+}
+
+int Checksum::computeDigestBefore(const std::string& filePath, uint8_t digest[DigestSize], uint64_t deadlineNs) {
+    return digestBefore<Blake3>(filePath, digest, deadlineNs);
+}
+
+std::string Checksum::compute(const std::string& filePath) {
+    uint8_t digest[DigestSize];
+    if (!computeDigest(filePath, digest)) {
+        return "";
+    }
+    return toHex(digest);
+}
+
+std::string Checksum::computeFast(const std::string& filePath) {
+    uint8_t digest[FastHash::DigestSize];
+    if (!digestFile<FastHash>(filePath, digest)) {
+        return "";
+    }
+    return toHex(digest, FastHash::DigestSize);
+}
+
+std::string Checksum::computeSmall(const std::string& filePath, uint64_t size, std::vector<char>& buffer) {
+    int fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return "";
+    }
+    //fstat tells whether the file changed size since the walk, so the expected bytes
+    //come in one read() and no second call is needed to reach the end of the file.
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || (uint64_t)st.st_size != size) {
+        ::close(fd);
+        return "";
+    }
+    buffer.resize((size_t)size);
+    size_t filled = 0;
+    while (filled < size) {
+        ssize_t got = ::read(fd, buffer.data() + filled, size - filled);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        filled += (size_t)got;
+    }
+    ::close(fd);
+    if (filled != size) {
+        return "";
+    }
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, buffer.data(), filled);
+    return finalizeHex(hasher);
+}
+
+void Checksum::computeWithImageHash(const std::string& filePath, std::string& blake3, uint64_t& phash,
+                                    bool useThumbnail) {
+    blake3.clear();
+    phash = 0;
+
+    std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+    if (!file){
+        return;
+    }
+    //Opened at the end (ios::ate) so tellg gives the size and the buffer can be allocated once.
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::vector<unsigned char> buffer(size > 0 ? (size_t)size : 0);
+    if (size > 0 && !file.read(reinterpret_cast<char*>(buffer.data()), size)) {
+        return;
+    }
+
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, buffer.data(), buffer.size());
+    blake3 = finalizeHex(hasher);
+
+    //imdecode works on the bytes already in memory instead of opening the file again.
+    cv::Mat img;
+    std::size_t offset, length, needed;
+    if (useThumbnail && ExifThumbnail::find(buffer.data(), buffer.size(), offset, length, needed)) {
+        img = cv::imdecode(cv::Mat(1, (int)length, CV_8UC1, buffer.data() + offset), cv::IMREAD_GRAYSCALE);
+    }
+    if (img.empty()) {
+        img = cv::imdecode(buffer, cv::IMREAD_GRAYSCALE);
+    }
+    if (!img.empty()) {
+        phash = phashFromMat(img);
+    }
+}
+
 uint64_t Checksum::computeImagePHash64(const std::string& imagePath) {
     // Load image in grayscale (works for color images too)
     //Each value in tha matrix is an unsigned 8bit number(0-255).
@@ -59,7 +278,6 @@ uint64_t Checksum::computeImagePHash64(const std::string& imagePath) {
     //0-black 255-white.
     cv::Mat img = cv::imread(imagePath, cv::IMREAD_GRAYSCALE);
     if (img.empty()) {
-        std::cerr<<"Failed to load image: "<<imagePath<<"\n";
         return 0;
     }
 
@@ -111,6 +329,73 @@ uint64_t Checksum::computeImagePHash64(const std::string& imagePath) {
     return hash;
 }
 
+cv::Mat Checksum::loadReducedGray(const std::string& imgPath) {
+    return cv::imread(imgPath, cv::IMREAD_REDUCED_GRAYSCALE_4);
+}
+
+cv::Mat Checksum::loadThumbnailGray(const std::string& imgPath) {
+    std::vector<uint8_t> thumbnail;
+    if (!ExifThumbnail::read(imgPath, thumbnail)) {
+        return cv::Mat();
+    }
+    return cv::imdecode(thumbnail, cv::IMREAD_GRAYSCALE);
+}
+
+uint64_t Checksum::ahashFromMat(const cv::Mat& gray) {
+    cv::Mat small;
+    cv::resize(gray, small, cv::Size(8, 8), 0, 0, cv::INTER_AREA);
+    unsigned sum = 0;
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 8; ++j) sum += small.at<uchar>(i, j);
+    }
+    uint64_t hash = 0;
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 8; ++j) {
+            //Compared as pixel*64 > sum, the mean without a division.
+            hash = (hash << 1) | (small.at<uchar>(i, j) * 64u > sum ? 1 : 0);
+        }
+    }
+    return hash;
+}
+
+uint64_t Checksum::dhashFromMat(const cv::Mat& gray) {
+    cv::Mat small;
+    cv::resize(gray, small, cv::Size(9, 8), 0, 0, cv::INTER_AREA);
+    uint64_t hash = 0;
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 8; ++j) {
+            hash = (hash << 1) | (small.at<uchar>(i, j) > small.at<uchar>(i, j + 1) ? 1 : 0);
+        }
+    }
+    return hash;
+}
+
+void Checksum::phash256FromMat(cv::Mat& img, uint64_t hash[4]) {
+    cv::resize(img, img, cv::Size(64, 64));
+    img.convertTo(img, CV_32F);
+    cv::Mat dctImg;
+    cv::dct(img, dctImg);
+
+    std::vector<float> vals;
+    vals.reserve(256);
+    for (int i = 0; i < 16; ++i) {
+        for (int j = 0; j < 16; ++j) {
+            vals.push_back(dctImg.at<float>(i, j));
+        }
+    }
+    std::vector<float> sortedVals(vals.begin() + 1, vals.end());
+    std::nth_element(sortedVals.begin(), sortedVals.begin() + sortedVals.size() / 2, sortedVals.end());
+    float median = sortedVals[sortedVals.size() / 2];
+
+    //Bit 255 - i of the 256, MSB first like phashFromMat; the DC term (i = 0) stays 0.
+    for (int w = 0; w < 4; ++w) hash[w] = 0;
+    for (int i = 1; i < 256; ++i) {
+        if (vals[i] > median) {
+            hash[(255 - i) / 64] |= 1ULL << ((255 - i) % 64);
+        }
+    }
+}
+
 uint64_t Checksum::phashFromMat(cv::Mat & img){
     // Resize to 32x32 for DCT
     cv::resize(img, img, cv::Size(32, 32));
@@ -150,34 +435,32 @@ uint64_t Checksum::phashFromMat(cv::Mat & img){
     return hash;
 }
 
-std::vector<uint64_t> Checksum::setVideoHashes(const std::string& videoPath){
+int Checksum::sampleVideoFrames(const std::string& videoPath, int numSamples, int begin, int end, uint64_t* hashes){
   cv::VideoCapture cap(videoPath);
   if(!cap.isOpened()){
-    std::cerr<<"Failed to open video file"<<videoPath<<"\n";
-    std::vector<uint64_t> vec;
-    return vec;
+    return 0;
   }
-
-  double totalFrames=cap.get(cv::CAP_PROP_FRAME_COUNT);
-  const int numSamples=10;
-  std::vector<uint64_t> video_hashes;
-  for(int i=0; i<numSamples; ++i){
+  const double totalFrames=cap.get(cv::CAP_PROP_FRAME_COUNT);
+  for(int i=begin; i<end; ++i){
     //starts from 0 to totalFrames-1;
     int frameIndex=(int)((i*totalFrames)/numSamples);
     cap.set(cv::CAP_PROP_POS_FRAMES, frameIndex);
-    
+
     cv::Mat frame;
     if(!cap.read(frame) || frame.empty()){
-      //std::cerr<<"Failed to read frame "<<frameIndex<<" frame of "<<m_path<<"\n";
-      //If even the first frame could not be read then mark it for removal.
-      return video_hashes;
+      return i-begin;
     }
 
     cv::Mat gray;
     cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-    uint64_t hashval=Checksum::phashFromMat(gray);
-    video_hashes.push_back(hashval);
+    hashes[i]=Checksum::phashFromMat(gray);
   }
-  return video_hashes;
+  return end-begin;
+}
 
-}
\ No newline at end of file
+std::vector<uint64_t> Checksum::setVideoHashes(const std::string& videoPath, int numSamples){
+  numSamples=std::max(numSamples, 1);
+  std::vector<uint64_t> video_hashes(numSamples);
+  video_hashes.resize(sampleVideoFrames(videoPath, numSamples, 0, numSamples, video_hashes.data()));
+  return video_hashes;
+}
@@ -2,7 +2,18 @@
 #define CHECKSUM_HPP
 #include <string>
 #include <cstdint>
+#include <vector>
 #include <opencv2/opencv.hpp> 
+#include "blake3.h"
+#include "FastHash.hpp"
+
+/**
+ * @class Checksum
+ * @brief Content and perceptual hashes of files.
+ *
+ * Nothing is printed here: a file which can't be read or decoded gives an
+ * empty hash (or 0, or an empty Mat), and the caller reports it.
+ */
 class Checksum {
 public:
     /**
@@ -12,9 +23,7 @@ public:
      * and returns the final hash as a lowercase hexadecimal string.
      * 
      * @param filePath Path to the file to be hashed.
-     * @return Hexadecimal string representation of the BLAKE3 hash.
-     * 
-     * @throws std::runtime_error if the file cannot be opened.
+     * @return Hexadecimal string representation of the BLAKE3 hash, empty if the file cannot be opened.
      * 
      * Computes BLAKE3 hash of a file and returns it as a hex string
      * Since it is static it belongs to the class and not an object.
@@ -23,11 +32,156 @@ public:
 
     static std::string compute(const std::string& filePath);
 
+    /// Size of a BLAKE3 digest in bytes.
+    static constexpr int DigestSize = 32;
+
+    /**
+     * @brief Computes the BLAKE3 hash of a file's contents as raw bytes.
+     * @param filePath Path to the file to be hashed.
+     * @param digest Receives the DigestSize bytes of the hash.
+     * @return false if the file couldn't be opened.
+     */
+    static bool computeDigest(const std::string& filePath, uint8_t digest[DigestSize]);
+
+    /**
+     * @brief computeDigest which gives up once deadlineNs (CLOCK_MONOTONIC, see Metrics::nowNs) passes.
+     *
+     * The clock is checked before each 64 KB read, so a large file stops within
+     * one read of the deadline.
+     * @return 1 if the digest was computed, 0 if the deadline passed first, -1 if the file couldn't be opened.
+     */
+    static int computeDigestBefore(const std::string& filePath, uint8_t digest[DigestSize], uint64_t deadlineNs);
+
+    /**
+     * @brief Hasher policy for digestFile computing BLAKE3.
+     */
+    struct Blake3 {
+        static constexpr int DigestSize = BLAKE3_OUT_LEN;
+        Blake3() { blake3_hasher_init(&m_hasher); }
+        void update(const void* data, size_t size) { blake3_hasher_update(&m_hasher, data, size); }
+        void finalize(uint8_t* digest) const { blake3_hasher_finalize(&m_hasher, digest, DigestSize); }
+    private:
+        blake3_hasher m_hasher;
+    };
+
+    /**
+     * @brief Hashes a file's contents with the hasher policy H.
+     *
+     * H is default constructible and has update(data, size), finalize(digest)
+     * and a DigestSize constant; Blake3 and FastHash are instantiated. Holes of
+     * sparse files are hashed as zeros without being read.
+     * @return false if the file couldn't be opened.
+     */
+    template <class H>
+    static bool digestFile(const std::string& filePath, uint8_t digest[H::DigestSize]);
+
+    /**
+     * @brief Computes the 128 bit FastHash of a file's contents.
+     *
+     * Several times faster than compute() but not collision resistant; used to
+     * tell candidates apart before BLAKE3 confirms the ones that still match.
+     * @return 32 character lowercase hex string, empty if the file couldn't be opened.
+     */
+    static std::string computeFast(const std::string& filePath);
+
+    /**
+     * @brief Hashes a small file with a single read, without the sparse file handling of computeDigest.
+     *
+     * Meant for files of a few kilobytes, where opening the file costs more than
+     * reading and hashing it. The size is checked with fstat, so the read asks for
+     * exactly that many bytes and one call is enough.
+     * @param size Size of the file when it was walked; a file which changed size since gives no hash.
+     * @param buffer Scratch buffer, reused between calls to save an allocation per file.
+     * @return The hex hash as compute() returns it, empty if the file couldn't be read.
+     */
+    static std::string computeSmall(const std::string& filePath, uint64_t size, std::vector<char>& buffer);
+
+    /**
+     * @brief 64 bit fingerprint of a buffer: its first 8 BLAKE3 output bytes, little endian.
+     *
+     * Used for the first bytes of files (FileInfo::readFirstBytes) and stored in
+     * shard files, so it must not change.
+     */
+    static uint64_t fingerprint(const char* data, size_t size);
+
+    /**
+     * @brief Converts a digest to the 64 character lowercase hex string returned by compute().
+     */
+    static std::string toHex(const uint8_t digest[DigestSize]);
+    static std::string toHex(const uint8_t* digest, int size);
+
+    /**
+     * @brief Computes the BLAKE3 hash and the 64 bit perceptual hash of an image in one read.
+     *
+     * The file is read into memory once; the same buffer is fed to BLAKE3 and
+     * decoded by OpenCV, so images that are also duplicate candidates are not read twice.
+     *
+     * @param filePath Path to the image file.
+     * @param blake3 Receives the hex BLAKE3 hash, empty if the file couldn't be read.
+     * @param phash Receives the perceptual hash, 0 if the file couldn't be decoded.
+     * @param useThumbnail Hash the embedded EXIF thumbnail instead of the image when there is one.
+     */
+    static void computeWithImageHash(const std::string& filePath, std::string& blake3, uint64_t& phash,
+                                     bool useThumbnail = false);
+
+    /**
+     * @brief 64 bit pHash of an image decoded in full, 0 if it can't be decoded.
+     */
     static uint64_t computeImagePHash64(const std::string& imgPath);
 
     static uint64_t phashFromMat(cv::Mat& img);
 
-    static std::vector<uint64_t> setVideoHashes(const std::string& filePath);
+    /**
+     * @brief Decodes an image in grayscale at a quarter of its width and height.
+     *
+     * JPEG is scaled while decoding, which skips most of the work of a full
+     * decode. Enough detail is left for the 8x8 and 9x8 hashes below.
+     * @return An empty Mat if the image can't be decoded.
+     */
+    static cv::Mat loadReducedGray(const std::string& imgPath);
+
+    /**
+     * @brief Decodes the EXIF thumbnail of a JPEG file in grayscale, reading only the start of the file.
+     *
+     * Camera thumbnails are about 160x120, plenty for the 32x32 pHash, and
+     * decoding one costs a fraction of decoding the full image. Hashes of a
+     * thumbnail and of its image differ by a few bits, well within the thresholds.
+     * @return An empty Mat if the file has no thumbnail (see ExifThumbnail).
+     */
+    static cv::Mat loadThumbnailGray(const std::string& imgPath);
+
+    /**
+     * @brief Average hash: 8x8 area-averaged thumbnail, one bit per pixel brighter than the mean.
+     */
+    static uint64_t ahashFromMat(const cv::Mat& gray);
+
+    /**
+     * @brief Difference hash: 9x8 thumbnail, one bit per pixel brighter than its right neighbour.
+     */
+    static uint64_t dhashFromMat(const cv::Mat& gray);
+
+    /**
+     * @brief 256 bit pHash: the 16x16 lowest DCT frequencies of a 64x64 thumbnail against their median.
+     *
+     * Four times the bits of phashFromMat, for telling apart images which are
+     * close under the 64 bit hash. The DC term is left out, so the top bit is always 0.
+     */
+    static void phash256FromMat(cv::Mat& img, uint64_t hash[4]);
+
+    /**
+     * @brief pHashes of numSamples frames spread evenly over a video.
+     * @return The hashes in frame order, up to the first frame which couldn't be read.
+     */
+    static std::vector<uint64_t> setVideoHashes(const std::string& filePath, int numSamples = 10);
+
+    /**
+     * @brief pHashes samples [begin, end) of numSamples spread evenly over a video, through one capture.
+     *
+     * Runs of samples of one video can be decoded independently, each through its own capture.
+     * @param hashes Receives sample i at hashes[i].
+     * @return Number of samples hashed before the first frame which couldn't be read, 0 if the video can't be opened.
+     */
+    static int sampleVideoFrames(const std::string& filePath, int numSamples, int begin, int end, uint64_t* hashes);
 
 };
 
@@ -0,0 +1,38 @@
+#include "ChunkIndex.hpp"
+
+ChunkIndex::ChunkIndex()
+    : m_slots(1024, Slot{Chunker::Digest{}, kEmpty})
+{}
+
+std::uint32_t ChunkIndex::insert(const Chunker::Digest& digest, std::uint32_t length) {
+    if ((m_lengths.size() + 1) * 10 > m_slots.size() * 7) {
+        grow();
+    }
+    const std::size_t mask = m_slots.size() - 1;
+    for (std::size_t i = digest.lo & mask;; i = (i + 1) & mask) {
+        Slot& slot = m_slots[i];
+        if (slot.id == kEmpty) {
+            slot.digest = digest;
+            slot.id = (std::uint32_t)m_lengths.size();
+            m_lengths.push_back(length);
+            m_references.push_back(1);
+            return slot.id;
+        }
+        if (slot.digest == digest) {
+            m_references[slot.id]++;
+            return slot.id;
+        }
+    }
+}
+
+void ChunkIndex::grow() {
+    std::vector<Slot> old(m_slots.size() * 2, Slot{Chunker::Digest{}, kEmpty});
+    old.swap(m_slots);
+    const std::size_t mask = m_slots.size() - 1;
+    for (const Slot& slot : old) {
+        if (slot.id == kEmpty) continue;
+        std::size_t i = slot.digest.lo & mask;
+        while (m_slots[i].id != kEmpty) i = (i + 1) & mask;
+        m_slots[i] = slot;
+    }
+}
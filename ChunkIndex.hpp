@@ -0,0 +1,50 @@
+#ifndef CHUNKINDEX_HPP
+#define CHUNKINDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Chunker.hpp"
+
+/**
+ * @class ChunkIndex
+ * @brief Compact hash table from chunk digest to a dense chunk id.
+ *
+ * Open addressing with linear probing over a power of two table of 20 byte
+ * slots (the digest and the id), grown at 70% load. The digests are already
+ * uniformly distributed, so their low bits are used as the slot directly.
+ * Per-chunk data lives in plain vectors indexed by the id.
+ */
+class ChunkIndex {
+public:
+    ChunkIndex();
+
+    /**
+     * @brief Returns the id of a chunk, adding it if it is new.
+     */
+    std::uint32_t insert(const Chunker::Digest& digest, std::uint32_t length);
+
+    std::size_t size() const { return m_lengths.size(); }
+    std::uint32_t length(std::uint32_t id) const { return m_lengths[id]; }
+
+    /// Number of times the chunk was inserted, once per occurrence.
+    std::uint32_t references(std::uint32_t id) const { return m_references[id]; }
+
+private:
+#pragma pack(push, 4)
+    struct Slot {
+        Chunker::Digest digest;
+        std::uint32_t id;               // kEmpty for a free slot.
+    };
+#pragma pack(pop)
+    static constexpr std::uint32_t kEmpty = 0xFFFFFFFFu;
+
+    std::vector<Slot> m_slots;
+    std::vector<std::uint32_t> m_lengths;
+    std::vector<std::uint32_t> m_references;
+
+    void grow();
+};
+
+#endif // CHUNKINDEX_HPP
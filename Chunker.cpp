@@ -0,0 +1,107 @@
+#include "Chunker.hpp"
+#include "blake3.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+//256 random 64 bit values, the same in every build so chunk boundaries are stable.
+static constexpr std::array<std::uint64_t, 256> makeGearTable() {
+    std::array<std::uint64_t, 256> table{};
+    std::uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (auto& value : table) {
+        //splitmix64
+        state += 0x9e3779b97f4a7c15ULL;
+        std::uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        value = z ^ (z >> 31);
+    }
+    return table;
+}
+
+static constexpr std::array<std::uint64_t, 256> kGear = makeGearTable();
+
+//Mask of the top bits of the hash. After the shift the top bits depend on the last 64 bytes.
+static std::uint64_t topBits(int bits) {
+    return bits <= 0 ? 0 : ~0ULL << (64 - bits);
+}
+
+Chunker::Chunker(std::size_t averageSize) {
+    int bits = 8;
+    while (bits < 30 && (std::size_t(1) << (bits + 1)) <= averageSize) bits++;
+    m_avg = std::size_t(1) << bits;
+    m_min = m_avg / 4;
+    m_max = m_avg * 8;
+    m_maskS = topBits(bits + 2);
+    m_maskL = topBits(bits - 2);
+}
+
+std::size_t Chunker::cut(const std::uint8_t* data, std::size_t size) const {
+    if (size <= m_min) return size;
+    const std::size_t normal = std::min(size, m_avg);
+    const std::size_t end = std::min(size, m_max);
+    std::uint64_t hash = 0;
+    std::size_t i = m_min;
+    for (; i < normal; ++i) {
+        hash = (hash << 1) + kGear[data[i]];
+        if (!(hash & m_maskS)) return i + 1;
+    }
+    for (; i < end; ++i) {
+        hash = (hash << 1) + kGear[data[i]];
+        if (!(hash & m_maskL)) return i + 1;
+    }
+    return end;
+}
+
+static Chunker::Digest digestOf(const std::uint8_t* data, std::size_t size) {
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, data, size);
+    std::uint8_t out[16];
+    blake3_hasher_finalize(&hasher, out, sizeof(out));
+    Chunker::Digest digest;
+    std::memcpy(&digest.hi, out, 8);
+    std::memcpy(&digest.lo, out + 8, 8);
+    return digest;
+}
+
+bool Chunker::chunkFile(const std::string& path, std::vector<Chunk>& chunks) const {
+    chunks.clear();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    //The unchunked tail is moved to the front before every refill, so a chunk never spans two reads.
+    std::vector<std::uint8_t> buffer(std::max<std::size_t>(4 << 20, 2 * m_max));
+    std::size_t filled = 0;
+    bool eof = false, ok = true;
+    while (true) {
+        while (!eof && filled < buffer.size()) {
+            ssize_t got = ::read(fd, buffer.data() + filled, buffer.size() - filled);
+            if (got < 0 && errno == EINTR) continue;
+            if (got < 0) ok = false;
+            if (got <= 0) {
+                eof = true;
+                break;
+            }
+            filled += (std::size_t)got;
+        }
+        std::size_t pos = 0;
+        //Without more data to come the last chunk may be short; otherwise keep a full maximum available.
+        while (pos < filled && (eof || filled - pos >= m_max)) {
+            std::size_t length = cut(buffer.data() + pos, filled - pos);
+            chunks.push_back(Chunk{digestOf(buffer.data() + pos, length), (std::uint32_t)length});
+            pos += length;
+        }
+        if (eof) break;
+        std::memmove(buffer.data(), buffer.data() + pos, filled - pos);
+        filled -= pos;
+    }
+    ::close(fd);
+    return ok;
+}
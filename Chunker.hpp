@@ -0,0 +1,63 @@
+#ifndef CHUNKER_HPP
+#define CHUNKER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class Chunker
+ * @brief Content-defined chunking with a Gear rolling hash, FastCDC style.
+ *
+ * A cut point is placed where the top bits of the Gear hash are all zero, so
+ * chunk boundaries depend on the content around them and not on offsets: an
+ * insertion only changes the chunks it touches. Normalized chunking is used:
+ * below the average size a stricter mask (two more bits) is tested, above it
+ * a looser one (two fewer bits), which keeps chunk sizes close to the average.
+ * No cut is looked for in the first minimum bytes of a chunk.
+ */
+class Chunker {
+public:
+    /// Digest of one chunk: the first 16 bytes of its BLAKE3 hash.
+    struct Digest {
+        std::uint64_t hi = 0;
+        std::uint64_t lo = 0;
+        bool operator==(const Digest& other) const { return hi == other.hi && lo == other.lo; }
+    };
+
+    struct Chunk {
+        Digest digest;
+        std::uint32_t length = 0;
+    };
+
+    /**
+     * @param averageSize Target chunk size, rounded down to a power of two (at least 256).
+     *                    Chunks are between a quarter and eight times this size.
+     */
+    explicit Chunker(std::size_t averageSize = 8192);
+
+    std::size_t minSize() const { return m_min; }
+    std::size_t maxSize() const { return m_max; }
+
+    /**
+     * @brief Length of the chunk starting at data.
+     * @param size Bytes available; the result is at most size, and size itself if no cut was found.
+     */
+    std::size_t cut(const std::uint8_t* data, std::size_t size) const;
+
+    /**
+     * @brief Splits a file into chunks and hashes each of them.
+     * @return false if the file couldn't be read.
+     */
+    bool chunkFile(const std::string& path, std::vector<Chunk>& chunks) const;
+
+private:
+    std::size_t m_min;
+    std::size_t m_avg;
+    std::size_t m_max;
+    std::uint64_t m_maskS;              // Tested before the average size.
+    std::uint64_t m_maskL;              // Tested after it.
+};
+
+#endif // CHUNKER_HPP
@@ -0,0 +1,230 @@
+#include "DedupAction.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+//Bytes handed to one FIDEDUPERANGE call; filesystems cap a single call at about this much anyway.
+static constexpr std::uint64_t kDedupeChunk = 16ull << 20;
+
+static std::int64_t mtimeOf(const struct stat& st) {
+    return (std::int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+//Whether FIDEDUPERANGE failed because the filesystem can't share extents, rather than for this file.
+//EINVAL (a range the filesystem won't take) and EXDEV (another filesystem, where a hardlink fails
+//too) are about the one file, so they don't count.
+static bool unsupported(int err) {
+    return err == EOPNOTSUPP || err == ENOTTY || err == ENOSYS;
+}
+
+/**
+ * @brief Shares the first size bytes of dstFd with srcFd.
+ * @return 0 if all bytes are shared, 1 if the kernel found different bytes, -errno on failure.
+ */
+static int dedupeRange(int srcFd, int dstFd, std::uint64_t size) {
+    alignas(file_dedupe_range) char buf[sizeof(file_dedupe_range) + sizeof(file_dedupe_range_info)];
+    auto* range = reinterpret_cast<file_dedupe_range*>(buf);
+
+    std::uint64_t offset = 0;
+    while (offset < size) {
+        std::memset(buf, 0, sizeof(buf));
+        range->src_offset = offset;
+        range->src_length = std::min(size - offset, kDedupeChunk);
+        range->dest_count = 1;
+        range->info[0].dest_fd = dstFd;
+        range->info[0].dest_offset = offset;
+
+        if (::ioctl(srcFd, FIDEDUPERANGE, range) != 0) return -errno;
+        if (range->info[0].status == FILE_DEDUPE_RANGE_DIFFERS) return 1;
+        if (range->info[0].status < 0) return range->info[0].status;
+        if (range->info[0].bytes_deduped == 0) return -EIO;   // No progress, don't loop forever.
+        offset += range->info[0].bytes_deduped;
+    }
+    return 0;
+}
+
+/**
+ * @brief Replaces dst by a hardlink to src, atomically through a temporary name in dst's directory.
+ * @return 0 on success, -errno on failure.
+ */
+static int replaceWithLink(const fs::path& src, const fs::path& dst) {
+    //Groups don't share files, so a name derived from dst can't clash with another thread's.
+    fs::path tmp = dst.parent_path() / ("." + dst.filename().string() + ".dedup-" + std::to_string(::getpid()));
+    if (::link(src.c_str(), tmp.c_str()) != 0) return -errno;
+    if (::rename(tmp.c_str(), dst.c_str()) != 0) {
+        int err = errno;
+        ::unlink(tmp.c_str());
+        return -err;
+    }
+    return 0;
+}
+
+void ActionSummary::add(const ActionSummary& other) {
+    reflinked += other.reflinked;
+    hardlinked += other.hardlinked;
+    planned += other.planned;
+    alreadyShared += other.alreadyShared;
+    changed += other.changed;
+    failed += other.failed;
+    bytesReclaimed += other.bytesReclaimed;
+}
+
+//Absolute and normalized, without the empty last component a trailing separator leaves.
+//Empty if the working directory can't be had; this runs in pool jobs, which must not throw.
+static fs::path normalized(const fs::path& p) {
+    std::error_code ec;
+    fs::path abs = fs::absolute(p, ec);
+    if (ec) return fs::path();
+    abs = abs.lexically_normal();
+    if (abs.has_relative_path() && abs.filename().empty()) abs = abs.parent_path();
+    return abs;
+}
+
+DedupAction::DedupAction(const ActionOptions& options)
+    : m_options(options)
+{
+    //A root which can't be resolved comes out empty and protects every file.
+    for (const auto& root : options.protectedRoots) {
+        m_protected.push_back(normalized(root));
+    }
+}
+
+bool DedupAction::isProtected(const fs::path& file) const {
+    const fs::path abs = normalized(file);
+    //A path which can't be resolved is left alone, it might be under a protected root.
+    if (abs.empty()) return !m_protected.empty();
+    for (const auto& root : m_protected) {
+        auto mismatch = std::mismatch(root.begin(), root.end(), abs.begin(), abs.end());
+        if (mismatch.first == root.end()) return true;
+    }
+    return false;
+}
+
+void DedupAction::add(const DuplicateGroup& group) {
+    if (group.kind != DuplicateGroup::Kind::Exact || group.files.size() < 2 ||
+        group.mtimes.size() != group.files.size() || group.references >= group.files.size() || !group.confirmed) {
+        return;
+    }
+    m_groups.push_back(group);
+}
+
+ActionSummary DedupAction::run() {
+    std::vector<ActionSummary> perGroup(m_groups.size());
+    ThreadPool pool(m_options.threads);
+    pool.parallelFor(m_groups.size(), [&](std::size_t i) {
+        std::string log;
+        processGroup(m_groups[i], perGroup[i], log);
+        if (m_onMessage && !log.empty()) {
+            std::lock_guard<std::mutex> lock(m_messageMutex);
+            m_onMessage(log);
+        }
+    });
+
+    ActionSummary total;
+    for (const auto& summary : perGroup) {
+        total.add(summary);
+    }
+    return total;
+}
+
+void DedupAction::processGroup(const DuplicateGroup& group, ActionSummary& summary, std::string& log) const {
+    const fs::path& source = group.files[0];
+    struct stat srcStat;
+    if (::stat(source.c_str(), &srcStat) != 0 || (std::uintmax_t)srcStat.st_size != group.size ||
+        mtimeOf(srcStat) != group.mtimes[0]) {
+        summary.changed += group.files.size() - 1;
+        log += "Skipped group of " + source.string() + ": it changed since the scan\n";
+        return;
+    }
+
+    int srcFd = -1;
+    bool reflinkWorks = m_options.mode != ActionOptions::Mode::Hardlink;
+    //The reference files lead the group; only the files after them are targets.
+    for (std::size_t i = std::max<std::size_t>(1, group.references); i < group.files.size(); ++i) {
+        const fs::path& target = group.files[i];
+        if (isProtected(target)) {
+            summary.failed++;
+            log += "Refused to change " + target.string() + ": it is inside a reference directory\n";
+            continue;
+        }
+        struct stat st;
+        if (::stat(target.c_str(), &st) != 0 || (std::uintmax_t)st.st_size != group.size ||
+            mtimeOf(st) != group.mtimes[i]) {
+            summary.changed++;
+            log += "Skipped " + target.string() + ": it changed since the scan\n";
+            continue;
+        }
+        if (st.st_dev == srcStat.st_dev && st.st_ino == srcStat.st_ino) {
+            summary.alreadyShared++;
+            continue;
+        }
+
+        if (m_options.dryRun) {
+            //Neither a reflink nor a hard link crosses a filesystem, whatever the mode.
+            if (st.st_dev == srcStat.st_dev) {
+                summary.planned++;
+                summary.bytesReclaimed += group.size;
+                log += "Would share " + target.string() + " with " + source.string() + "\n";
+            } else {
+                summary.failed++;
+                log += "Cannot share " + target.string() + ": on another device\n";
+            }
+            continue;
+        }
+
+        if (reflinkWorks) {
+            if (srcFd < 0) srcFd = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+            //Without CAP_SYS_ADMIN older kernels want the destination open for writing.
+            int dstFd = ::open(target.c_str(), O_RDWR | O_CLOEXEC);
+            if (dstFd < 0) dstFd = ::open(target.c_str(), O_RDONLY | O_CLOEXEC);
+            int res = (srcFd < 0 || dstFd < 0) ? -errno : dedupeRange(srcFd, dstFd, group.size);
+            if (dstFd >= 0) ::close(dstFd);
+
+            if (res == 0) {
+                summary.reflinked++;
+                summary.bytesReclaimed += group.size;
+                log += "Reflinked " + target.string() + " to " + source.string() + "\n";
+                continue;
+            }
+            if (res == 1) {
+                summary.failed++;
+                log += "Not shared " + target.string() + ": the kernel found different bytes\n";
+                continue;
+            }
+            if (!unsupported(-res) || m_options.mode == ActionOptions::Mode::Reflink) {
+                summary.failed++;
+                log += "Cannot reflink " + target.string() + ": " + std::strerror(-res) + ", left as it is\n";
+                continue;
+            }
+            //The filesystem can't share extents; no point trying again for the rest of the group.
+            reflinkWorks = false;
+        }
+
+        if (st.st_dev != srcStat.st_dev) {
+            summary.failed++;
+            log += "Cannot hardlink " + target.string() + ": on another device\n";
+            continue;
+        }
+        int res = replaceWithLink(source, target);
+        if (res == 0) {
+            summary.hardlinked++;
+            summary.bytesReclaimed += group.size;
+            log += "Hardlinked " + target.string() + " to " + source.string() + "\n";
+        } else {
+            summary.failed++;
+            log += "Cannot hardlink " + target.string() + ": " + std::strerror(-res) + "\n";
+        }
+    }
+    if (srcFd >= 0) ::close(srcFd);
+}
@@ -0,0 +1,94 @@
+#ifndef DEDUPACTION_HPP
+#define DEDUPACTION_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ScanResult.hpp"
+
+/**
+ * @struct ActionOptions
+ * @brief How DedupAction reclaims the space of exact duplicate groups.
+ */
+struct ActionOptions {
+    enum class Mode {
+        Auto,       // FIDEDUPERANGE, falling back to a hardlink where the filesystem can't share extents.
+        Reflink,    // FIDEDUPERANGE only.
+        Hardlink    // Hardlinks only.
+    };
+
+    Mode mode = Mode::Auto;
+    bool dryRun = false;        // Only check and report what would be done.
+    unsigned threads = 0;       // Groups processed in parallel, 0 = hardware concurrency.
+    std::vector<std::string> protectedRoots;    // Trees in which no file is ever changed, e.g. the reference trees.
+};
+
+/**
+ * @struct ActionSummary
+ * @brief What DedupAction did, in files.
+ */
+struct ActionSummary {
+    std::size_t reflinked = 0;          // Extents now shared with the group's first file.
+    std::size_t hardlinked = 0;         // Replaced by a hardlink to the group's first file.
+    std::size_t planned = 0;            // Dry run: would have been reflinked or hardlinked.
+    std::size_t alreadyShared = 0;      // Already the same inode as the first file.
+    std::size_t changed = 0;            // Size or mtime changed since the scan, left alone.
+    std::size_t failed = 0;             // The kernel found different bytes, or the action failed.
+    std::uintmax_t bytesReclaimed = 0;  // Sum of the sizes of reflinked/hardlinked (or planned) files.
+
+    void add(const ActionSummary& other);
+};
+
+/**
+ * @class DedupAction
+ * @brief Reclaims the space taken by exact duplicate groups.
+ *
+ * Every other file of a group is made to share storage with the group's first
+ * file: through the FIDEDUPERANGE ioctl on filesystems that share extents
+ * (btrfs, XFS), where the kernel compares the bytes itself before sharing them,
+ * or by atomically replacing the file with a hardlink on the same device.
+ * A hardlinked file takes the owner and permissions of the first file.
+ *
+ * Before touching a file its size and mtime are compared with the ones
+ * recorded by the scan; files which changed in between are skipped. The
+ * reference files at the front of a cross-tree group, and any file under one
+ * of the protected roots, are never changed.
+ * Groups are processed in parallel.
+ */
+class DedupAction {
+public:
+    explicit DedupAction(const ActionOptions& options);
+
+    /**
+     * @brief Sets the function receiving one line per file acted on or skipped.
+     *
+     * Called from the worker threads, but never concurrently.
+     */
+    void setMessageCallback(MessageCallback callback) { m_onMessage = std::move(callback); }
+
+    /**
+     * @brief Queues a group. Only exact groups confirmed by BLAKE3, with recorded mtimes and a file
+     * outside the reference trees, are kept.
+     */
+    void add(const DuplicateGroup& group);
+
+    /**
+     * @brief Processes all queued groups.
+     */
+    ActionSummary run();
+
+private:
+    ActionOptions m_options;
+    MessageCallback m_onMessage;
+    std::mutex m_messageMutex;
+    std::vector<DuplicateGroup> m_groups;
+    std::vector<std::filesystem::path> m_protected;     // protectedRoots, absolute and normalized.
+
+    bool isProtected(const std::filesystem::path& file) const;
+    void processGroup(const DuplicateGroup& group, ActionSummary& summary, std::string& log) const;
+};
+
+#endif // DEDUPACTION_HPP
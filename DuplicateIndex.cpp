@@ -0,0 +1,142 @@
+#include "DuplicateIndex.hpp"
+#include "BufferedWriter.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char kMagic[8] = {'D', 'D', 'U', 'P', 'I', 'D', 'X', '1'};
+
+DuplicateIndex::~DuplicateIndex() {
+    close();
+}
+
+void DuplicateIndex::close() {
+    if (m_map) {
+        munmap(m_map, m_mapSize);
+    }
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_header = nullptr;
+}
+
+bool DuplicateIndex::write(const std::string& file, std::vector<Entry>& entries) {
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        if (a.size != b.size) return a.size < b.size;
+        return a.digest < b.digest;
+    });
+
+    std::vector<SizeBucket> sizes;
+    for (std::uint64_t i = 0; i < entries.size(); ++i) {
+        if (sizes.empty() || sizes.back().size != entries[i].size) {
+            sizes.push_back(SizeBucket{entries[i].size, i, 0});
+        }
+        sizes.back().count++;
+    }
+
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.fileCount = entries.size();
+    header.sizeCount = sizes.size();
+    header.sizesOffset = sizeof(Header);
+    header.digestsOffset = header.sizesOffset + sizes.size() * sizeof(SizeBucket);
+    header.pathOffsetsOffset = header.digestsOffset + entries.size() * sizeof(Digest);
+    header.pathsOffset = header.pathOffsetsOffset + (entries.size() + 1) * sizeof(std::uint64_t);
+    for (const auto& e : entries) {
+        header.pathsSize += e.path.size();
+    }
+
+    BufferedWriter out(file);
+    if (!out.ok()) {
+        return false;
+    }
+    out.write(&header, sizeof(header));
+    out.write(sizes.data(), sizes.size() * sizeof(SizeBucket));
+    for (const auto& e : entries) {
+        out.write(e.digest.data(), e.digest.size());
+    }
+    std::uint64_t offset = 0;
+    for (const auto& e : entries) {
+        out.write(&offset, sizeof(offset));
+        offset += e.path.size();
+    }
+    out.write(&offset, sizeof(offset));
+    for (const auto& e : entries) {
+        out.write(e.path);
+    }
+    return out.flush();
+}
+
+bool DuplicateIndex::open(const std::string& file, std::string& error) {
+    close();
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (std::size_t)st.st_size < sizeof(Header)) {
+        error = "not an index file";
+        ::close(fd);
+        return false;
+    }
+    m_mapSize = (std::size_t)st.st_size;
+    m_map = mmap(nullptr, m_mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m_map == MAP_FAILED) {
+        m_map = nullptr;
+        error = std::strerror(errno);
+        return false;
+    }
+    //Lookups jump around the file.
+    madvise(m_map, m_mapSize, MADV_RANDOM);
+
+    const char* base = static_cast<const char*>(m_map);
+    m_header = reinterpret_cast<const Header*>(base);
+    const Header& h = *m_header;
+    //Only the section bounds are checked, the contents are trusted.
+    bool valid = std::memcmp(h.magic, kMagic, sizeof(kMagic)) == 0 &&
+                 h.sizesOffset == sizeof(Header) &&
+                 h.digestsOffset == h.sizesOffset + h.sizeCount * sizeof(SizeBucket) &&
+                 h.pathOffsetsOffset == h.digestsOffset + h.fileCount * sizeof(Digest) &&
+                 h.pathsOffset == h.pathOffsetsOffset + (h.fileCount + 1) * sizeof(std::uint64_t) &&
+                 h.pathsOffset + h.pathsSize == m_mapSize;
+    if (!valid) {
+        close();
+        error = "not an index file or truncated";
+        return false;
+    }
+    m_sizes = reinterpret_cast<const SizeBucket*>(base + h.sizesOffset);
+    m_digests = reinterpret_cast<const Digest*>(base + h.digestsOffset);
+    m_pathOffsets = reinterpret_cast<const std::uint64_t*>(base + h.pathOffsetsOffset);
+    m_paths = base + h.pathsOffset;
+    return true;
+}
+
+const DuplicateIndex::SizeBucket* DuplicateIndex::bucket(std::uint64_t size) const {
+    if (!m_header) return nullptr;
+    const SizeBucket* end = m_sizes + m_header->sizeCount;
+    const SizeBucket* it = std::lower_bound(m_sizes, end, size,
+        [](const SizeBucket& b, std::uint64_t s) { return b.size < s; });
+    return (it != end && it->size == size) ? it : nullptr;
+}
+
+bool DuplicateIndex::hasSize(std::uint64_t size) const {
+    return bucket(size) != nullptr;
+}
+
+std::pair<std::uint64_t, std::uint64_t> DuplicateIndex::find(std::uint64_t size, const Digest& digest) const {
+    const SizeBucket* b = bucket(size);
+    if (!b) return {0, 0};
+    auto range = std::equal_range(m_digests + b->first, m_digests + b->first + b->count, digest);
+    return {(std::uint64_t)(range.first - m_digests), (std::uint64_t)(range.second - m_digests)};
+}
+
+std::string_view DuplicateIndex::path(std::uint64_t id) const {
+    return std::string_view(m_paths + m_pathOffsets[id], m_pathOffsets[id + 1] - m_pathOffsets[id]);
+}
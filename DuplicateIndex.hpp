@@ -0,0 +1,104 @@
+#ifndef DUPLICATEINDEX_HPP
+#define DUPLICATEINDEX_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Checksum.hpp"
+
+/**
+ * @class DuplicateIndex
+ * @brief Read-only, memory-mapped index of file sizes and BLAKE3 digests.
+ *
+ * The file is used in place after mmap, nothing is parsed on load. Layout
+ * (native byte order, all offsets from the start of the file):
+ *
+ * - Header: magic "DDUPIDX1", then the counts and section offsets below.
+ * - SizeBucket[sizeCount]: (size, first record, record count), sorted by size.
+ * - digest[fileCount][32]: sorted by (size, digest), so each size bucket is a
+ *   sorted run of digests. The record number is the path id.
+ * - uint64 pathOffsets[fileCount + 1]: path id i is the bytes
+ *   [pathOffsets[i], pathOffsets[i + 1]) of the path section.
+ * - The path bytes.
+ *
+ * A lookup is a binary search over the sizes and one over the digests of that size.
+ */
+class DuplicateIndex {
+public:
+    using Digest = std::array<std::uint8_t, Checksum::DigestSize>;
+
+    struct Entry {
+        std::uint64_t size = 0;
+        Digest digest{};
+        std::string path;
+    };
+
+    DuplicateIndex() = default;
+    ~DuplicateIndex();
+
+    DuplicateIndex(const DuplicateIndex&) = delete;
+    DuplicateIndex& operator=(const DuplicateIndex&) = delete;
+
+    /**
+     * @brief Writes an index file. entries is sorted in place.
+     * @return false if the file couldn't be written.
+     */
+    static bool write(const std::string& file, std::vector<Entry>& entries);
+
+    /**
+     * @brief Maps an index file written by write().
+     * @param error Receives the reason on failure.
+     * @return false if the file can't be opened or isn't a valid index.
+     */
+    bool open(const std::string& file, std::string& error);
+
+    std::uint64_t fileCount() const { return m_header ? m_header->fileCount : 0; }
+
+    /**
+     * @brief Whether any indexed file has this size. Files of other sizes can't be duplicates.
+     */
+    bool hasSize(std::uint64_t size) const;
+
+    /**
+     * @brief Returns the path ids [first, last) of the indexed files with this size and digest.
+     */
+    std::pair<std::uint64_t, std::uint64_t> find(std::uint64_t size, const Digest& digest) const;
+
+    std::string_view path(std::uint64_t id) const;
+
+private:
+    struct Header {
+        char magic[8];
+        std::uint64_t fileCount;
+        std::uint64_t sizeCount;
+        std::uint64_t sizesOffset;
+        std::uint64_t digestsOffset;
+        std::uint64_t pathOffsetsOffset;
+        std::uint64_t pathsOffset;
+        std::uint64_t pathsSize;
+    };
+
+    struct SizeBucket {
+        std::uint64_t size;
+        std::uint64_t first;
+        std::uint64_t count;
+    };
+
+    void* m_map = nullptr;
+    std::size_t m_mapSize = 0;
+    const Header* m_header = nullptr;
+    const SizeBucket* m_sizes = nullptr;
+    const Digest* m_digests = nullptr;
+    const std::uint64_t* m_pathOffsets = nullptr;
+    const char* m_paths = nullptr;
+
+    const SizeBucket* bucket(std::uint64_t size) const;
+    void close();
+};
+
+#endif // DUPLICATEINDEX_HPP
@@ -0,0 +1,142 @@
+#include "ExifThumbnail.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+//Reads the byte order of a TIFF structure ("II" little endian, "MM" big endian) with bounds checks.
+class TiffReader {
+public:
+    TiffReader(const std::uint8_t* data, std::size_t size) : m_data(data), m_size(size) {}
+
+    bool init() {
+        if (m_size < 8) return false;
+        if (m_data[0] == 'I' && m_data[1] == 'I') m_little = true;
+        else if (m_data[0] == 'M' && m_data[1] == 'M') m_little = false;
+        else return false;
+        std::uint32_t magic;
+        return u16(2, magic) && magic == 42;
+    }
+
+    bool u16(std::size_t at, std::uint32_t& value) const { return get(at, 2, value); }
+    bool u32(std::size_t at, std::uint32_t& value) const { return get(at, 4, value); }
+
+private:
+    const std::uint8_t* m_data;
+    std::size_t m_size;
+    bool m_little = true;
+
+    bool get(std::size_t at, int bytes, std::uint32_t& value) const {
+        if (at > m_size || m_size - at < (std::size_t)bytes) return false;
+        value = 0;
+        for (int i = 0; i < bytes; ++i) {
+            const std::uint32_t b = m_data[at + (m_little ? bytes - 1 - i : i)];
+            value = (value << 8) | b;
+        }
+        return true;
+    }
+};
+
+//Finds the thumbnail in the TIFF structure of the EXIF data, offsets relative to its start.
+bool findInTiff(const std::uint8_t* tiff, std::size_t size, std::size_t& offset, std::size_t& length) {
+    TiffReader r(tiff, size);
+    std::uint32_t ifd0, count, ifd1;
+    if (!r.init() || !r.u32(4, ifd0) || !r.u16(ifd0, count)) return false;
+    //IFD0 is only skipped: its entries are 12 bytes each, then the offset of IFD1.
+    if (!r.u32((std::size_t)ifd0 + 2 + (std::size_t)count * 12, ifd1) || ifd1 == 0) return false;
+    if (!r.u16(ifd1, count)) return false;
+    std::uint32_t start = 0, bytes = 0;
+    for (std::uint32_t i = 0; i < count; ++i) {
+        const std::size_t entry = (std::size_t)ifd1 + 2 + (std::size_t)i * 12;
+        std::uint32_t tag, type, value;
+        if (!r.u16(entry, tag) || !r.u16(entry + 2, type)) return false;
+        //The two tags are LONG, some writers use SHORT; either way the value sits in the entry.
+        if (!(type == 3 ? r.u16(entry + 8, value) : r.u32(entry + 8, value))) return false;
+        if (tag == 0x0201) start = value;               // JPEGInterchangeFormat
+        else if (tag == 0x0202) bytes = value;          // JPEGInterchangeFormatLength
+    }
+    if (start == 0 || bytes < 4 || start > size || size - start < bytes) return false;
+    if (tiff[start] != 0xFF || tiff[start + 1] != 0xD8) return false;
+    offset = start;
+    length = bytes;
+    return true;
+}
+
+}
+
+bool ExifThumbnail::find(const std::uint8_t* data, std::size_t size, std::size_t& offset, std::size_t& length,
+                         std::size_t& needed) {
+    needed = 0;
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) return false;
+    std::size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xFF) return false;
+        const std::uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {                           // Fill byte.
+            pos++;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+            pos += 2;                                   // Markers without a length.
+            continue;
+        }
+        //The EXIF data comes before the image data; nothing after SOS or EOI is metadata.
+        if (marker == 0xDA || marker == 0xD9) return false;
+        const std::size_t segment = ((std::size_t)data[pos + 2] << 8) | data[pos + 3];
+        if (segment < 2) return false;
+        const std::size_t begin = pos + 4, end = pos + 2 + segment;
+        if (marker == 0xE1) {
+            if (end > size) {
+                needed = end;
+                return false;
+            }
+            if (end - begin >= 6 && std::memcmp(data + begin, "Exif\0\0", 6) == 0 &&
+                findInTiff(data + begin + 6, end - begin - 6, offset, length)) {
+                offset += begin + 6;
+                return true;
+            }
+        }
+        pos = end;
+    }
+    return false;
+}
+
+//Reads up to size bytes at offset, returns the number read.
+static std::size_t readAt(int fd, std::uint8_t* data, std::size_t size, std::size_t offset) {
+    std::size_t filled = 0;
+    while (filled < size) {
+        ssize_t got = ::pread(fd, data + filled, size - filled, (off_t)(offset + filled));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        filled += (std::size_t)got;
+    }
+    return filled;
+}
+
+bool ExifThumbnail::read(const std::string& path, std::vector<std::uint8_t>& thumbnail) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<std::uint8_t> head(4096);
+    head.resize(readAt(fd, head.data(), head.size(), 0));
+    std::size_t offset, length, needed;
+    bool found = find(head.data(), head.size(), offset, length, needed);
+    //An APP1 segment is at most 64 KB, so a second read is enough.
+    if (!found && needed > head.size() && needed <= head.size() + 70000) {
+        std::size_t have = head.size();
+        head.resize(needed);
+        head.resize(have + readAt(fd, head.data() + have, needed - have, have));
+        found = find(head.data(), head.size(), offset, length, needed);
+    }
+    ::close(fd);
+    if (!found) {
+        return false;
+    }
+    thumbnail.assign(head.begin() + offset, head.begin() + offset + length);
+    return true;
+}
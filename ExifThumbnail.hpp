@@ -0,0 +1,44 @@
+#ifndef EXIFTHUMBNAIL_HPP
+#define EXIFTHUMBNAIL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class ExifThumbnail
+ * @brief Finds the small JPEG thumbnail cameras embed in the EXIF data of a JPEG file.
+ *
+ * The EXIF data is the APP1 segment ("Exif\0\0" followed by a TIFF structure)
+ * near the start of the file. Its second image file directory (IFD1) describes
+ * the thumbnail, and the JPEGInterchangeFormat tags give its offset and length
+ * inside the TIFF structure. Only the segment markers and the two IFDs are
+ * parsed; everything is bounds checked, so a damaged file just has no thumbnail.
+ */
+class ExifThumbnail {
+public:
+    /**
+     * @brief Locates the thumbnail in the first bytes of a JPEG file.
+     * @param data Start of the file.
+     * @param size Bytes available at data.
+     * @param offset Receives the offset of the thumbnail from the start of the file.
+     * @param length Receives the length of the thumbnail.
+     * @param needed Receives the bytes needed to find it when the APP1 segment goes past size, 0 otherwise.
+     * @return true if the thumbnail was found and lies within size.
+     */
+    static bool find(const std::uint8_t* data, std::size_t size, std::size_t& offset, std::size_t& length,
+                     std::size_t& needed);
+
+    /**
+     * @brief Reads the thumbnail of a JPEG file without reading the rest of the file.
+     *
+     * The first 4 KB are read, and the rest of the APP1 segment (at most 64 KB)
+     * only if the segment is longer.
+     * @param thumbnail Receives the JPEG bytes of the thumbnail.
+     * @return false if the file has no thumbnail or couldn't be read.
+     */
+    static bool read(const std::string& path, std::vector<std::uint8_t>& thumbnail);
+};
+
+#endif // EXIFTHUMBNAIL_HPP
@@ -0,0 +1,21 @@
+#include "FastHash.hpp"
+
+//The implementation of the vendored header is compiled here, once.
+#define XXH_IMPLEMENTATION
+#include "third_party/xxhash/xxhash.h"
+
+FastHash::FastHash() {
+    XXH3_128bits_reset(&m_state);
+}
+
+void FastHash::update(const void* data, std::size_t size) {
+    XXH3_128bits_update(&m_state, data, size);
+}
+
+void FastHash::finalize(std::uint8_t* digest) const {
+    XXH128_canonical_t canonical;
+    XXH128_canonicalFromHash(&canonical, XXH3_128bits_digest(&m_state));
+    for (int i = 0; i < DigestSize; ++i) {
+        digest[i] = canonical.digest[i];
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef FASTHASH_HPP
+#define FASTHASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#define XXH_STATIC_LINKING_ONLY     // XXH3_state_t, so the state can live in the object.
+#include "third_party/xxhash/xxhash.h"
+
+/**
+ * @class FastHash
+ * @brief Streaming 128 bit non-cryptographic hash, for telling files apart quickly.
+ *
+ * XXH3-128 from the vendored xxHash (third_party/xxhash); the digest is its
+ * canonical big endian form, the one xxh128sum prints.
+ *
+ * It is only a prefilter, meant to drop files whose contents differ. It is not
+ * collision resistant against files made to collide, so equal digests are
+ * confirmed with BLAKE3 before any file is changed.
+ */
+class FastHash {
+public:
+    static constexpr int DigestSize = 16;
+
+    FastHash();
+
+    void update(const void* data, std::size_t size);
+
+    /**
+     * @brief Writes the DigestSize byte digest of everything passed to update().
+     */
+    void finalize(std::uint8_t* digest) const;
+
+private:
+    XXH3_state_t m_state;
+};
+
+#endif // FASTHASH_HPP
@@ -1,38 +1,42 @@
 #include "FileInfo.hpp"
+#include <array>
 #include <system_error>  // for std::error_code
 #include <sys/stat.h>
 #include <opencv2/opencv.hpp>
 #include "Checksum.hpp"
 /**
- * @brief Reads the size of the file at the stored path.
+ * @brief Reads the size and modification time of the file at `path`.
  *
- * This function uses std::filesystem to read the size of the file pointed to by `m_path`.
- * It stores the result in `m_size`. If an error occurs during size retrieval,
- * the function returns false.
+ * It stores the results in `m_size` and `m_mtime`. If the file can't be stat'ed
+ * or isn't a regular file, the function returns false.
  *
  * @return true if the file size was read successfully, false otherwise.
  */
-bool FileInfo::readFileSize() {
-    std::error_code ec;
-    m_size = std::filesystem::file_size(m_path, ec);
-    if (ec) return false;
+bool FileInfo::readFileSize(const std::filesystem::path& path) {
+    //One stat gives both the size and the modification time, which actions later recheck.
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+    m_size = (filesizetype)st.st_size;
+    m_mtime = (std::int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
     return true;
 }
 
 /**
- * @brief Reads the first few bytes of the file and stores them in `m_somebytes`.
+ * @brief Reads the first few bytes of the file and stores their fingerprint in `m_prefix`.
  *
- * This function opens the file in binary mode and reads up to fixed size of bytes returned by getBufferSize().
- * into the internal buffer `m_somebytes`. The buffer is initialized with null characters.
+ * This function opens the file in binary mode and reads up to fixed size of bytes returned by getBufferSize()
+ * into a buffer on the stack, initialized with null characters, which is fingerprinted whole.
  *
  * @return 0 if bytes were successfully read, -1 if the file could not be opened.
  */
-int FileInfo::readFirstBytes() {
-  m_somebytes.fill('\0');
-  std::ifstream file(m_path, std::ios::in | std::ios::binary);
+int FileInfo::readFirstBytes(const std::string& path) {
+  std::array<char, m_FixedReadSize> bytes;
+  bytes.fill('\0');
+  std::ifstream file(path, std::ios::in | std::ios::binary);
   if (!file.is_open()) return -1;
 
-  file.read(m_somebytes.data(), getBufferSize());
+  file.read(bytes.data(), bytes.size());
+  m_prefix = Checksum::fingerprint(bytes.data(), bytes.size());
   return 0;
 }
 
@@ -1,18 +1,21 @@
 #ifndef FILEINFO_HPP
 #define FILEINFO_HPP
 
-#include <array>
+#include <cstdint>
 #include <string>
 #include <filesystem>
 #include <fstream>
 #include "Checksum.hpp"
+#include "PathStore.hpp"
 
 /**
  * @class FileInfo
  * @brief Stores metadata about a file using std::filesystem.
  * 
- * This class encapsulates file attributes such as size, path, etc
+ * This class encapsulates file attributes such as size, hashes, etc
  * using the `std::filesystem` library for efficient and portable file information gathering.
+ * The path itself lives in a PathStore; a FileInfo only keeps its 32 bit id, and the
+ * functions which open the file take the materialized path as a parameter.
  */
 class FileInfo {
 public:
@@ -20,18 +23,19 @@ public:
     using filesizetype = std::uintmax_t;
 
     /**
-     * @brief Constructs a FileInfo object with the given path.
-     * @param path Filesystem path of the file.
+     * @brief Constructs a FileInfo object for the given path.
+     * @param pathId Id of the file's path in the scan's PathStore.
      */
-    explicit FileInfo(const std::filesystem::path& path)
-        :m_path(path)
+    explicit FileInfo(PathId pathId)
+        :m_pathId(pathId)
         {}
 
     /**
-     * @brief Reads the size of the file and stores it in m_size.
+     * @brief Reads the size and modification time of the file.
+     * @param path Path of this file.
      * @return true if successful, false otherwise.
      */
-    bool readFileSize();
+    bool readFileSize(const std::filesystem::path& path);
 
     /**
      * @brief Sets the delete flag for this file.
@@ -45,6 +49,12 @@ public:
      */
     bool checkRemoveUniqueFlag() const{return m_remove_unique_flag;}
 
+    /**
+     * @brief Marks the file as coming from a reference tree rather than the target tree.
+     */
+    void setReference(bool reference){m_reference=reference;}
+    bool isReference() const{return m_reference;}
+
     /**
      * @brief Returns the file size in bytes.
      * @return File size as `filesizetype`.
@@ -52,16 +62,30 @@ public:
     filesizetype getSize() const {return m_size;}
 
     /**
-     * @brief Returns the original path of the file.
-     * @return Path object referencing the full file path.
+     * @brief Returns the modification time read by readFileSize, in nanoseconds since the epoch.
+     */
+    std::int64_t getMtime() const {return m_mtime;}
+
+    /**
+     * @brief Returns the id of the file's path.
+     * @return Id to be resolved with PathStore::string or PathStore::path.
+     */
+    PathId getPathId() const {return m_pathId;}
+
+    /**
+     * @brief Sets the id of the file's path, used when the path is recorded after the size check.
      */
-    const std::filesystem::path& getPath() const {return m_path;}
+    void setPathId(PathId pathId){m_pathId=pathId;}
     
     /**
-     * @brief Reads a fixed amount of first bytes from the file and stores them in a buffer.
+     * @brief Reads a fixed amount of first bytes from the file and keeps their fingerprint.
+     *
+     * Only the 64 bit fingerprint is kept (see Checksum::fingerprint), not the
+     * bytes, so a FileInfo stays small whether or not its prefix was read.
+     * @param path Path of this file.
      * @return 0 if successful, -1 if the file couldn't be opened.
      */
-    int readFirstBytes();
+    int readFirstBytes(const std::string& path);
 
     /**
      * @brief Returns the fixed number of bytes read from the file.
@@ -69,23 +93,72 @@ public:
      */
     std::size_t getBufferSize() const{return m_FixedReadSize;}
 
-    //I use this in memcmp in utility.cpp.
-    /// get a pointer to the bytes read from the file
-    //The .data function returns a pointer to m_somebytes.
-    const char* getbyteptr() const {return m_somebytes.data();}
+    /**
+     * @brief Fingerprint of the first bytes, set by readFirstBytes.
+     *
+     * Different fingerprints mean different first bytes; equal ones only mean the
+     * files are worth hashing.
+     */
+    std::uint64_t getPrefix() const {return m_prefix;}
 
     /**
      * @brief Computes and sets the BLAKE3 hash for this file.
      * 
-     * This function computes the BLAKE3 hash of the file located at the path 
-     * stored in this FileInfo object and assigns the result to m_blake3_val.
+     * This function computes the BLAKE3 hash of the file located at the given
+     * path and assigns the result to m_blake3_val.
+     * @param path Path of this file.
      */
-    void setBlake3() {
-        m_blake3_val = Checksum::compute(m_path.string());
+    void setBlake3(const std::string& path) {
+        m_blake3_val = Checksum::compute(path);
     }
 
-    void setImgHash(){
-        m_phash_val=Checksum::computeImagePHash64(m_path.string());
+    /**
+     * @brief setBlake3 which stops once deadlineNs passes, see Checksum::computeDigestBefore.
+     * @return 1 if the hash was set, 0 if the deadline passed first (no hash), -1 if the file couldn't be opened.
+     */
+    int setBlake3Before(const std::string& path, uint64_t deadlineNs) {
+        uint8_t digest[Checksum::DigestSize];
+        int res = Checksum::computeDigestBefore(path, digest, deadlineNs);
+        m_blake3_val = res > 0 ? Checksum::toHex(digest) : std::string();
+        return res;
+    }
+
+    /**
+     * @brief Computes and sets the 128 bit FastHash of this file (see Checksum::computeFast).
+     */
+    void setFastHash(const std::string& path) {
+        m_fast_val = Checksum::computeFast(path);
+    }
+
+    const std::string& getFastHash() const{return m_fast_val;}
+
+    /**
+     * @brief Takes the fast hash as the file's content hash, when BLAKE3 is skipped.
+     */
+    void trustFastHash() {
+        m_blake3_val = m_fast_val;
+    }
+
+    /**
+     * @brief Sets the BLAKE3 hash of a small file, read whole in one call (see Checksum::computeSmall).
+     */
+    void setBlake3Small(const std::string& path, std::vector<char>& buffer) {
+        m_blake3_val = Checksum::computeSmall(path, m_size, buffer);
+    }
+
+    void setImgHash(const std::string& path){
+        m_phash_val=Checksum::computeImagePHash64(path);
+    }
+
+    /**
+     * @brief Computes the BLAKE3 hash and the image hash from a single read of the file.
+     */
+    void setBlake3AndImgHash(const std::string& path, bool useThumbnail = false){
+        Checksum::computeWithImageHash(path, m_blake3_val, m_phash_val, useThumbnail);
+    }
+
+    void setImgHash(uint64_t hash){
+        m_phash_val=hash;
     }
 
     uint64_t getImgHash() const{
@@ -98,8 +171,11 @@ public:
     int getDuration() const{
         return m_duration;
     }
-    void setVideoHashes(){
-        m_video_hashes=Checksum::setVideoHashes(m_path.string());
+    void setVideoHashes(const std::string& path, int numSamples = 10){
+        m_video_hashes=Checksum::setVideoHashes(path, numSamples);
+    }
+    void setVideoHashes(std::vector<uint64_t> hashes){
+        m_video_hashes=std::move(hashes);
     }
 
     const std::vector<uint64_t>& getVideoHashVector() const{
@@ -113,16 +189,19 @@ public:
 
 
 private:
-    std::filesystem::path m_path;               // Full file or directory path.
+    PathId m_pathId;                            // Id of the full path in the scan's PathStore.
     filesizetype m_size = 0;                    // File size in bytes.(Setting 0 as default.)
+    std::int64_t m_mtime = 0;                   // Modification time in ns, used to detect changes before acting.
     bool m_remove_unique_flag = false;          // True if file should be removed during cleanup.
+    bool m_reference = false;                   // True if the file was found under a reference root.
     
     //constexpr within class must be static.
     //For it to be shared across all instances as a single copy in memory
     //it must be made static.
     static constexpr std::size_t m_FixedReadSize=4096;
-    std::array<char, m_FixedReadSize> m_somebytes;
+    std::uint64_t m_prefix = 0;                 // Fingerprint of the first m_FixedReadSize bytes.
     std::string m_blake3_val;
+    std::string m_fast_val;                     // Hex FastHash, set only when the two-tier hashing runs.
     uint64_t m_phash_val=0;
     int m_duration=0;
     std::vector<uint64_t> m_video_hashes;
@@ -132,73 +132,130 @@
 //     return -1;
 // }
 
+#include <cerrno>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <sys/stat.h>
 #include "FileTree.hpp"
 
 namespace fs = std::filesystem;
 
+void FileTree::message(const std::string& text) const {
+    if (m_onMessage) {
+        m_onMessage(text);
+    } else {
+        std::cerr << text;
+    }
+}
+
 int FileTree::walk(const std::string& dir, int recursionLevel) {
-    fs::path dirPath(dir);
+    return walkDir(fs::path(dir), PathStore::npos, recursionLevel);
+}
+
+int FileTree::walkDir(const fs::path& dirPath, PathId parentId, int recursionLevel, const struct stat* st) {
     std::error_code ec;
 
-    fs::file_status stat = fs::symlink_status(dirPath, ec);
-    if (ec) {
-        std::cerr << "Error getting status of " << dirPath << ": " << ec.message() << "\n";
-        return -1;
+    //One lstat gives both the type and the identity of the directory.
+    struct stat own;
+    if (!st) {
+        if (::lstat(dirPath.c_str(), &own) != 0) {
+            const int err = errno;
+            std::ostringstream msg;
+            msg << "Error getting status of " << dirPath << ": " << std::strerror(err) << "\n";
+            message(msg.str());
+            return -1;
+        }
+        if (!S_ISDIR(own.st_mode)) {
+            return handlePossibleFile(dirPath, recursionLevel);
+        }
+        st = &own;
     }
 
-    if (fs::is_symlink(stat)) {
-        return handlePossibleFile(dirPath, recursionLevel);
+    if (!visitedDirs.insert(DirKey{st->st_dev, st->st_ino}).second) {
+        return 0;
     }
 
-    if (!fs::is_directory(stat)) {
-        return handlePossibleFile(dirPath, recursionLevel);
-    }
+    //Covers the subdirectories as well, they show up nested below this event.
+    Tracer::Scope scope(m_tracer, "walk_dir", "walk", dirPath.native());
 
-    fs::path canonicalPath = fs::weakly_canonical(dirPath, ec);
-    if (ec) {
-        std::cerr << "Error resolving canonical path for " << dirPath << "\n";
-        return -1;
+    //The directory is recorded once; its files only add their own name below it.
+    PathId dirId = PathStore::npos;
+    if (m_store) {
+        dirId = (parentId == PathStore::npos) ? m_store->addRoot(dirPath.string())
+                                              : m_store->add(parentId, dirPath.filename().string());
     }
 
-    if (visitedDirs.count(canonicalPath)) {
-        return 0;
+    if (m_onDirectory && !m_onDirectory(dirPath, dirId)) {
+        skipped(parentId);
+        skipped(dirId);
+        return 2;
     }
 
-    visitedDirs.insert(canonicalPath);
-
-    for (const auto& entry : fs::directory_iterator(dirPath, fs::directory_options::skip_permission_denied, ec)) {
+    //A directory which can't be opened (permission denied included) is only partly known,
+    //not empty: it and its parent are reported as skipped.
+    fs::directory_iterator it(dirPath, ec);
+    if (ec) {
+        std::ostringstream msg;
+        msg << "Error opening directory " << dirPath << ": " << ec.message() << '\n';
+        message(msg.str());
+        skipped(parentId);
+        skipped(dirId);
+        return 2;
+    }
+    for (; it != fs::directory_iterator(); it.increment(ec)) {
         if (ec) {
-            std::cerr << "Error reading path " << entry.path() << ": " << ec.message() << '\n';
-            continue;
+            std::ostringstream msg;
+            msg << "Error reading directory " << dirPath << ": " << ec.message() << '\n';
+            message(msg.str());
+            skipped(dirId);
+            break;
         }
+        const fs::directory_entry& entry = *it;
 
         const auto& path = entry.path();
         std::error_code status_ec;
         fs::file_status entryStat = entry.symlink_status(status_ec);
         if (status_ec) {
-            std::cerr << "Error: Cannot get file status for " << path << ": " << status_ec.message() << "\n";
+            std::ostringstream msg;
+            msg << "Error: Cannot get file status for " << path << ": " << status_ec.message() << "\n";
+            message(msg.str());
+            skipped(dirId);
             continue;
         }
 
         if (fs::is_symlink(entryStat)) {
-            if (m_followsymlinks) {
-                if (fs::is_directory(path, ec)) {
-                    if (!ec) {
-                        int res = walk(path.string(), recursionLevel + 1);
-                        if (res < 0) return res;
-                    }
-                }
+            //The stat of the target is the key, so a link back up the tree is seen as visited.
+            struct stat target;
+            if (m_followsymlinks && ::stat(path.c_str(), &target) == 0 && S_ISDIR(target.st_mode) &&
+                !(m_filter && m_filter->skipDirectory(path))) {
+                int res = walkDir(path, dirId, recursionLevel + 1, &target);
+                if (res < 0) return res;
+                if (res == 0) skipped(dirId);
+            } else {
+                skipped(dirId);
             }
         } else if (fs::is_directory(entryStat)) {
-            int res = walk(path.string(), recursionLevel + 1);
+            //Prune here, before the subdirectory is opened.
+            if (m_filter && m_filter->skipDirectory(path)) {
+                skipped(dirId);
+                continue;
+            }
+            int res = walkDir(path, dirId, recursionLevel + 1);
             if (res < 0) return res;
+            if (res == 0) skipped(dirId);
         } else if (fs::is_regular_file(entryStat)) {
+            if (m_filter && !m_filter->acceptFile(entry)) {
+                skipped(dirId);
+                continue;
+            }
             if (m_callback) {
-                m_callback(path);
+                m_callback(path, dirId);
             }
+        } else {
+            skipped(dirId);
         }
     }
 
@@ -210,42 +267,43 @@ int FileTree::handlePossibleFile(const fs::path& possibleFile, int recursionLeve
     std::error_code ec;
 
     if (!fs::exists(possibleFile, ec)) {
-        std::cerr << "Argument passed doesn't exist\n";
+        message("Argument passed doesn't exist\n");
         return -1;
     }
 
     fs::file_status stat = fs::symlink_status(possibleFile, ec);
     if (ec) {
-        std::cerr << "Error getting status for file: " << possibleFile << ": " << ec.message() << "\n";
+        std::ostringstream msg;
+        msg << "Error getting status for file: " << possibleFile << ": " << ec.message() << "\n";
+        message(msg.str());
         return -1;
     }
 
     if (fs::is_symlink(stat)) {
         if (m_followsymlinks) {
-            fs::path resolvedPath = fs::weakly_canonical(possibleFile, ec);
-            if (ec) {
-                std::cerr << "Error resolving symlink target: " << possibleFile << ": " << ec.message() << "\n";
+            struct stat target;
+            if (::stat(possibleFile.c_str(), &target) != 0) {
+                const int err = errno;
+                std::ostringstream msg;
+                msg << "Error resolving symlink target: " << possibleFile << ": " << std::strerror(err) << "\n";
+                message(msg.str());
                 return -1;
             }
 
-            if (fs::is_directory(resolvedPath, ec)) {
-                if (ec) {
-                    std::cerr << "Error checking if resolved path is directory: " << resolvedPath << ": " << ec.message() << "\n";
-                    return -1;
-                }
-                return walk(resolvedPath.string(), recursionLevel + 1);
+            if (S_ISDIR(target.st_mode)) {
+                return walkDir(possibleFile, PathStore::npos, recursionLevel + 1, &target);
             }
         } else {
-            std::cout << "Cannot follow symlink. Set parameter to true in input to follow\n";
+            message("Cannot follow symlink. Set parameter to true in input to follow\n");
             return -1;
         }
     }
 
     if (fs::is_regular_file(stat)) {
-        std::cout << "You passed a file as the argument. No duplicates to check\n";
+        message("You passed a file as the argument. No duplicates to check\n");
         return 0;
     }
 
-    std::cout << "Dirlist::handlePossibleFile: Unrecognized file type.\n";
+    message("Dirlist::handlePossibleFile: Unrecognized file type.\n");
     return -1;
 }
@@ -3,7 +3,12 @@
 
 #include <string>
 #include <filesystem>
+#include <functional>
 #include <unordered_set>
+#include <sys/stat.h>
+#include "PathFilter.hpp"
+#include "PathStore.hpp"
+#include "Tracer.hpp"
 
 /**
  * @class FileTree
@@ -22,30 +27,111 @@ public:
    */
   explicit FileTree(bool followsymlinks)
       : m_followsymlinks(followsymlinks), 
-        m_callback(nullptr) 
+        m_callback(nullptr),
+        m_filter(nullptr),
+        m_store(nullptr),
+        m_tracer(nullptr),
+        m_onMessage(nullptr),
+        m_onSkip(nullptr),
+        m_onDirectory(nullptr)
         {}
 
   /**
    * @brief Callback function type for reporting files.
    * 
    * The callback receives:
-   * - the full directory path
+   * - the full path of the file
+   * - the PathStore id of the directory containing it (PathStore::npos without a store),
+   *   so a callback keeping the file only has to add its name
+   * It may carry state (e.g. a lambda capturing a ScanContext), so the walker
+   * doesn't depend on any global file list.
    */
-  using ReportFcnType = int (*)(const std::filesystem::path&);
+  using ReportFcnType = std::function<int(const std::filesystem::path&, PathId)>;
 
   /**
    * @brief Set the callback function to be invoked for each discovered file.
-   * @param reportFcn Pointer to the callback function
+   * @param reportFcn The callback function
    */
-  void setCallback(ReportFcnType reportFcn) { m_callback = reportFcn; }
+  void setCallback(ReportFcnType reportFcn) { m_callback = std::move(reportFcn); }
+
+  /**
+   * @brief Callback function type for the walk's warnings and errors.
+   */
+  using MessageFcnType = std::function<void(const std::string&)>;
+
+  /**
+   * @brief Set the function receiving the walk's warnings and errors.
+   * 
+   * Without one they go to std::cerr; the walker never writes to std::cout.
+   * @param messageFcn The callback, or nullptr.
+   */
+  void setMessageCallback(MessageFcnType messageFcn) { m_onMessage = std::move(messageFcn); }
+
+  /**
+   * @brief Callback function type for entries the walk leaves out.
+   * 
+   * It receives the PathStore id of the directory holding the entry.
+   */
+  using SkipFcnType = std::function<void(PathId)>;
+
+  /**
+   * @brief Set the function told about every entry which is neither reported nor walked.
+   * 
+   * That is an entry rejected by the filter, one whose status can't be read, a file
+   * which is not regular, a symlink which isn't followed, or a directory already
+   * visited elsewhere. A directory with such an entry is only partly known.
+   * @param skipFcn The callback, or nullptr.
+   */
+  void setSkipCallback(SkipFcnType skipFcn) { m_onSkip = std::move(skipFcn); }
+
+  /**
+   * @brief Callback function type for directories, called as each one is entered.
+   * 
+   * It receives the path of the directory and its PathStore id, and returns
+   * false to leave the directory out, unread.
+   */
+  using DirectoryFcnType = std::function<bool(const std::filesystem::path&, PathId)>;
+
+  /**
+   * @brief Set the function called for every directory walked, before its entries are read.
+   * 
+   * A directory it declines is reported to the skip callback like one which can't be opened.
+   * @param dirFcn The callback, or nullptr.
+   */
+  void setDirectoryCallback(DirectoryFcnType dirFcn) { m_onDirectory = std::move(dirFcn); }
+
+  /**
+   * @brief Set the include/exclude rules applied while walking.
+   * 
+   * Directories rejected by the filter are not opened at all, and files
+   * rejected by it never reach the callback. The filter must outlive the walk.
+   * @param filter Compiled filter, or nullptr to report everything.
+   */
+  void setFilter(const PathFilter* filter) { m_filter = filter; }
+
+  /**
+   * @brief Set the store in which every walked directory is recorded.
+   * @param store The store, or nullptr if no ids are needed. It must outlive the walk.
+   */
+  void setPathStore(PathStore* store) { m_store = store; }
+
+  /**
+   * @brief Set the tracer receiving one event per walked directory.
+   * @param tracer The tracer, or nullptr. It must outlive the walk.
+   */
+  void setTracer(Tracer* tracer) { m_tracer = tracer; }
 
   /**
    * @brief Recursively walk through a directory tree and report files/symlinks.
    * 
    * @param dir Starting directory path
    * @param recursionLevel Current depth of the recursion (default = 0)
+   * Directories are told apart by device and inode, so a directory reached
+   * twice (through a followed symlink or a bind mount) is walked once, and a
+   * symlink pointing back up the tree ends the recursion.
+   * 
    * @return 
-   *          : -1 if canonical path cannot be resolved.  
+   *          : -1 if the status of the directory cannot be read.  
    *          :  0 incase the directory/file is already visited.
    *          :  1 if the given path is not a directory  
    *          :  2 if the directory was processed successfully  
@@ -55,7 +141,35 @@ public:
 private:
   bool m_followsymlinks;      // Whether to follow symbolic links.
   ReportFcnType m_callback;   // Callback to invoke for each discovered file.
-  std::unordered_set<std::filesystem::path> visitedDirs;
+  const PathFilter* m_filter; // Rules deciding which subtrees and files are skipped.
+  PathStore* m_store;         // Receives the (parent, name) record of each directory.
+  Tracer* m_tracer;           // Optional, records the time spent in each directory.
+  MessageFcnType m_onMessage; // Receives warnings and errors, std::cerr if unset.
+  SkipFcnType m_onSkip;       // Told about the entries left out of a directory.
+  DirectoryFcnType m_onDirectory; // Told about each directory before it is read.
+
+  /** @brief Identity of a visited directory, 16 bytes instead of its canonical path. */
+  struct DirKey {
+    dev_t dev;
+    ino_t ino;
+    bool operator==(const DirKey& o) const { return dev == o.dev && ino == o.ino; }
+  };
+  struct DirKeyHash {
+    std::size_t operator()(const DirKey& k) const {
+      return std::hash<ino_t>()(k.ino) ^ (std::hash<dev_t>()(k.dev) * 0x9E3779B97F4A7C15ULL);
+    }
+  };
+  std::unordered_set<DirKey, DirKeyHash> visitedDirs;
+
+  /**
+   * @brief Passes a warning or error to the message callback.
+   */
+  void message(const std::string& text) const;
+
+  /**
+   * @brief Passes the directory of a left out entry to the skip callback.
+   */
+  void skipped(PathId dirId) const { if (m_onSkip && dirId != PathStore::npos) m_onSkip(dirId); }
 
   /**
    * @brief Handles a file that was expected to be a directory but isn't.
@@ -69,6 +183,15 @@ private:
    *         : 0 if it was a valid symlink or regular file
    */
   int handlePossibleFile(const std::filesystem::path& possibleFile, int recursionLevel);
+
+  /**
+   * @brief Walks one directory, recording it below parentId.
+   * @param st Status of dirPath when the caller already has it (the target of a
+   *           followed symlink), nullptr to lstat it here.
+   * @return Same values as walk().
+   */
+  int walkDir(const std::filesystem::path& dirPath, PathId parentId, int recursionLevel,
+              const struct stat* st = nullptr);
 };
 
 #endif // FILETREE_HH
@@ -1,66 +1,116 @@
 #include "Manager.hpp"
-#include "Utility.hpp"
-#include "FileTree.hpp"
-#include "BKTree.hpp"
-
-#include <unordered_set>
-
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-//Code for exact deduplication.
-
-//Global Usage of fileList.
-std::vector<FileInfo> fileList;
-
-std::string beautify(uintmax_t size) {
-    std::ostringstream oss;
-    oss << std::fixed << std::setprecision(2);
-    
-    if (size >= 1073741824) {
-        oss << (double)size / 1073741824 << " GB";
-    } else if (size >= 1048576) {
-        oss << (double)size / 1048576 << " MB";
-    } else if (size >= 1024) {
-        oss << (double)size / 1024 << " KB";
-    } else {
-        oss << size << " B";
+#include "ResultSink.hpp"
+#include "DuplicateIndex.hpp"
+#include "ScanContext.hpp"
+#include "ShardFile.hpp"
+#include "Watcher.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+
+#include <csignal>
+#include <unistd.h>
+
+//Writes one of the optional outputs to a file, or std::cout for "-".
+static void writeOutput(const std::string& file, const char* what, const std::function<void(std::ostream&)>& write) {
+    if (file.empty()) {
+        return;
+    }
+    if (file == "-") {
+        write(std::cout);
+        return;
     }
+    std::ofstream out(file);
+    if (!out) {
+        std::cerr << "Cannot write " << what << " to " << file << "\n";
+        return;
+    }
+    write(out);
+}
 
-    return oss.str();
+//Writes the metrics summary and the trace of the finished scan, if they were asked for.
+static void writeExtras(const ScanContext& context, const ReportOptions& report) {
+    writeOutput(report.metricsFile, "metrics", [&](std::ostream& out) { out << context.getMetrics().toJson(); });
+    writeOutput(report.traceFile, "trace", [&](std::ostream& out) { context.getTracer().writeJson(out); });
 }
 
-bool is_in_skipped_dir(const std::filesystem::path& path) {
-    //static ensures that the set is initialized only once. The first time the function is called.
-    //Hence every time the function is called reinitialization doesn't take place. This makes it faster.
-    static const std::unordered_set<std::string> skipDuplication = {
-        ".git", ".config", ".cache", ".vscode", ".local", ".venv", ".mozilla", ".thunderbird"
-    };
-    for (const auto& part : path) {
-        if (skipDuplication.count(part.string())) return true;
-    }
-    return false;
+//Acts on the collected exact groups and reports what was done.
+static void runAction(DedupAction& action, ResultSink& sink, bool dryRun) {
+    sink.message(dryRun ? "\n=== Dry run ===\n" : "\n=== Reclaiming space ===\n");
+    action.setMessageCallback([&sink](const std::string& text) { sink.message(text); });
+    ActionSummary done = action.run();
+
+    std::ostringstream msg;
+    if (dryRun) {
+        msg << "Would share:     " << done.planned << " files\n";
+    } else {
+        msg << "Reflinked:       " << done.reflinked << " files\n";
+        msg << "Hardlinked:      " << done.hardlinked << " files\n";
+    }
+    msg << "Already shared:  " << done.alreadyShared << " files\n";
+    msg << "Changed:         " << done.changed << " files\n";
+    msg << "Failed:          " << done.failed << " files\n";
+    msg << (dryRun ? "Would reclaim:   " : "Reclaimed:       ") << done.bytesReclaimed << " bytes\n";
+    sink.message(msg.str());
 }
 
 /**
- * @brief Callback function to process a file or directory during traversal.
- *
- * This function checks if the given file should be skipped based on its path.
- * If it is not skipped and is a regular file of at least 1KB, it is added to the global file list.
- *
- * @param path The full path being scanned.
- * @return Return -1 if file is part of skipped directory and 0 if given file is successfully added to fileList.
+ * @brief Runs one scan, streaming its groups to the sink selected in report.
+ * @param heading First line of the report, followed by the quoted root.
+ * @param scan The ScanContext search to run.
+ * @param summary Whether to end with the per-kind group counts.
  */
-int dedup_report(const std::filesystem::path& path_name) {
-    if(is_in_skipped_dir(path_name)){
-        return -1;
+static void run(const ScanOptions& options, const ReportOptions& report, const char* heading,
+                const std::function<int(ScanContext&)>& scan, bool summary) {
+    BufferedWriter out(report.outputFile);
+    if (!out.ok()) {
+        return;
+    }
+    std::unique_ptr<ResultSink> sink = ResultSink::create(report.format, out);
+    if (!sink) {
+        std::cerr << "Unknown output format " << report.format << "\n";
+        return;
     }
 
-    FileInfo fi(path_name);
-
-    if (fi.readFileSize() && fi.getSize() >= 1024) {
-        fileList.push_back(fi);
+    std::ostringstream msg;
+    msg << heading << std::filesystem::path(options.root) << "\n";
+    sink->message(msg.str());
+
+    ScanContext context(options);
+    ActionOptions actionOptions = report.action;
+    actionOptions.protectedRoots = options.referenceRoots;
+    DedupAction action(actionOptions);
+    context.setMessageCallback([&sink](const std::string& text) { sink->message(text); });
+    //A budgeted scan may be cut short, so its groups are written out as soon as they are confirmed.
+    const bool progressive = options.timeBudgetSec > 0 || options.byteBudget > 0;
+    context.setGroupCallback([&](const DuplicateGroup& group) {
+        sink->group(group);
+        if (progressive) out.flush();
+        if (report.act) action.add(group);
+    });
+    if (scan(context) < 0) {
+        sink->finish();
+        return;
     }
 
-    return 0;
+    if (summary) {
+        msg.str("");
+        msg << "\n=== Summary ===\n";
+        msg << "Exact duplicate groups: " << sink->groups(DuplicateGroup::Kind::Exact) << "\n";
+        msg << "Similar image groups:   " << sink->groups(DuplicateGroup::Kind::Image) << "\n";
+        msg << "Similar video groups:   " << sink->groups(DuplicateGroup::Kind::Video) << "\n";
+        msg << "Wasted bytes:           " << sink->wastedBytes() << "\n";
+        sink->message(msg.str());
+    }
+    if (report.act) {
+        runAction(action, *sink, report.action.dryRun);
+    }
+    //The report has to be out before the extras, which may also go to standard output.
+    sink->finish();
+    writeExtras(context, report);
 }
 
 /**
@@ -71,338 +121,294 @@ int dedup_report(const std::filesystem::path& path_name) {
  * - Removing files with unique sizes
  * - Removing files with unique beginning byte patterns
  * - Removing files with unique hash values
- * - Grouping and printing remaining files by identical sizes
+ * - Reporting remaining files grouped by identical size and hash
  *
- * @param filename Path to the directory in which to search for duplicate files.
- * @param follow_symlinks Whether to follow symlinks or not.
+ * @param options Directory to search in and the rest of the scan options.
+ * @param report Output format and extra outputs, such as the metrics summary or the trace.
  */
-void Manager::findExactDuplicates(char* filename, bool follow_symlinks) {
-
-    std::filesystem::path dir(filename);
-    std::cout << "Searching for files in directory: " << dir << "\n";
+void Manager::findExactDuplicates(const ScanOptions& options, const ReportOptions& report) {
+    run(options, report, "Searching for files in directory: ", std::mem_fn(&ScanContext::findExactDuplicates), false);
+}
 
-    FileTree walker(follow_symlinks);
-    walker.setCallback(&dedup_report);
-    int status=walker.walk(dir.string());
+void Manager::findSimilarImages(const ScanOptions& options, const ReportOptions& report) {
+    run(options, report, "Searching for image files in directory: ", std::mem_fn(&ScanContext::findSimilarImages), false);
+}
 
-    if(status==-1 || status==0){
-        return ;
-    }
+void Manager::findSimilarVideos(const ScanOptions& options, const ReportOptions& report) {
+    run(options, report, "Searching for video files in directory: ", std::mem_fn(&ScanContext::findSimilarVideos), false);
+}
 
-    if(fileList.size()==0){
-        std::cout<<"File List is empty."<<"\n";
-        return;
-    }
+void Manager::findAll(const ScanOptions& options, const ReportOptions& report) {
+    run(options, report, "Searching for duplicate files, images and videos in directory: ",
+        std::mem_fn(&ScanContext::findAll), true);
+}
 
-    std::cout << "Total files before filtering: " << fileList.size() << "\n";
+void Manager::findCrossTreeDuplicates(const ScanOptions& options, const ReportOptions& report) {
+    run(options, report, "Searching for files already in the reference directories in: ",
+        std::mem_fn(&ScanContext::findCrossTreeDuplicates), false);
+}
 
-    //This object of Utility class is used to find duplicate files using various techniques.
-    Utility deduper(fileList);
+void Manager::findChunkDuplicates(const ScanOptions& options, const ReportOptions& report) {
+    run(options, report, "Searching for files sharing chunks in directory: ",
+        std::mem_fn(&ScanContext::findChunkDuplicates), false);
+}
 
-    //1.
-    //removeUniqueSizes removes all the files with unique file size within the mentioned directory and 
-    //following sub-directories and returns the number of removed files.
-    std::size_t removed = deduper.removeUniqueSizes();
-    std::cout << "Removed " << removed << " files with unique sizes.\n";
-    std::cout << "Files remaining: " << fileList.size() << "\n\n";
+void Manager::estimate(const ScanOptions& options, const ReportOptions& report) {
+    run(options, report, "Estimating the duplicate bytes in directory: ",
+        std::mem_fn(&ScanContext::estimateDuplicates), false);
+}
 
-    if(fileList.size()==0){
-        return ;
-    }
+void Manager::buildIndex(const ScanOptions& options, const ReportOptions& report) {
+    run(options, report, "Indexing files in directory: ",
+        [&report](ScanContext& context) { return context.writeIndex(report.indexFile); }, false);
+}
 
-    //2.
-    // This serves as a quick content-based pre-filter to eliminate files that differ early,
-    // reducing the workload for full hashing.
-    for (auto& file : fileList) {
-        if(file.readFirstBytes()!=0){
-            file.setRemoveUniqueFlag(true);
-        }
+/**
+ * @brief Reports every query file which has the same content as an indexed file.
+ *
+ * Only query files whose size occurs in the index are hashed; the indexed
+ * files are never read. Each match is reported as an exact group with the
+ * query file first.
+ */
+void Manager::query(const std::vector<std::string>& paths, const ReportOptions& report) {
+    DuplicateIndex index;
+    std::string error;
+    if (!index.open(report.indexFile, error)) {
+        std::cerr << "Cannot open index " << report.indexFile << ": " << error << "\n";
+        return;
     }
-    removed=deduper.removeMarkedFiles();
-    if(removed!=0){
-        std::cout<<"Removed "<<removed<<" files which couldn't be opened\n";
+    BufferedWriter out(report.outputFile);
+    if (!out.ok()) {
+        return;
     }
-    //removeUniqueBuffer removes all the files with unique firstbytes(default buffer size set to 4kB)
-    //and returns the total number of such removed files.
-    removed = deduper.removeUniqueBuffer();
-    std::cout << "Removed " << removed << " files with unique first bytes.\n";
-    std::cout << "Files remaining " << fileList.size() << "\n\n";
-
-    if(fileList.size()==0){
-        return ;
+    std::unique_ptr<ResultSink> sink = ResultSink::create(report.format, out);
+    if (!sink) {
+        std::cerr << "Unknown output format " << report.format << "\n";
+        return;
     }
 
-    //3.
-    //The setHash function is used to hash the contents of the entire file and store it in the form 
-    //of a string in the member-variable of the class FileInfo called m_blake3_val.
-    for(auto &file: fileList){
-        file.setBlake3();
-        if(file.getBlake3().empty()){
-            file.setRemoveUniqueFlag(true);
+    std::size_t queried = 0, hashed = 0, duplicates = 0;
+    auto check = [&](const std::string& name) {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        if (!fs::is_regular_file(name, ec)) {
+            sink->message("Not a regular file: " + name + "\n");
+            return;
         }
-    }
-    removed=deduper.removeMarkedFiles();
-    if(removed!=0){
-        std::cout<<"Removed "<<removed<<" files which couldn't be opened\n";
-    }
-
-    //removeUniqueHashes removes all the files with unique hashes from the fileList and returns the number
-    //of files which it removed.
-    removed = deduper.removeUniqueHashes();
-    std::cout << "Removed " << removed << " files with unique hashes\n";
-    std::cout << "Files remaining " << fileList.size() << "\n\n";
-
-    if(fileList.size()==0){
-        return ;
-    }
-
-    //This is used to sort the FileList based on the size of the files.
-    deduper.sortFilesBySize();
-
-    //The code given below is to display all files which are duplicates and their regarding details.
-    int count = 1;
-    int beg = 0;
-    for (size_t i = 1; i < fileList.size(); ++i) {
-        if (fileList[i].getSize() == fileList[i - 1].getSize()) {
-            count++;
-        } else {
-            int interval = beg + count;
-            std::cout << "Found " << count << " files of size " << beautify(fileList[beg].getSize()) << "\n";
-            for (int j = beg; j < interval; j++) {
-                std::cout << fileList[j].getPath() << "\n";
-            }
-            std::cout << "\n\n";
-            beg = i;
-            count = 1;
+        queried++;
+        std::uint64_t size = fs::file_size(name, ec);
+        if (ec || !index.hasSize(size)) {
+            return;
         }
-    }
-
-    // This will always get executed.
-    if (count != 1) {
-        int interval = beg + count;
-        std::cout << "Found " << count << " files of size " << beautify(fileList[beg].getSize()) << "\n";
-        for (int j = beg; j < interval; j++) {
-            std::cout << fileList[j].getPath() << "\n";
+        DuplicateIndex::Digest digest;
+        hashed++;
+        if (!Checksum::computeDigest(name, digest.data())) {
+            sink->message("Cannot read " + name + "\n");
+            return;
         }
-    }
-
-    std::cout << "\n\n";
-}
-
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-//For detecting similar images.
-
-bool is_image_file(const std::filesystem::path& path) {
-    //static ensures that the set is initialized only once. The first time the function is called.
-    //Hence every time the function is called reinitialization doesn't take place. This makes it faster.
-    static const std::unordered_set<std::string> image_extensions = {
-        ".jpg", ".jpeg", ".png", ".bmp", ".tiff", ".tif", ".gif", ".webp"
+        const std::string self = fs::absolute(name, ec).lexically_normal().string();
+        DuplicateGroup group;
+        group.kind = DuplicateGroup::Kind::Exact;
+        group.size = size;
+        group.files.push_back(name);
+        auto range = index.find(size, digest);
+        for (std::uint64_t id = range.first; id < range.second; ++id) {
+            //A query file which is itself indexed doesn't duplicate itself.
+            if (index.path(id) != self) group.files.push_back(std::string(index.path(id)));
+        }
+        if (group.files.size() < 2) {
+            return;
+        }
+        group.hash = Checksum::toHex(digest.data());
+        group.wastedBytes = size;
+        sink->group(group);
+        duplicates++;
     };
 
-    std::string ext = path.extension().string();
-    //std::transform(InputBegin, InputEnd, OutputBegin, UnaryFunction);
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-    return image_extensions.count(ext) > 0;
-}
-
-int img_report(const std::filesystem::path& path_name) {
-
-    if (is_in_skipped_dir(path_name)) {
-        return -1;
-    }
-
-    if (!is_image_file(path_name)) {
-        return -1;
-    }
-
-    cv::Mat img = cv::imread(path_name.string(), cv::IMREAD_UNCHANGED);
-    if (img.empty()) {
-        return -1;
+    //Paths come from the command line, or one per line from standard input.
+    if (paths.empty() || (paths.size() == 1 && paths[0] == "-")) {
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            if (!line.empty()) check(line);
+        }
+    } else {
+        for (const auto& path : paths) check(path);
     }
 
-    FileInfo obj(path_name);
-    fileList.emplace_back(obj);
-    return 0;
+    std::ostringstream msg;
+    msg << "Queried " << queried << " files against " << index.fileCount() << " indexed files: "
+        << duplicates << " duplicates, " << hashed << " hashed\n";
+    sink->message(msg.str());
+    sink->finish();
 }
 
-
-void printSimilarGroups(const std::vector<FileInfo>& fileList, const BKTree& tree, int& ifvideo, int threshold=10){
-    //std::cout<<"FileList size "<<fileList.size()<<"\n";
-    std::set<std::filesystem::path> visited;
-    int count=0;
-    // std::cout<<"Function called"<<"\n";
-    for(const auto &file: fileList){
-        if(visited.count(file.getPath())) continue;
-
-        std::vector<FileInfo> similar;
-        tree.findSimilar(file.getImgHash(), threshold, similar, visited);
-
-
-        if(similar.size()>1){
-            if(ifvideo){
-                std::cout<<"Group "<<(ifvideo)<<"\n";
-                ifvideo++;
-            }
-            else{
-                std::cout<<"Group "<<(++count)<<"\n";
-            }
-            for(const auto& img: similar){
-                std::cout<<" - "<<img.getPath()<<"\n";
-                visited.insert(img.getPath());
-            }
-            std::cout<<"\n";
-        }
-        else{
-            visited.insert(file.getPath());
-        }
+void Manager::writeShard(const ScanOptions& options, const ReportOptions& report) {
+    std::string name = report.shardName;
+    if (name.empty()) {
+        char host[256] = {};
+        gethostname(host, sizeof(host) - 1);
+        name = host;
     }
+    run(options, report, "Writing shard of directory: ",
+        [&](ScanContext& context) { return context.writeShard(report.shardFile, name); }, false);
 }
 
-void Manager::findSimilarImages(char* filename, bool follow_symlinks){
-    std::filesystem::path dir(filename);
-    std::cout << "Searching for image files in directory: " << dir << "\n";
-
-    // This function is used to walk the specified directory.
-    //The false here indicates that the program should not follow symlinks.
-    FileTree walker(follow_symlinks);
-    walker.setCallback(&img_report);
-    int status=walker.walk(dir.string());
+void Manager::completeShard(const ScanOptions& options, const ReportOptions& report) {
+    run(options, report, "Hashing the work list entries of shard: ",
+        [&report](ScanContext& context) { return context.completeShard(report.shardFile, report.workList); }, false);
+}
 
-    if(status==1){
-        return ;
-    }
-    else if(status==-1){
-        return ;
+/**
+ * @brief Merges shard files into exact duplicate groups.
+ *
+ * Records are grouped by (size, prefix fingerprint) across all shards. A
+ * group with a single record can't hold a duplicate. A group whose records
+ * all have digests is split by digest and reported; otherwise its records
+ * without a digest go to the work list as "<shard name>\t<path>" lines and the
+ * group waits for the next merge. When all shards have the same name paths are
+ * reported as they are, otherwise as "<shard name>:<path>".
+ */
+void Manager::mergeShards(const std::vector<std::string>& shardFiles, const ReportOptions& report) {
+    std::vector<ShardFile> shards(shardFiles.size());
+    bool sameName = true;
+    for (std::size_t i = 0; i < shardFiles.size(); ++i) {
+        std::string error;
+        if (!shards[i].read(shardFiles[i], error)) {
+            std::cerr << "Cannot read shard " << shardFiles[i] << ": " << error << "\n";
+            return;
+        }
+        sameName = sameName && shards[i].name == shards[0].name;
     }
-
-    if(fileList.size()==0){
-        std::cout<<"File List is empty."<<"\n";
+    BufferedWriter out(report.outputFile);
+    if (!out.ok()) {
         return;
     }
-    for(auto &it: fileList){
-        it.setImgHash();
-        if(it.getImgHash()==0){
-            it.setRemoveUniqueFlag(true);
-        }
+    std::unique_ptr<ResultSink> sink = ResultSink::create(report.format, out);
+    if (!sink) {
+        std::cerr << "Unknown output format " << report.format << "\n";
+        return;
     }
-    Utility deduper(fileList);
-    std::size_t removed=deduper.removeMarkedFiles();
-    if(removed){
-        std::cout<<"Removed "<<removed<<" images which could not be opened for hashing.\n";
+    BufferedWriter work(report.workList);
+    if (report.workList.empty() || report.workList == "-" || !work.ok()) {
+        sink->message("The work list needs a file of its own: " + report.workList + "\n");
+        sink->finish();
+        return;
     }
-    std::cout<<"Total images to be processed: "<<fileList.size()<<"\n";
 
-    BKTree tree;
-    for(auto &file: fileList){
-        tree.insert(file);
+    //(shard, record) pairs, sorted so that every candidate group is one run.
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> refs;
+    for (std::size_t s = 0; s < shards.size(); ++s) {
+        for (std::size_t r = 0; r < shards[s].records.size(); ++r) refs.emplace_back(s, r);
     }
-    int ifvideo=0;
-    printSimilarGroups(fileList, tree, ifvideo);
-    std::cout<<"Finished processing similar images\n";
-}
-
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-//For finding different vidoes which differ only in terms of quality.
-
-bool is_video_file(const std::filesystem::path& path) {
-    //static ensures that the set is initialized only once. The first time the function is called.
-    //Hence every time the function is called reinitialization doesn't take place. This makes it faster.
-    static const std::unordered_set<std::string> videoExtensions = {
-        ".mp4", ".mkv", ".avi", ".mov", ".flv", ".wmv", ".webm"
+    auto rec = [&](const std::pair<std::uint32_t, std::uint32_t>& ref) -> const ShardFile::Record& {
+        return shards[ref.first].records[ref.second];
     };
-
-    std::string ext = path.extension().string();
-    //std::transform(InputBegin, InputEnd, OutputBegin, UnaryFunction);
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-    return videoExtensions.count(ext) > 0;
-}
-
-int vid_report(const std::filesystem::path& path_name) {
-    if(is_in_skipped_dir(path_name)){
-        return -1;
-    }
-
-    if(!is_video_file(path_name)){
-        return -1;
-    }
-
-    cv::VideoCapture cap(path_name.string());
-    if(!cap.isOpened()){
-        return -1; //Not a video file.
+    auto candidate = [&](const auto& a, const auto& b) {
+        return std::make_pair(rec(a).size, rec(a).prefix) < std::make_pair(rec(b).size, rec(b).prefix);
+    };
+    std::sort(refs.begin(), refs.end(), candidate);
+
+    std::size_t pending = 0, groups = 0;
+    DuplicateGroup group;
+    group.kind = DuplicateGroup::Kind::Exact;
+    for (std::size_t beg = 0, end; beg < refs.size(); beg = end) {
+        for (end = beg + 1; end < refs.size() && !candidate(refs[beg], refs[end]); ++end) {}
+        if (end - beg < 2) continue;
+
+        bool complete = true;
+        for (std::size_t i = beg; i < end; ++i) {
+            if (rec(refs[i]).hasDigest) continue;
+            complete = false;
+            work.write(shards[refs[i].first].name);
+            work.put('\t');
+            work.write(rec(refs[i]).path);
+            work.put('\n');
+            pending++;
+        }
+        if (!complete) continue;
+
+        std::sort(refs.begin() + beg, refs.begin() + end,
+                  [&](const auto& a, const auto& b) { return rec(a).digest < rec(b).digest; });
+        for (std::size_t first = beg, last; first < end; first = last) {
+            for (last = first + 1; last < end && rec(refs[last]).digest == rec(refs[first]).digest; ++last) {}
+            if (last - first < 2) continue;
+            group.size = rec(refs[first]).size;
+            group.hash = Checksum::toHex(rec(refs[first]).digest.data());
+            group.wastedBytes = group.size * (last - first - 1);
+            group.files.clear();
+            group.mtimes.clear();
+            for (std::size_t i = first; i < last; ++i) {
+                const std::string& path = rec(refs[i]).path;
+                group.files.push_back(sameName ? path : shards[refs[i].first].name + ":" + path);
+                group.mtimes.push_back(rec(refs[i]).mtime);
+            }
+            sink->group(group);
+            groups++;
+        }
     }
-
-    double totalFrames=cap.get(cv::CAP_PROP_FRAME_COUNT);
-    double fps=cap.get(cv::CAP_PROP_FPS);
-
-    if(fps<=0 || totalFrames<=0){
-        return -1;
+    if (!work.flush()) {
+        sink->message("Cannot write the work list to " + report.workList + "\n");
     }
-    FileInfo file(path_name);
-    int duration=(int)(totalFrames/fps);
-    file.setDuration(duration);
-    fileList.emplace_back(file);
 
-    return 0;
+    std::ostringstream msg;
+    msg << "Merged " << refs.size() << " records from " << shards.size() << " shards: "
+        << groups << " groups, " << pending << " files still to hash";
+    if (pending) msg << " (listed in " << report.workList << ", run complete on each shard and merge again)";
+    msg << "\n";
+    sink->message(msg.str());
+    sink->finish();
 }
 
-bool cmpDurationValFile(const int& a, const FileInfo& b) {
-    return a < b.getDuration();
-}
-
-void Manager::findSimilarVideos(char* filename, bool follow_symlinks){
-    std::filesystem::path dir(filename);
-    std::cout << "Searching for video files in directory: " << dir << "\n";
+static volatile std::sig_atomic_t g_stopWatching = 0;
 
-    FileTree walker(follow_symlinks);
-    walker.setCallback(&vid_report);
-    int status=walker.walk(dir.string());
+static void onInterrupt(int) {
+    g_stopWatching = 1;
+}
 
-    if(status==1){
-        return ;
-    }
-    else if(status==-1){
-        return ;
+void Manager::watch(const ScanOptions& options, const ReportOptions& report) {
+    BufferedWriter out(report.outputFile);
+    if (!out.ok()) {
+        return;
     }
-
-    if(fileList.size()==0){
-        std::cout<<"File List is empty."<<"\n";
+    std::unique_ptr<ResultSink> sink = ResultSink::create(report.format, out);
+    if (!sink) {
+        std::cerr << "Unknown output format " << report.format << "\n";
         return;
     }
-    
-    std::cout<<"Found "<<fileList.size()<<" video files in "<<dir<<" directory\n";
 
-    for(auto &it: fileList){
-        it.setVideoHashes();
-        if(it.getVideoHashVector().size()==0){
-            it.setRemoveUniqueFlag(true);
-        }
-    }
-    
-    Utility deduper(fileList);
-    std::size_t removed=deduper.removeMarkedFiles();
-    if(removed){
-        std::cout<<"Removed "<<removed<<" video files which couldn't be hashed\n";
+    std::ostringstream msg;
+    msg << "Watching for duplicate files in directory: " << std::filesystem::path(options.root) << "\n";
+    sink->message(msg.str());
+
+    Watcher watcher(options);
+    watcher.setMessageCallback([&sink](const std::string& text) { sink->message(text); });
+    watcher.setGroupCallback([&sink](const DuplicateGroup& group) { sink->group(group); });
+    watcher.setResyncCallback([&sink]() { sink->resync(); });
+    if (watcher.start() < 0) {
+        sink->finish();
+        return;
     }
+    out.flush();
 
-    removed = deduper.removeUniqueDuration();//This sorts it accoring to durtion. This is why we can call upper bound below.
-    std::cout << "Removed " << removed << " files with unique duration.\n";
-    std::cout << "Files remaining: " << fileList.size() << "\n\n";
+    g_stopWatching = 0;
+    struct sigaction action {};
+    action.sa_handler = onInterrupt;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
 
-    if(fileList.size()==0){
-        return ;
-    }
-    size_t start=0, end;
-    int ifvideo=1;
-    while(start!=fileList.size()){
-        end=std::upper_bound(fileList.begin()+start, fileList.end(), fileList[start].getDuration(), cmpDurationValFile)-fileList.begin();
-        BKTree tree;
-        std::vector<FileInfo> temp;
-        while(start!=end){
-            tree.insertVideoHashes(fileList[start]);
-            temp.push_back(fileList[start]);
-            start++;
+    while (!g_stopWatching) {
+        int groups = watcher.poll(500);
+        if (groups < 0) {
+            sink->message("Lost the inotify descriptor, stopping\n");
+            break;
         }
-
-        printSimilarGroups(temp, tree, ifvideo);
+        //New matches should show up right away, not when the buffer fills.
+        if (groups > 0) out.flush();
     }
-}
\ No newline at end of file
+
+    msg.str("");
+    msg << "\nStopped watching. " << watcher.fileCount() << " files indexed, "
+        << watcher.hashedCount() << " hashed.\n";
+    sink->message(msg.str());
+    sink->finish();
+}
@@ -1,13 +1,72 @@
 #ifndef MANAGER_HPP
 #define MANAGER_HPP
+
+#include <string>
+#include <vector>
+#include "DedupAction.hpp"
+#include "ScanOptions.hpp"
+
+/**
+ * @struct ReportOptions
+ * @brief Frontend-only settings: the report format and where each output goes.
+ */
+struct ReportOptions {
+    std::string format = "text";        // text | ndjson | binary, see ResultSink.
+    std::string outputFile;             // Where the groups go, empty or "-" for standard output.
+    std::string metricsFile;            // Where the JSON metrics summary goes, "-" for std::cout. Empty = none.
+    std::string traceFile;              // Where the Chrome trace JSON goes. Empty = none.
+    std::string indexFile = "dedup.idx";  // Written by the index mode, read by the query mode.
+    std::string shardFile = "dedup.shard";  // Written by the shard mode, completed by the complete mode.
+    std::string shardName;              // Owner recorded in the shard, empty = host name.
+    std::string workList = "dedup.work";  // Written by the merge mode, read by the complete mode.
+    bool act = false;                   // Reclaim the space of exact duplicate groups after the scan.
+    ActionOptions action;
+};
+
+/**
+ * @class Manager
+ * @brief Command line frontend over ScanContext.
+ *
+ * Runs a scan and streams its groups through a ResultSink, as text by default.
+ */
 class Manager{
     public:
-        static void findExactDuplicates(char* filename, bool follow_symlinks);
+        static void findExactDuplicates(const ScanOptions& options, const ReportOptions& report = ReportOptions());
+
+        static void findSimilarImages(const ScanOptions& options, const ReportOptions& report = ReportOptions());
+
+        static void findSimilarVideos(const ScanOptions& options, const ReportOptions& report = ReportOptions());
+
+        //Walks the tree once and runs the exact, image and video analyzers with one combined report.
+        static void findAll(const ScanOptions& options, const ReportOptions& report = ReportOptions());
+
+        //Reports files under the root which also exist under one of options.referenceRoots.
+        static void findCrossTreeDuplicates(const ScanOptions& options, const ReportOptions& report = ReportOptions());
+
+        //Reports pairs of files sharing content-defined chunks and what a chunk-level dedup would reclaim.
+        static void findChunkDuplicates(const ScanOptions& options, const ReportOptions& report = ReportOptions());
+
+        //Estimates the duplicate bytes under the root from a sample, with a confidence interval.
+        static void estimate(const ScanOptions& options, const ReportOptions& report = ReportOptions());
+
+        //Hashes every file under the root into the index file, for later queries.
+        static void buildIndex(const ScanOptions& options, const ReportOptions& report = ReportOptions());
+
+        //Checks the given files (or paths read from standard input) against the index file.
+        static void query(const std::vector<std::string>& paths, const ReportOptions& report = ReportOptions());
+
+        //Writes the partial result of the root as one shard of a larger scan.
+        static void writeShard(const ScanOptions& options, const ReportOptions& report = ReportOptions());
+
+        //Combines shard files: reports the finished groups and writes the files still to hash to the work list.
+        static void mergeShards(const std::vector<std::string>& shardFiles, const ReportOptions& report = ReportOptions());
 
-        static void findSimilarImages(char* filename, bool follow_symlinks);
+        //Hashes the work list entries of the shard file and updates it, ready for the next merge.
+        static void completeShard(const ScanOptions& options, const ReportOptions& report = ReportOptions());
 
-        static void findSimilarVideos(char* filename, bool follow_symlinks);
+        //Keeps reporting new exact duplicates under the root as files change, until interrupted (Ctrl-C).
+        static void watch(const ScanOptions& options, const ReportOptions& report = ReportOptions());
         
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,184 @@
+#include "Metrics.hpp"
+
+#include <atomic>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+#include <sys/resource.h>
+#include <time.h>
+
+//Each thread remembers its counters for the instance it last worked for, so the
+//lookup under the mutex only happens the first time a thread touches a scan.
+struct MetricsSlotCache {
+    std::uint64_t owner = 0;
+    Metrics::Counters* stages = nullptr;
+};
+static thread_local MetricsSlotCache t_slotCache;
+static std::atomic<std::uint64_t> g_nextMetricsId{1};
+
+static std::uint64_t readClock(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return (std::uint64_t)ts.tv_sec * 1000000000ull + (std::uint64_t)ts.tv_nsec;
+}
+
+//Peak resident set size of the process in KB (ru_maxrss is in KB on Linux).
+static std::uint64_t peakRssKb() {
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return (std::uint64_t)usage.ru_maxrss;
+}
+
+Metrics::Metrics() : m_id(g_nextMetricsId++) {}
+
+std::uint64_t Metrics::nowNs() {
+    return readClock(CLOCK_MONOTONIC);
+}
+
+std::uint64_t Metrics::threadCpuNs() {
+    return readClock(CLOCK_THREAD_CPUTIME_ID);
+}
+
+const char* Metrics::stageName(Stage stage) {
+    switch (stage) {
+        case Stage::Walk: return "walk";
+        case Stage::SizeFilter: return "size_filter";
+        case Stage::Prefix: return "prefix";
+        case Stage::Hash: return "hash";
+        case Stage::ImageHash: return "image_hash";
+        case Stage::VideoHash: return "video_hash";
+        case Stage::Similarity: return "similarity";
+        case Stage::Report: return "report";
+        default: return "unknown";
+    }
+}
+
+void Metrics::reset(const std::string& mode) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& slot : m_slots) {
+        for (auto& counters : slot->stages) counters = Counters();
+    }
+    for (auto& counters : m_shared) counters = Counters();
+    m_mode = mode;
+    m_groups = 0;
+    m_driver = std::this_thread::get_id();
+    m_startNs = nowNs();
+}
+
+Metrics::Counters& Metrics::local(Stage stage) {
+    if (t_slotCache.owner != m_id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const std::thread::id self = std::this_thread::get_id();
+        ThreadSlot* found = nullptr;
+        for (auto& slot : m_slots) {
+            if (slot->thread == self) {
+                found = slot.get();
+                break;
+            }
+        }
+        if (!found) {
+            m_slots.push_back(std::make_unique<ThreadSlot>());
+            found = m_slots.back().get();
+            found->thread = self;
+        }
+        t_slotCache.owner = m_id;
+        t_slotCache.stages = found->stages;
+    }
+    return t_slotCache.stages[(int)stage];
+}
+
+void Metrics::setFiles(Stage stage, std::uint64_t in, std::uint64_t out) {
+    Counters& c = m_shared[(int)stage];
+    c.filesIn += in;
+    c.filesOut += out;
+    c.ran = true;
+}
+
+Metrics::Counters Metrics::total(Stage stage) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Counters sum = m_shared[(int)stage];
+    for (const auto& slot : m_slots) {
+        const Counters& c = slot->stages[(int)stage];
+        sum.cpuNs += c.cpuNs;
+        sum.filesIn += c.filesIn;
+        sum.filesOut += c.filesOut;
+        sum.bytesRead += c.bytesRead;
+        sum.filesOpened += c.filesOpened;
+        sum.decodeNs += c.decodeNs;
+        sum.ran = sum.ran || c.ran;
+    }
+    return sum;
+}
+
+std::string Metrics::toJson() const {
+    std::ostringstream oss;
+    oss << std::setprecision(6) << std::fixed;
+    oss << "{\"mode\":\"" << m_mode << "\""
+        << ",\"wall_sec\":" << (nowNs() - m_startNs) / 1e9
+        << ",\"peak_rss_kb\":" << peakRssKb()
+        << ",\"groups\":" << m_groups
+        << ",\"stages\":[";
+
+    bool first = true;
+    double cpuTotal = 0;
+    for (int s = 0; s < (int)Stage::Count; ++s) {
+        Counters c = total((Stage)s);
+        if (!c.ran) continue;
+        const double wall = c.wallNs / 1e9;
+        cpuTotal += c.cpuNs / 1e9;
+        oss << (first ? "" : ",")
+            << "{\"name\":\"" << stageName((Stage)s) << "\""
+            << ",\"wall_sec\":" << wall
+            << ",\"cpu_sec\":" << c.cpuNs / 1e9
+            << ",\"files_in\":" << c.filesIn
+            << ",\"files_out\":" << c.filesOut
+            << ",\"eliminated\":" << (c.filesIn > c.filesOut ? c.filesIn - c.filesOut : 0)
+            << ",\"bytes_read\":" << c.bytesRead
+            << ",\"files_opened\":" << c.filesOpened
+            << ",\"decode_sec\":" << c.decodeNs / 1e9
+            << ",\"mb_per_sec\":" << (wall > 0 ? c.bytesRead / wall / 1e6 : 0.0)
+            << ",\"files_per_sec\":" << (wall > 0 ? c.filesIn / wall : 0.0)
+            << ",\"peak_rss_kb\":" << c.peakRssKb << "}";
+        first = false;
+    }
+    oss << "],\"cpu_sec\":" << cpuTotal << "}\n";
+    return oss.str();
+}
+
+Metrics::StageTimer::StageTimer(Metrics& metrics, Stage stage)
+    : m_metrics(metrics), m_stage(stage)
+{
+    if (m_metrics.m_enabled) {
+        m_wallStart = nowNs();
+        m_cpuStart = threadCpuNs();
+    }
+}
+
+Metrics::StageTimer::~StageTimer() {
+    Counters& c = m_metrics.m_shared[(int)m_stage];
+    c.ran = true;
+    if (m_metrics.m_enabled) {
+        c.wallNs += nowNs() - m_wallStart;
+        c.cpuNs += threadCpuNs() - m_cpuStart;
+        std::uint64_t rss = peakRssKb();
+        if (rss > c.peakRssKb) c.peakRssKb = rss;
+    }
+}
+
+Metrics::WorkTimer::WorkTimer(Metrics& metrics, Stage stage, bool decode)
+    : m_counters(nullptr), m_decode(decode)
+{
+    if (!metrics.m_enabled) return;
+    m_counters = &metrics.local(stage);
+    //The driving thread's CPU time is already taken by its StageTimer.
+    m_countCpu = std::this_thread::get_id() != metrics.m_driver;
+    if (m_decode) m_wallStart = nowNs();
+    if (m_countCpu) m_cpuStart = threadCpuNs();
+}
+
+Metrics::WorkTimer::~WorkTimer() {
+    if (!m_counters) return;
+    if (m_decode) m_counters->decodeNs += nowNs() - m_wallStart;
+    if (m_countCpu) m_counters->cpuNs += threadCpuNs() - m_cpuStart;
+}
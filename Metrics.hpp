@@ -0,0 +1,142 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class Metrics
+ * @brief Per-stage counters of a scan: time, files in and out, bytes read, files opened.
+ *
+ * Every thread taking part in a scan gets its own block of counters, which it
+ * updates without locking or atomics. The blocks are only added up when the
+ * summary is requested, after the parallel sections have finished.
+ *
+ * Counting is always on; the clock reads behind the timers only happen when
+ * the metrics are enabled.
+ */
+class Metrics {
+public:
+    enum class Stage {
+        Walk,           // Traversal and per-file callbacks.
+        SizeFilter,     // Removing unique sizes.
+        Prefix,         // Reading and comparing the first bytes.
+        Hash,           // Full BLAKE3 and removing unique hashes.
+        ImageHash,      // Decoding images and computing their perceptual hash.
+        VideoHash,      // Decoding sampled video frames.
+        Similarity,     // BKTree build and queries.
+        Report,         // Forming groups and handing them to the callback.
+        Count
+    };
+
+    struct Counters {
+        std::uint64_t wallNs = 0;       // Only measured by the thread driving the scan.
+        std::uint64_t cpuNs = 0;        // Summed over all threads.
+        std::uint64_t filesIn = 0;
+        std::uint64_t filesOut = 0;
+        std::uint64_t bytesRead = 0;
+        std::uint64_t filesOpened = 0;
+        std::uint64_t decodeNs = 0;     // Wall time spent in image/video decoding, summed over threads.
+        std::uint64_t peakRssKb = 0;    // Peak RSS of the process when the stage ended.
+        bool ran = false;
+    };
+
+    Metrics();
+
+    void setEnabled(bool enabled) { m_enabled = enabled; }
+    bool isEnabled() const { return m_enabled; }
+
+    /**
+     * @brief Zeroes all counters, called at the start of each scan.
+     * @param mode Name of the scan, e.g. "dedup".
+     */
+    void reset(const std::string& mode);
+
+    /**
+     * @brief Returns the calling thread's counters for a stage.
+     *
+     * Only the calling thread may write to the returned counters.
+     */
+    Counters& local(Stage stage);
+
+    /**
+     * @brief Records the number of files entering and leaving a stage.
+     */
+    void setFiles(Stage stage, std::uint64_t in, std::uint64_t out);
+
+    void addGroups(std::uint64_t groups) { m_groups += groups; }
+
+    /**
+     * @brief Adds up the per-thread counters of a stage.
+     */
+    Counters total(Stage stage) const;
+
+    /**
+     * @brief Builds the JSON summary of the last scan.
+     */
+    std::string toJson() const;
+
+    static const char* stageName(Stage stage);
+
+    /// Monotonic wall clock in nanoseconds.
+    static std::uint64_t nowNs();
+
+    /// CPU time of the calling thread in nanoseconds.
+    static std::uint64_t threadCpuNs();
+
+    /**
+     * @brief Measures the wall and CPU time of the calling thread for one stage.
+     *
+     * Used by the thread driving the scan around a whole stage.
+     */
+    class StageTimer {
+    public:
+        StageTimer(Metrics& metrics, Stage stage);
+        ~StageTimer();
+    private:
+        Metrics& m_metrics;
+        Stage m_stage;
+        std::uint64_t m_wallStart = 0;
+        std::uint64_t m_cpuStart = 0;
+    };
+
+    /**
+     * @brief Adds the CPU time of the enclosed block to the calling thread's counters.
+     *
+     * Used around each work item inside a parallel section.
+     * With decode set, the block's wall time is also counted as decode time.
+     */
+    class WorkTimer {
+    public:
+        WorkTimer(Metrics& metrics, Stage stage, bool decode = false);
+        ~WorkTimer();
+    private:
+        Metrics::Counters* m_counters;
+        bool m_decode;
+        bool m_countCpu = false;
+        std::uint64_t m_wallStart = 0;
+        std::uint64_t m_cpuStart = 0;
+    };
+
+private:
+    struct ThreadSlot {
+        std::thread::id thread;
+        Counters stages[(int)Stage::Count];
+    };
+
+    const std::uint64_t m_id;                           // Distinguishes instances in the thread local cache.
+    bool m_enabled = false;
+    std::string m_mode;
+    std::uint64_t m_startNs = 0;
+    std::uint64_t m_groups = 0;
+    std::thread::id m_driver;                           // Thread which called reset, timed by StageTimer.
+    mutable std::mutex m_mutex;                         // Guards m_slots when a new thread registers.
+    std::vector<std::unique_ptr<ThreadSlot>> m_slots;
+    Counters m_shared[(int)Stage::Count];               // Written by the driving thread only.
+};
+
+#endif // METRICS_HPP
@@ -0,0 +1,120 @@
+#include "PathFilter.hpp"
+
+#include <algorithm>
+#include <fnmatch.h>    // POSIX glob matching.
+
+namespace fs = std::filesystem;
+
+//A pattern without any of these characters can be compared with a plain string lookup.
+static bool hasWildcard(const std::string& pattern) {
+    return pattern.find_first_of("*?[") != std::string::npos;
+}
+
+static std::string toLower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+static bool matchesAny(const std::vector<std::string>& globs, const std::string& text) {
+    for (const auto& glob : globs) {
+        if (fnmatch(glob.c_str(), text.c_str(), 0) == 0) return true;
+    }
+    return false;
+}
+
+PathFilter::PathFilter(const FilterRules& rules)
+    : m_minSize(rules.minSize),
+      m_maxSize(rules.maxSize),
+      m_hasSizeRange(rules.minSize != 0 || rules.maxSize != std::numeric_limits<std::uintmax_t>::max())
+{
+    if (rules.useDefaultExcludes) {
+        m_excludeNames = {
+            ".git", ".config", ".cache", ".vscode", ".local", ".venv", ".mozilla", ".thunderbird"
+        };
+    }
+
+    for (const auto& glob : rules.excludeGlobs) {
+        if (glob.find('/') != std::string::npos) {
+            m_excludePathGlobs.push_back(glob);
+        } else if (hasWildcard(glob)) {
+            m_excludeNameGlobs.push_back(glob);
+        } else {
+            m_excludeNames.insert(glob);
+        }
+    }
+
+    for (const auto& glob : rules.includeGlobs) {
+        if (glob.find('/') != std::string::npos) {
+            m_includePathGlobs.push_back(glob);
+        } else {
+            m_includeNameGlobs.push_back(glob);
+        }
+    }
+
+    //Prefixes are stored in absolute normalized form so that "./a/b", "a/b/" and "/home/x/a/b" all match.
+    for (const auto& prefix : rules.excludePrefixes) {
+        std::error_code ec;
+        fs::path abs = fs::absolute(prefix, ec);
+        if (ec) continue;
+        std::string s = abs.lexically_normal().string();
+        while (s.size() > 1 && s.back() == '/') s.pop_back();
+        m_excludePrefixes.push_back(s);
+    }
+
+    for (auto ext : rules.extensions) {
+        if (ext.empty()) continue;
+        if (ext[0] != '.') ext.insert(ext.begin(), '.');
+        m_extensions.insert(toLower(ext));
+    }
+}
+
+bool PathFilter::isExcluded(const fs::path& path) const {
+    const std::string name = path.filename().string();
+    if (m_excludeNames.count(name)) return true;
+    if (matchesAny(m_excludeNameGlobs, name)) return true;
+    if (!m_excludePathGlobs.empty() && matchesAny(m_excludePathGlobs, path.string())) return true;
+    return false;
+}
+
+bool PathFilter::skipDirectory(const fs::path& dir) const {
+    if (isExcluded(dir)) return true;
+
+    if (!m_excludePrefixes.empty()) {
+        std::error_code ec;
+        fs::path abs = fs::absolute(dir, ec);
+        if (ec) return false;
+        const std::string s = abs.lexically_normal().string();
+        for (const auto& prefix : m_excludePrefixes) {
+            //Only match on a component boundary: "/a/b" must not prune "/a/bc".
+            if (s.compare(0, prefix.size(), prefix) == 0 &&
+                (s.size() == prefix.size() || s[prefix.size()] == '/' || prefix == "/")) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool PathFilter::acceptFile(const fs::directory_entry& entry) const {
+    const fs::path& path = entry.path();
+    if (isExcluded(path)) return false;
+
+    if (!m_includeNameGlobs.empty() || !m_includePathGlobs.empty()) {
+        if (!matchesAny(m_includeNameGlobs, path.filename().string()) &&
+            !matchesAny(m_includePathGlobs, path.string())) {
+            return false;
+        }
+    }
+
+    if (!m_extensions.empty() && !m_extensions.count(toLower(path.extension().string()))) {
+        return false;
+    }
+
+    //Only pay for the stat when a size rule was actually given.
+    if (m_hasSizeRange) {
+        std::error_code ec;
+        std::uintmax_t size = entry.file_size(ec);
+        if (ec || !acceptSize(size)) return false;
+    }
+    return true;
+}
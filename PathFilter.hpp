@@ -0,0 +1,84 @@
+#ifndef PATHFILTER_HPP
+#define PATHFILTER_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @struct FilterRules
+ * @brief User supplied include/exclude rules, as given on the command line.
+ *
+ * Globs without a '/' are matched against a single file or directory name,
+ * globs containing a '/' are matched against the whole path.
+ * The rules are only a description; they are compiled into a PathFilter once
+ * before the walk starts.
+ */
+struct FilterRules {
+    std::vector<std::string> excludeGlobs;      // Files and directories to leave out.
+    std::vector<std::string> includeGlobs;      // If non-empty a file must match one of them.
+    std::vector<std::string> excludePrefixes;   // Directory subtrees to leave out.
+    std::vector<std::string> extensions;        // If non-empty only these extensions are reported.
+    std::uintmax_t minSize = 0;
+    std::uintmax_t maxSize = std::numeric_limits<std::uintmax_t>::max();
+    bool useDefaultExcludes = true;             // Skip .git, .cache, ... like before.
+};
+
+/**
+ * @class PathFilter
+ * @brief Compiled form of FilterRules used by FileTree::walk.
+ *
+ * Literal names go into a hash set, wildcard globs are kept apart so that the
+ * common case (skipping .git and friends) is a single lookup per directory entry.
+ * Directories are checked before they are opened, so excluded subtrees are never read.
+ */
+class PathFilter {
+public:
+    /**
+     * @brief Compiles the given rules.
+     * @param rules The rules to compile.
+     */
+    explicit PathFilter(const FilterRules& rules = FilterRules());
+
+    /**
+     * @brief Checks whether a directory should be pruned from the walk.
+     * @param dir Path of the directory as seen by the walker.
+     * @return true if the directory and everything below it must be skipped.
+     */
+    bool skipDirectory(const std::filesystem::path& dir) const;
+
+    /**
+     * @brief Checks name, extension and (if configured) size rules for a file.
+     * @param entry Directory entry of the file.
+     * @return true if the file should be reported to the callback.
+     */
+    bool acceptFile(const std::filesystem::directory_entry& entry) const;
+
+    /**
+     * @brief Checks a file size against the configured size range.
+     * @param size File size in bytes.
+     * @return true if the size lies within [minSize, maxSize].
+     */
+    bool acceptSize(std::uintmax_t size) const {
+        return size >= m_minSize && size <= m_maxSize;
+    }
+
+private:
+    std::unordered_set<std::string> m_excludeNames;     // Literal names, e.g. ".git".
+    std::vector<std::string> m_excludeNameGlobs;        // Wildcard patterns matched on the name.
+    std::vector<std::string> m_excludePathGlobs;        // Patterns matched on the full path.
+    std::vector<std::string> m_includeNameGlobs;
+    std::vector<std::string> m_includePathGlobs;
+    std::vector<std::string> m_excludePrefixes;         // Absolute, normalized, without trailing '/'.
+    std::unordered_set<std::string> m_extensions;       // Lower case, with the leading dot.
+    std::uintmax_t m_minSize;
+    std::uintmax_t m_maxSize;
+    bool m_hasSizeRange;
+
+    bool isExcluded(const std::filesystem::path& path) const;
+};
+
+#endif // PATHFILTER_HPP
@@ -0,0 +1,62 @@
+#include "PathStore.hpp"
+
+#include <cstring>
+
+//Copies the name into the arena. Names larger than a block get a block of their own.
+const char* PathStore::intern(std::string_view name) {
+    if (name.size() > m_BlockSize) {
+        m_largeNames.emplace_back(new char[name.size()]);
+        m_arenaBytes += name.size();
+        std::memcpy(m_largeNames.back().get(), name.data(), name.size());
+        return m_largeNames.back().get();
+    }
+
+    if (m_blockUsed + name.size() > m_BlockSize) {
+        m_blocks.emplace_back(new char[m_BlockSize]);
+        m_arenaBytes += m_BlockSize;
+        m_blockUsed = 0;
+    }
+    char* dest = m_blocks.back().get() + m_blockUsed;
+    std::memcpy(dest, name.data(), name.size());
+    m_blockUsed += name.size();
+    return dest;
+}
+
+PathId PathStore::addRoot(const std::string& root) {
+    return add(npos, root);
+}
+
+PathId PathStore::add(PathId parent, std::string_view name) {
+    m_nodes.push_back(Node{intern(name), parent, (std::uint32_t)name.size()});
+    return (PathId)(m_nodes.size() - 1);
+}
+
+//A separator goes between a node and its parent unless the parent is a root like "/" or "dir/".
+bool PathStore::needsSeparator(PathId parent) const {
+    if (parent == npos) return false;
+    const Node& node = m_nodes[parent];
+    return node.length == 0 || node.name[node.length - 1] != '/';
+}
+
+std::string PathStore::string(PathId id) const {
+    //First pass up the chain computes the length, the second one fills the string from the back.
+    //This way the path is built with a single allocation.
+    std::size_t length = 0;
+    for (PathId cur = id; cur != npos; cur = m_nodes[cur].parent) {
+        length += m_nodes[cur].length + (needsSeparator(m_nodes[cur].parent) ? 1 : 0);
+    }
+
+    std::string result(length, '/');
+    std::size_t pos = length;
+    for (PathId cur = id; cur != npos; cur = m_nodes[cur].parent) {
+        const Node& node = m_nodes[cur];
+        pos -= node.length;
+        std::memcpy(&result[pos], node.name, node.length);
+        if (needsSeparator(node.parent)) pos--;     // Already '/' from the constructor.
+    }
+    return result;
+}
+
+std::size_t PathStore::memoryUsage() const {
+    return m_nodes.capacity() * sizeof(Node) + m_arenaBytes + (m_blocks.capacity() + m_largeNames.capacity()) * sizeof(m_blocks[0]);
+}
@@ -0,0 +1,96 @@
+#ifndef PATHSTORE_HPP
+#define PATHSTORE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Identifies a file or directory recorded in a PathStore.
+using PathId = std::uint32_t;
+
+/**
+ * @class PathStore
+ * @brief Interned storage for the paths found by a walk.
+ *
+ * Every directory and file is recorded once as (parent id, name), and the names
+ * live in large arena blocks. A file deep down a tree therefore costs one small
+ * node plus its own name instead of a full std::filesystem::path, and records
+ * refer to it by a 32 bit PathId. Full paths are only built when a file has to be
+ * opened or reported.
+ *
+ * Adding is not thread safe; once the walk is done any number of threads may read.
+ */
+class PathStore {
+public:
+    static constexpr PathId npos = 0xFFFFFFFF;
+
+    /**
+     * @brief Records a walk root. Its name is the path exactly as given.
+     * @param root The root directory (or file) of the walk.
+     * @return Id of the new node.
+     */
+    PathId addRoot(const std::string& root);
+
+    /**
+     * @brief Records a child of an already stored directory.
+     * @param parent Id of the directory containing the entry.
+     * @param name File or directory name, without separators.
+     * @return Id of the new node.
+     */
+    PathId add(PathId parent, std::string_view name);
+
+    /**
+     * @brief Builds the full path of a node.
+     * @param id Id returned by addRoot or add.
+     * @return The path as the walker saw it, e.g. "root/sub/file.txt".
+     */
+    std::string string(PathId id) const;
+
+    /**
+     * @brief Same as string(), as a std::filesystem::path.
+     */
+    std::filesystem::path path(PathId id) const { return std::filesystem::path(string(id)); }
+
+    /**
+     * @brief Returns the last component of a node without building the full path.
+     */
+    std::string_view name(PathId id) const { return {m_nodes[id].name, m_nodes[id].length}; }
+
+    /**
+     * @brief Returns the id of the containing directory, npos for roots.
+     */
+    PathId parent(PathId id) const { return m_nodes[id].parent; }
+
+    /**
+     * @brief Returns the number of recorded nodes.
+     */
+    std::size_t size() const { return m_nodes.size(); }
+
+    /**
+     * @brief Returns the number of bytes held by the nodes and the arena.
+     */
+    std::size_t memoryUsage() const;
+
+private:
+    struct Node {
+        const char* name;       // Points into one of the arena blocks, not null terminated.
+        PathId parent;
+        std::uint32_t length;
+    };
+
+    static constexpr std::size_t m_BlockSize = 64 * 1024;
+
+    std::vector<Node> m_nodes;
+    std::vector<std::unique_ptr<char[]>> m_blocks;  // Blocks never move, so Node::name stays valid.
+    std::vector<std::unique_ptr<char[]>> m_largeNames;
+    std::size_t m_blockUsed = m_BlockSize;          // Bytes used in the last block; full when no block exists.
+    std::size_t m_arenaBytes = 0;
+
+    const char* intern(std::string_view name);
+    bool needsSeparator(PathId parent) const;
+};
+
+#endif // PATHSTORE_HPP
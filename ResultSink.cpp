@@ -0,0 +1,173 @@
+#include "ResultSink.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+static std::string beautify(std::uintmax_t size) {
+    char buf[32];
+    if (size >= 1073741824) {
+        std::snprintf(buf, sizeof(buf), "%.2f GB", (double)size / 1073741824);
+    } else if (size >= 1048576) {
+        std::snprintf(buf, sizeof(buf), "%.2f MB", (double)size / 1048576);
+    } else if (size >= 1024) {
+        std::snprintf(buf, sizeof(buf), "%.2f KB", (double)size / 1024);
+    } else {
+        std::snprintf(buf, sizeof(buf), "%ju B", size);
+    }
+    return buf;
+}
+
+static const char* kindName(DuplicateGroup::Kind kind) {
+    switch (kind) {
+        case DuplicateGroup::Kind::Exact: return "exact";
+        case DuplicateGroup::Kind::Image: return "image";
+        case DuplicateGroup::Kind::Video: return "video";
+        case DuplicateGroup::Kind::Chunk: return "chunk";
+        case DuplicateGroup::Kind::Directory: return "directory";
+    }
+    return "unknown";
+}
+
+//Value of one hex digit, -1 if c isn't one.
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+std::unique_ptr<ResultSink> ResultSink::create(const std::string& format, BufferedWriter& out) {
+    if (format == "text") return std::make_unique<TextSink>(out);
+    if (format == "ndjson") return std::make_unique<NdjsonSink>(out);
+    if (format == "binary") return std::make_unique<BinarySink>(out);
+    return nullptr;
+}
+
+void ResultSink::count(const DuplicateGroup& group) {
+    m_groups[(int)group.kind]++;
+    m_wasted += group.wastedBytes;
+}
+
+void ResultSink::message(std::string_view text) {
+    std::cerr << text;
+}
+
+void ResultSink::finish() {
+    m_out.flush();
+}
+
+void TextSink::group(const DuplicateGroup& group) {
+    count(group);
+    if (group.kind == DuplicateGroup::Kind::Exact || group.kind == DuplicateGroup::Kind::Directory) {
+        m_out.write("Found ");
+        m_out.writeNumber(group.files.size());
+        m_out.write(group.kind == DuplicateGroup::Kind::Exact ? " files of size " : " identical directories of ");
+        m_out.write(beautify(group.size));
+        m_out.write(" (");
+        m_out.write(beautify(group.wastedBytes));
+        m_out.write(" wasted)\n");
+        for (const auto& path : group.files) {
+            m_out.writeQuoted(path.native());
+            m_out.put('\n');
+        }
+        m_out.write("\n\n");
+        return;
+    }
+
+    m_out.write("Group ");
+    m_out.writeNumber((std::uint64_t)m_groups[(int)group.kind]);
+    m_out.write(" (");
+    m_out.write(beautify(group.wastedBytes));
+    if (group.kind == DuplicateGroup::Kind::Chunk) {
+        char share[64];
+        std::snprintf(share, sizeof(share), " shared, %.1f%% of the larger file)\n", group.similarity * 100);
+        m_out.write(share);
+    } else {
+        m_out.write(" wasted)\n");
+    }
+    for (const auto& path : group.files) {
+        m_out.write(" - ");
+        m_out.writeQuoted(path.native());
+        m_out.put('\n');
+    }
+    m_out.put('\n');
+}
+
+void TextSink::resync() {
+    m_out.write("=== Events were lost, all groups are reported again below ===\n\n");
+    m_out.flush();
+}
+
+//Messages are rare; flushing keeps them and the groups before them visible while the scan runs.
+void TextSink::message(std::string_view text) {
+    m_out.write(text);
+    m_out.flush();
+}
+
+void NdjsonSink::group(const DuplicateGroup& group) {
+    count(group);
+    m_out.write("{\"kind\":\"");
+    m_out.write(kindName(group.kind));
+    m_out.write("\",\"size\":");
+    m_out.writeNumber(group.size);
+    m_out.write(",\"hash\":");
+    m_out.writeJsonString(group.hash);
+    m_out.write(",\"wasted_bytes\":");
+    m_out.writeNumber(group.wastedBytes);
+    if (group.kind == DuplicateGroup::Kind::Chunk) {
+        char similarity[32];
+        std::snprintf(similarity, sizeof(similarity), ",\"similarity\":%.4f", group.similarity);
+        m_out.write(similarity);
+    }
+    m_out.write(",\"files\":[");
+    for (std::size_t i = 0; i < group.files.size(); ++i) {
+        if (i) m_out.put(',');
+        m_out.writeJsonString(group.files[i].native());
+    }
+    m_out.write("]}\n");
+}
+
+void NdjsonSink::resync() {
+    m_out.write("{\"event\":\"resync\"}\n");
+}
+
+BinarySink::BinarySink(BufferedWriter& out) : ResultSink(out) {
+    m_out.write("DDUPRES2", 8);
+}
+
+void BinarySink::group(const DuplicateGroup& group) {
+    count(group);
+    m_out.writeLE((std::uint64_t)group.kind, 1);
+    m_out.writeLE(group.size, 8);
+    m_out.writeLE(group.wastedBytes, 8);
+    m_out.writeLE((std::uint64_t)std::lround(std::clamp(group.similarity, 0.0, 1.0) * 1000000), 4);
+
+    //The hex hash is stored as raw bytes.
+    unsigned char raw[128];
+    std::size_t rawLength = 0;
+    for (std::size_t i = 0; i + 1 < group.hash.size() && rawLength < sizeof(raw); i += 2) {
+        int hi = hexValue(group.hash[i]), lo = hexValue(group.hash[i + 1]);
+        if (hi < 0 || lo < 0) break;
+        raw[rawLength++] = (unsigned char)(hi * 16 + lo);
+    }
+    m_out.writeLE(rawLength, 1);
+    m_out.write(raw, rawLength);
+
+    m_out.writeLE(group.files.size(), 4);
+    for (const auto& path : group.files) {
+        m_out.writeLE(path.native().size(), 4);
+        m_out.write(path.native());
+    }
+}
+
+void BinarySink::resync() {
+    m_out.writeLE(0xFE, 1);
+}
+
+void BinarySink::finish() {
+    m_out.writeLE(0xFF, 1);
+    m_out.writeLE((std::uint64_t)(m_groups[0] + m_groups[1] + m_groups[2] + m_groups[3] + m_groups[4]), 8);
+    m_out.flush();
+}
@@ -0,0 +1,111 @@
+#ifndef RESULTSINK_HPP
+#define RESULTSINK_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "BufferedWriter.hpp"
+#include "ScanResult.hpp"
+
+/**
+ * @class ResultSink
+ * @brief Formats the groups of a scan as they are finalized.
+ *
+ * All formats write through one BufferedWriter. Groups are written as soon as
+ * the scan hands them over, nothing is collected.
+ */
+class ResultSink {
+public:
+    explicit ResultSink(BufferedWriter& out) : m_out(out) {}
+    virtual ~ResultSink() = default;
+
+    /**
+     * @brief Creates the sink for a format name.
+     * @param format "text", "ndjson" or "binary".
+     * @return The sink, or nullptr for an unknown format.
+     */
+    static std::unique_ptr<ResultSink> create(const std::string& format, BufferedWriter& out);
+
+    /**
+     * @brief Writes one group.
+     */
+    virtual void group(const DuplicateGroup& group) = 0;
+
+    /**
+     * @brief Marks that the groups after it replace every group written before it.
+     *
+     * The watch mode writes it when inotify lost events and the tree is indexed
+     * and reported again, so consumers can drop what they collected so far.
+     */
+    virtual void resync() = 0;
+
+    /**
+     * @brief Progress and summary text. Part of the text report, sent to std::cerr by the other formats.
+     */
+    virtual void message(std::string_view text);
+
+    /**
+     * @brief Ends the output, e.g. writes the trailer of the binary format, and flushes it.
+     */
+    virtual void finish();
+
+    int groups(DuplicateGroup::Kind kind) const { return m_groups[(int)kind]; }
+    std::uintmax_t wastedBytes() const { return m_wasted; }
+
+protected:
+    BufferedWriter& m_out;
+    int m_groups[5] = {0, 0, 0, 0, 0};  // Per DuplicateGroup::Kind.
+    std::uintmax_t m_wasted = 0;
+
+    void count(const DuplicateGroup& group);
+};
+
+/**
+ * @class TextSink
+ * @brief The human readable report the tool always printed.
+ */
+class TextSink : public ResultSink {
+public:
+    using ResultSink::ResultSink;
+    void group(const DuplicateGroup& group) override;
+    void resync() override;
+    void message(std::string_view text) override;
+};
+
+/**
+ * @class NdjsonSink
+ * @brief One JSON object per group and line:
+ * {"kind":"exact","size":N,"hash":"..","wasted_bytes":N,"files":["..",..]}
+ * Chunk groups also carry "similarity":F after "wasted_bytes".
+ * A resync is the line {"event":"resync"}.
+ */
+class NdjsonSink : public ResultSink {
+public:
+    using ResultSink::ResultSink;
+    void group(const DuplicateGroup& group) override;
+    void resync() override;
+};
+
+/**
+ * @class BinarySink
+ * @brief Compact binary format, all integers little endian:
+ *
+ * - header: the 8 bytes "DDUPRES2"
+ * - per group: u8 kind (0 exact, 1 image, 2 video, 3 chunk, 4 directory), u64 size, u64 wasted bytes,
+ *   u32 similarity in millionths (chunk groups, 0 for the other kinds),
+ *   u8 hash length followed by the raw hash bytes (32 for BLAKE3, 0 for similar groups),
+ *   u32 file count, then per file u32 path length and the path bytes
+ * - resync: u8 0xFE, in place of a group
+ * - trailer: u8 0xFF, u64 number of groups
+ */
+class BinarySink : public ResultSink {
+public:
+    explicit BinarySink(BufferedWriter& out);
+    void group(const DuplicateGroup& group) override;
+    void resync() override;
+    void finish() override;
+};
+
+#endif // RESULTSINK_HPP
@@ -0,0 +1,1939 @@
+#include "ScanContext.hpp"
+#include "ChunkIndex.hpp"
+#include "Chunker.hpp"
+#include "DuplicateIndex.hpp"
+#include "FileTree.hpp"
+#include "ShardFile.hpp"
+#include "Utility.hpp"
+#include "blake3.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <random>
+#include <set>
+#include <sstream>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+//Lower case extension (with the dot) of a path or a bare name, same rules as path::extension().
+static std::string lowerExtension(std::string_view name) {
+    std::size_t slash = name.rfind('/');
+    if (slash != std::string_view::npos) name.remove_prefix(slash + 1);
+    std::size_t dot = name.rfind('.');
+    if (dot == std::string_view::npos || dot == 0 || name == "..") return "";
+    std::string ext(name.substr(dot));
+    //std::transform(InputBegin, InputEnd, OutputBegin, UnaryFunction);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+}
+
+static bool is_image_file(std::string_view name) {
+    //static ensures that the set is initialized only once. The first time the function is called.
+    //Hence every time the function is called reinitialization doesn't take place. This makes it faster.
+    static const std::unordered_set<std::string> image_extensions = {
+        ".jpg", ".jpeg", ".png", ".bmp", ".tiff", ".tif", ".gif", ".webp"
+    };
+    return image_extensions.count(lowerExtension(name)) > 0;
+}
+
+static bool is_video_file(std::string_view name) {
+    static const std::unordered_set<std::string> videoExtensions = {
+        ".mp4", ".mkv", ".avi", ".mov", ".flv", ".wmv", ".webm"
+    };
+    return videoExtensions.count(lowerExtension(name)) > 0;
+}
+
+static bool cmpDurationValFile(const int& a, const FileInfo& b) {
+    return a < b.getDuration();
+}
+
+ScanContext::ScanContext(const ScanOptions& options)
+    : m_options(options),
+      m_filter(options.filterRules),
+      m_pool(options.threads)
+{
+    m_metrics.setEnabled(options.collectMetrics);
+    m_tracer.setEnabled(options.collectTrace);
+}
+
+void ScanContext::message(const std::string& text) const {
+    if (m_onMessage) {
+        m_onMessage(text);
+    }
+}
+
+std::string ScanContext::markedPaths(const std::vector<FileInfo>& list) const {
+    std::string paths;
+    for (const FileInfo& file : list) {
+        if (file.checkRemoveUniqueFlag()) {
+            paths += "  " + m_paths.string(file.getPathId()) + "\n";
+        }
+    }
+    return paths;
+}
+
+void ScanContext::clear() {
+    m_fileList.clear();
+    m_imageList.clear();
+    m_videoList.clear();
+    m_paths = PathStore();
+}
+
+//Records the file below its directory the first time one of the lists keeps it.
+PathId ScanContext::intern(const fs::path& path, PathId dirId, PathId& fileId) {
+    if (fileId == PathStore::npos) {
+        fileId = m_paths.add(dirId, path.filename().string());
+        m_metrics.local(Metrics::Stage::Walk).filesOut++;
+    }
+    return fileId;
+}
+
+bool ScanContext::walk(const FileTree::ReportFcnType& report, const FileTree::SkipFcnType& skipped) {
+    clear();
+    return walkRoot(m_options.root, report, skipped);
+}
+
+bool ScanContext::walkRoot(const std::string& root, const FileTree::ReportFcnType& report,
+                           const FileTree::SkipFcnType& skipped) {
+    Metrics::StageTimer timer(m_metrics, Metrics::Stage::Walk);
+    Tracer::Scope stage(&m_tracer, "walk", "stage");
+    Metrics::Counters& counted = m_metrics.local(Metrics::Stage::Walk);
+    FileTree walker(m_options.followSymlinks);
+    walker.setCallback([&](const fs::path& path, PathId dirId) {
+        counted.filesIn++;
+        return report(path, dirId);
+    });
+    walker.setFilter(&m_filter);
+    walker.setPathStore(&m_paths);
+    walker.setTracer(&m_tracer);
+    walker.setMessageCallback([this](const std::string& text) { message(text); });
+    walker.setSkipCallback(skipped);
+    //2 is returned only when the root was a directory and it was processed.
+    return walker.walk(root) == 2;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Code for exact deduplication.
+
+/**
+ * @brief Callback function to process a file during traversal.
+ *
+ * Skipped directories are already pruned by the walker's PathFilter.
+ * If the file is a regular file of at least minDedupSize, it is added to the file list.
+ */
+int ScanContext::dedupReport(const fs::path& path_name, PathId dirId, PathId& fileId) {
+    FileInfo fi(PathStore::npos);
+
+    if (fi.readFileSize(path_name) && fi.getSize() >= m_options.minDedupSize) {
+        fi.setPathId(intern(path_name, dirId, fileId));
+        m_fileList.push_back(fi);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Runs the size and first bytes stages on a list of candidate files.
+ *
+ * The first bytes are read on the context's thread pool.
+ * With crossTree set, only groups holding both reference and target files are kept.
+ * Once deadlineNs passes no more files are opened; the files left unread are
+ * taken out of the list and appended to unread, if given.
+ */
+std::size_t ScanContext::prefilterDuplicates(std::vector<FileInfo>& list, bool crossTree,
+                                             std::uint64_t deadlineNs, std::vector<FileInfo>* unread) {
+    std::ostringstream msg;
+    msg << "Total files before filtering: " << list.size() << "\n";
+    message(msg.str());
+
+    //This object of Utility class is used to find duplicate files using various techniques.
+    Utility deduper(list, crossTree);
+
+    //1.
+    //removeUniqueSizes removes all the files with unique file size within the mentioned directory and
+    //following sub-directories and returns the number of removed files.
+    std::size_t before = list.size();
+    std::size_t removed;
+    {
+        Metrics::StageTimer timer(m_metrics, Metrics::Stage::SizeFilter);
+        Tracer::Scope stage(&m_tracer, "size_filter", "stage");
+        removed = deduper.removeUniqueSizes();
+    }
+    m_metrics.setFiles(Metrics::Stage::SizeFilter, before, list.size());
+    msg.str("");
+    msg << "Removed " << removed << " files with unique sizes.\n";
+    msg << "Files remaining: " << list.size() << "\n\n";
+    message(msg.str());
+
+    if(list.size()==0){
+        return 0;
+    }
+
+    //2.
+    // This serves as a quick content-based pre-filter to eliminate files that differ early,
+    // reducing the workload for full hashing.
+    before = list.size();
+    std::vector<char> skipped(list.size(), 0);
+    {
+        Metrics::StageTimer timer(m_metrics, Metrics::Stage::Prefix);
+        Tracer::Scope stage(&m_tracer, "prefix", "stage");
+        m_pool.parallelFor(list.size(), [&](std::size_t i) {
+            if (Metrics::nowNs() >= deadlineNs) {
+                skipped[i] = 1;
+                return;
+            }
+            Metrics::WorkTimer work(m_metrics, Metrics::Stage::Prefix);
+            Metrics::Counters& counted = m_metrics.local(Metrics::Stage::Prefix);
+            counted.filesOpened++;
+            const std::string path = m_paths.string(list[i].getPathId());
+            Tracer::Scope scope(&m_tracer, "read_prefix", "io", path);
+            if(list[i].readFirstBytes(path)!=0){
+                list[i].setRemoveUniqueFlag(true);
+            }
+            else{
+                counted.bytesRead += std::min<std::uintmax_t>(list[i].getSize(), list[i].getBufferSize());
+            }
+        });
+        msg.str("");
+        //Files the deadline kept from being read can't be compared, they leave the list unverified.
+        std::size_t late = std::count(skipped.begin(), skipped.end(), 1);
+        if (late != 0) {
+            std::size_t kept = 0;
+            for (std::size_t i = 0; i < list.size(); ++i) {
+                if (skipped[i]) {
+                    if (unread) unread->push_back(list[i]);
+                } else {
+                    if (kept != i) list[kept] = list[i];
+                    kept++;
+                }
+            }
+            list.erase(list.begin() + kept, list.end());
+            msg<<"Deadline reached: the first bytes of "<<late<<" files were not read\n";
+        }
+        std::string failed=markedPaths(list);
+        removed=deduper.removeMarkedFiles();
+        if(removed!=0){
+            msg<<"Removed "<<removed<<" files which couldn't be opened:\n"<<failed;
+        }
+        //removeUniqueBuffer removes all the files with unique firstbytes(default buffer size set to 4kB)
+        //and returns the total number of such removed files.
+        removed = deduper.removeUniqueBuffer();
+    }
+    m_metrics.setFiles(Metrics::Stage::Prefix, before, list.size());
+    msg << "Removed " << removed << " files with unique first bytes.\n";
+    msg << "Files remaining " << list.size() << "\n\n";
+    message(msg.str());
+
+    return list.size();
+}
+
+/**
+ * @brief Runs the size, first bytes and hash stages on a list of candidate files.
+ *
+ * When imageHashes is given, image files reaching the hash stage are read only once:
+ * the same buffer gives both the BLAKE3 hash and the perceptual hash, which is
+ * recorded in imageHashes (0 if the image couldn't be decoded).
+ * The per-file reads and hashes run on the context's thread pool.
+ * With crossTree set, only groups holding both reference and target files are kept.
+ *
+ * With ScanOptions::hashMode Tiered or Fast, the candidates first get a FastHash
+ * and only files sharing theirs go on: to BLAKE3 (Tiered) or straight to the
+ * report (Fast). Images dropped there are left out of imageHashes.
+ */
+std::size_t ScanContext::filterDuplicates(std::vector<FileInfo>& list,
+                                          std::unordered_map<PathId, uint64_t>* imageHashes,
+                                          bool crossTree) {
+    if(prefilterDuplicates(list, crossTree)==0){
+        return 0;
+    }
+
+    std::ostringstream msg;
+    Utility deduper(list, crossTree);
+    std::size_t before;
+    std::size_t removed;
+
+    if(m_options.hashMode!=ScanOptions::HashMode::Blake3){
+        before = list.size();
+        {
+            Metrics::StageTimer timer(m_metrics, Metrics::Stage::Hash);
+            Tracer::Scope stage(&m_tracer, "fast_hash", "stage");
+            m_pool.parallelFor(list.size(), [&](std::size_t i) {
+                Metrics::WorkTimer work(m_metrics, Metrics::Stage::Hash);
+                Metrics::Counters& counted = m_metrics.local(Metrics::Stage::Hash);
+                FileInfo& file = list[i];
+                const std::string path = m_paths.string(file.getPathId());
+                Tracer::Scope scope(&m_tracer, "fast_hash", "io", path);
+                counted.filesOpened++;
+                file.setFastHash(path);
+                if(file.getFastHash().empty()){
+                    file.setRemoveUniqueFlag(true);
+                }
+                else{
+                    counted.bytesRead += file.getSize();
+                }
+            });
+            std::string failed=markedPaths(list);
+            removed=deduper.removeMarkedFiles();
+            if(removed!=0){
+                msg<<"Removed "<<removed<<" files which couldn't be opened:\n"<<failed;
+            }
+            removed=deduper.removeUniqueFastHashes();
+        }
+        m_metrics.setFiles(Metrics::Stage::Hash, before, list.size());
+        msg << "Removed " << removed << " files with unique fast hashes\n";
+        msg << "Files remaining " << list.size() << "\n\n";
+        message(msg.str());
+        msg.str("");
+
+        if(m_options.hashMode==ScanOptions::HashMode::Fast || list.empty()){
+            //Sorted by size and fast hash, so every group is already one run.
+            for(auto& file: list){
+                file.trustFastHash();
+            }
+            return list.size();
+        }
+    }
+
+    //3.
+    //The setHash function is used to hash the contents of the entire file and store it in the form
+    //of a string in the member-variable of the class FileInfo called m_blake3_val.
+    before = list.size();
+    {
+        Metrics::StageTimer timer(m_metrics, Metrics::Stage::Hash);
+        Tracer::Scope stage(&m_tracer, "hash", "stage");
+        m_pool.parallelFor(list.size(), [&](std::size_t i) {
+            Metrics::WorkTimer work(m_metrics, Metrics::Stage::Hash);
+            Metrics::Counters& counted = m_metrics.local(Metrics::Stage::Hash);
+            FileInfo& file = list[i];
+            const std::string path = m_paths.string(file.getPathId());
+            counted.filesOpened++;
+            if(imageHashes && is_image_file(m_paths.name(file.getPathId()))){
+                Tracer::Scope scope(&m_tracer, "hash_and_decode", "io", path);
+                file.setBlake3AndImgHash(path, m_options.exifThumbnails);
+            }
+            else{
+                Tracer::Scope scope(&m_tracer, "hash", "io", path);
+                file.setBlake3(path);
+            }
+            if(file.getBlake3().empty()){
+                file.setRemoveUniqueFlag(true);
+            }
+            else{
+                counted.bytesRead += file.getSize();
+            }
+        });
+        //Collected after the parallel section so the map is only touched by one thread.
+        if(imageHashes){
+            for(const auto& file: list){
+                if(is_image_file(m_paths.name(file.getPathId()))){
+                    imageHashes->emplace(file.getPathId(), file.getImgHash());
+                }
+            }
+        }
+        std::string failed=markedPaths(list);
+        removed=deduper.removeMarkedFiles();
+        msg.str("");
+        if(removed!=0){
+            msg<<"Removed "<<removed<<" files which couldn't be opened:\n"<<failed;
+        }
+
+        //removeUniqueHashes removes all the files with unique hashes from the fileList and returns the number
+        //of files which it removed.
+        removed = deduper.removeUniqueHashes();
+    }
+    m_metrics.setFiles(Metrics::Stage::Hash, before, list.size());
+    msg << "Removed " << removed << " files with unique hashes\n";
+    msg << "Files remaining " << list.size() << "\n\n";
+    message(msg.str());
+
+    return list.size();
+}
+
+/**
+ * @brief Hands the files left after filterDuplicates to the group callback.
+ *
+ * removeUniqueHashes leaves the list sorted by hash, so every group is a run of
+ * equal hashes and is handed over as soon as its run ends, without sorting again.
+ * Reference files (cross-tree search) are moved to the front of their group, so
+ * they are the ones kept by DedupAction, and only the target files count as wasted.
+ *
+ * When collapsed is given (indexed by PathId, set for everything inside a
+ * duplicated directory tree), groups whose files all lie in such trees are left
+ * out: the directory groups already cover them.
+ */
+int ScanContext::reportDuplicateGroups(std::vector<FileInfo>& list, const std::vector<char>* collapsed) {
+    Metrics::StageTimer timer(m_metrics, Metrics::Stage::Report);
+    Tracer::Scope stage(&m_tracer, "report", "stage");
+
+    int groups = 0;
+    std::size_t beg = 0;
+    DuplicateGroup group;       // Reused, so its file vector keeps its capacity.
+    for (std::size_t i = 1; i <= list.size(); ++i) {
+        if (i == list.size() || list[i].getSize() != list[beg].getSize() ||
+            list[i].getBlake3() != list[beg].getBlake3()) {
+            bool covered = collapsed && std::all_of(list.begin() + beg, list.begin() + i,
+                [&](const FileInfo& f) { return (*collapsed)[f.getPathId()] != 0; });
+            if (!covered && reportGroup(list, beg, i, group)) {
+                groups++;
+            }
+            beg = i;
+        }
+    }
+    m_metrics.setFiles(Metrics::Stage::Report, list.size(), list.size());
+    m_metrics.addGroups(groups);
+    return groups;
+}
+
+//Hands list[beg, end), files of equal size and hash, to the group callback, reference files first.
+//A group lying entirely in the reference trees has nothing to report and is skipped.
+bool ScanContext::reportGroup(std::vector<FileInfo>& list, std::size_t beg, std::size_t end, DuplicateGroup& group) {
+    auto targets = std::stable_partition(list.begin() + beg, list.begin() + end,
+                                         [](const FileInfo& f) { return f.isReference(); });
+    std::size_t references = targets - (list.begin() + beg);
+    if (references == end - beg) {
+        return false;
+    }
+    group.kind = DuplicateGroup::Kind::Exact;
+    group.size = list[beg].getSize();
+    group.hash = list[beg].getBlake3();
+    //A fast hash taken as it is (--hash fast) is shorter than a BLAKE3 one.
+    group.confirmed = group.hash.size() == 2 * Checksum::DigestSize;
+    group.wastedBytes = group.size * (references ? end - beg - references : end - beg - 1);
+    group.references = references;
+    group.files.clear();
+    group.mtimes.clear();
+    for (std::size_t j = beg; j < end; ++j) {
+        group.files.push_back(m_paths.path(list[j].getPathId()));
+        group.mtimes.push_back(list[j].getMtime());
+    }
+    if (m_onGroup) m_onGroup(group);
+    return true;
+}
+
+/**
+ * @brief Hash stage of a budgeted scan: hashes the most rewarding candidates first and stops at the budget.
+ *
+ * The list left by prefilterDuplicates is cut into candidate groups of equal size
+ * and first bytes. A group of n files of size s costs n*s bytes to hash and can
+ * reclaim at most (n-1)*s, so groups are ranked by (n-1)/n, the reclaimable bytes
+ * per byte read, then by the reclaimable bytes. Groups are hashed in that order,
+ * a batch at a time, and the duplicates of each batch are reported right away.
+ *
+ * A group is only started if its whole cost fits in bytesLeft, what the small
+ * files left of the byte budget (UINT64_MAX without one); a smaller group further down may still fit. Once the deadline passes
+ * no new file is opened, and a file being hashed stops within one read.
+ * Whatever wasn't hashed is listed as unverified, after it the files whose
+ * first bytes the prefix stage had no time to read (unread).
+ */
+int ScanContext::hashWithinBudget(std::vector<FileInfo>& list, std::uint64_t deadlineNs, std::uint64_t bytesLeft,
+                                  const std::vector<FileInfo>& unread) {
+    struct Candidate {
+        std::size_t first;
+        std::size_t count;
+        std::uintmax_t size;
+    };
+
+    auto sameCandidate = [](const FileInfo& a, const FileInfo& b) {
+        return a.getSize() == b.getSize() && a.getPrefix() == b.getPrefix();
+    };
+    std::sort(list.begin(), list.end(), [](const FileInfo& a, const FileInfo& b) {
+        if (a.getSize() != b.getSize()) return a.getSize() < b.getSize();
+        return a.getPrefix() < b.getPrefix();
+    });
+    std::vector<Candidate> candidates;
+    for (std::size_t beg = 0, end; beg < list.size(); beg = end) {
+        for (end = beg + 1; end < list.size() && sameCandidate(list[beg], list[end]); ++end) {}
+        if (end - beg > 1) candidates.push_back(Candidate{beg, end - beg, list[beg].getSize()});
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        //(a.count-1)/a.count > (b.count-1)/b.count, without division.
+        if ((a.count - 1) * b.count != (b.count - 1) * a.count) return (a.count - 1) * b.count > (b.count - 1) * a.count;
+        return a.size * (a.count - 1) > b.size * (b.count - 1);
+    });
+
+    //Enough files per batch to keep the pool busy, few enough to report often.
+    const std::size_t batchFiles = std::max<std::size_t>(64, 4 * m_pool.size());
+    enum : char { Pending, Hashed, Failed };
+    std::vector<char> state(list.size(), Pending);
+    std::vector<Candidate> unverified;
+    std::uint64_t admitted = 0;
+    std::size_t hashedFiles = 0;
+    int groups = 0;
+    DuplicateGroup group;
+    std::string failed;
+
+    Metrics::StageTimer timer(m_metrics, Metrics::Stage::Hash);
+    Tracer::Scope stage(&m_tracer, "hash", "stage");
+    std::size_t next = 0;
+    while (next < candidates.size()) {
+        if (Metrics::nowNs() >= deadlineNs) break;
+        std::vector<Candidate> batch;
+        std::vector<std::size_t> files;
+        while (next < candidates.size() && files.size() < batchFiles) {
+            const Candidate& c = candidates[next++];
+            std::uint64_t cost = (std::uint64_t)c.size * c.count;
+            if (cost > bytesLeft - admitted) {
+                unverified.push_back(c);
+                continue;
+            }
+            admitted += cost;
+            batch.push_back(c);
+            for (std::size_t i = c.first; i < c.first + c.count; ++i) files.push_back(i);
+        }
+
+        m_pool.parallelFor(files.size(), [&](std::size_t k) {
+            if (Metrics::nowNs() >= deadlineNs) return;
+            Metrics::WorkTimer work(m_metrics, Metrics::Stage::Hash);
+            Metrics::Counters& counted = m_metrics.local(Metrics::Stage::Hash);
+            FileInfo& file = list[files[k]];
+            const std::string path = m_paths.string(file.getPathId());
+            Tracer::Scope scope(&m_tracer, "hash", "io", path);
+            counted.filesOpened++;
+            //A large file stops within one read of the deadline and stays unverified.
+            int res = file.setBlake3Before(path, deadlineNs);
+            if (res < 0) {
+                state[files[k]] = Failed;
+            } else if (res > 0) {
+                counted.bytesRead += file.getSize();
+                state[files[k]] = Hashed;
+            }
+        });
+        for (std::size_t i : files) {
+            if (state[i] == Failed) failed += "  " + m_paths.string(list[i].getPathId()) + "\n";
+        }
+
+        for (const Candidate& c : batch) {
+            auto beg = list.begin() + c.first, end = beg + c.count;
+            if (std::any_of(state.begin() + c.first, state.begin() + c.first + c.count,
+                            [](char st) { return st == Pending; })) {
+                unverified.push_back(c);
+                continue;
+            }
+            hashedFiles += c.count;
+            //Files which couldn't be read sort last and are never part of a group.
+            std::sort(beg, end, [](const FileInfo& a, const FileInfo& b) {
+                if (a.getBlake3().empty() != b.getBlake3().empty()) return b.getBlake3().empty();
+                return a.getBlake3() < b.getBlake3();
+            });
+            for (std::size_t first = c.first, last; first < c.first + c.count; first = last) {
+                for (last = first + 1; last < c.first + c.count && list[last].getBlake3() == list[first].getBlake3(); ++last) {}
+                if (last - first < 2 || list[first].getBlake3().empty()) continue;
+                if (reportGroup(list, first, last, group)) groups++;
+            }
+        }
+    }
+    unverified.insert(unverified.end(), candidates.begin() + next, candidates.end());
+    m_metrics.setFiles(Metrics::Stage::Hash, list.size(), hashedFiles);
+    m_metrics.addGroups(groups);
+
+    std::ostringstream msg;
+    if (!failed.empty()) msg << "Files which couldn't be opened:\n" << failed;
+    if (unverified.empty() && unread.empty()) {
+        msg << "All " << candidates.size() << " candidate groups were verified within the budget.\n";
+        message(msg.str());
+        return groups;
+    }
+    std::size_t files = 0;
+    std::uint64_t reclaimable = 0;
+    for (const Candidate& c : unverified) {
+        files += c.count;
+        reclaimable += (std::uint64_t)c.size * (c.count - 1);
+    }
+    msg << "\nBudget exhausted: " << unverified.size() << " of " << candidates.size()
+        << " candidate groups (" << files << " files, up to " << reclaimable
+        << " reclaimable bytes) were not verified";
+    if (!unread.empty()) msg << ", and " << unread.size() << " more candidate files were not read";
+    msg << ".\n";
+    if (!unverified.empty()) msg << "Unverified candidates (same size and first bytes, not hashed):\n";
+    for (const Candidate& c : unverified) {
+        msg << c.count << " files of size " << c.size << "\n";
+        for (std::size_t i = c.first; i < c.first + c.count; ++i) {
+            msg << "  " << m_paths.path(list[i].getPathId()) << "\n";
+        }
+    }
+    if (!unread.empty()) {
+        msg << "Unread candidates (a size shared with another file, contents not compared):\n";
+        for (const FileInfo& file : unread) {
+            msg << "  " << m_paths.path(file.getPathId()) << " (" << file.getSize() << " bytes)\n";
+        }
+    }
+    message(msg.str());
+    return groups;
+}
+
+/**
+ * @brief Reports directories whose trees are identical, from Merkle hashes of the tree.
+ *
+ * A file's hash is its BLAKE3 hash if it has a duplicate, and a directory's hash
+ * is the BLAKE3 hash of its sorted (type, name, hash) children. A file without a
+ * duplicate (unique size, first bytes or hash) can't be part of two identical
+ * trees, so it has no hash and neither has any directory above it. Node ids grow
+ * from parents to children, so one pass from the highest id computes every
+ * directory after its children.
+ *
+ * @param duplicates Files which have at least one duplicate, any size.
+ * @param walkedFiles Every regular file the walk recorded.
+ * @param partialDirs Directories with an entry that was not recorded (filtered, unreadable,
+ *                    not a regular file...); they can't be compared, and neither can any above them.
+ * @param inDuplicateTree Receives, per PathId, whether the node is inside a duplicated tree.
+ * @return Number of directory groups reported.
+ */
+int ScanContext::reportDirectoryGroups(const std::vector<FileInfo>& duplicates, const std::vector<PathId>& walkedFiles,
+                                       const std::vector<PathId>& partialDirs, std::vector<char>& inDuplicateTree) {
+    Tracer::Scope scope(&m_tracer, "merkle", "report");
+    const std::size_t n = m_paths.size();
+    std::vector<char> isFile(n, 0);
+    std::vector<std::string> hash(n);                 // Empty = can't be duplicated.
+    std::vector<std::uintmax_t> bytes(n, 0);
+    std::vector<char> partial(n, 0);
+    for (PathId id : walkedFiles) isFile[id] = 1;
+    for (PathId id : partialDirs) partial[id] = 1;
+    for (const auto& file : duplicates) {
+        hash[file.getPathId()] = file.getBlake3();
+        bytes[file.getPathId()] = file.getSize();
+    }
+
+    std::vector<std::vector<PathId>> children(n);
+    for (PathId id = 0; id < n; ++id) {
+        if (m_paths.parent(id) != PathStore::npos) children[m_paths.parent(id)].push_back(id);
+    }
+    for (PathId id = (PathId)n; id-- > 0;) {
+        if (isFile[id]) continue;
+        bool unique = partial[id];
+        for (PathId child : children[id]) {
+            bytes[id] += bytes[child];
+            if (hash[child].empty()) unique = true;
+        }
+        if (unique) continue;
+        std::sort(children[id].begin(), children[id].end(),
+                  [&](PathId a, PathId b) { return m_paths.name(a) < m_paths.name(b); });
+        blake3_hasher hasher;
+        blake3_hasher_init(&hasher);
+        for (PathId child : children[id]) {
+            const std::string_view name = m_paths.name(child);
+            const char type = isFile[child] ? 'f' : 'd';
+            const std::uint32_t length = (std::uint32_t)name.size();
+            blake3_hasher_update(&hasher, &type, 1);
+            blake3_hasher_update(&hasher, &length, sizeof(length));
+            blake3_hasher_update(&hasher, name.data(), name.size());
+            blake3_hasher_update(&hasher, hash[child].data(), hash[child].size());
+        }
+        std::uint8_t digest[Checksum::DigestSize];
+        blake3_hasher_finalize(&hasher, digest, sizeof(digest));
+        hash[id] = Checksum::toHex(digest);
+    }
+
+    //Trees without any bytes (empty directories) match too easily to be worth reporting.
+    std::unordered_map<std::string, std::vector<PathId>> same;
+    for (PathId id = 0; id < n; ++id) {
+        if (!isFile[id] && !hash[id].empty() && bytes[id] > 0) same[hash[id]].push_back(id);
+    }
+    std::vector<char> duplicated(n, 0);
+    for (const auto& entry : same) {
+        if (entry.second.size() < 2) continue;
+        for (PathId id : entry.second) duplicated[id] = 1;
+    }
+    inDuplicateTree.assign(n, 0);
+    for (PathId id = 0; id < n; ++id) {
+        PathId parent = m_paths.parent(id);
+        inDuplicateTree[id] = duplicated[id] || (parent != PathStore::npos && inDuplicateTree[parent]);
+    }
+
+    //Only the top of a duplicated tree is reported: a group is left out if all its
+    //directories lie inside trees which are duplicated as a whole.
+    std::vector<const std::vector<PathId>*> groups;
+    for (const auto& entry : same) {
+        if (entry.second.size() < 2) continue;
+        bool covered = std::all_of(entry.second.begin(), entry.second.end(), [&](PathId id) {
+            PathId parent = m_paths.parent(id);
+            return parent != PathStore::npos && inDuplicateTree[parent];
+        });
+        if (!covered) groups.push_back(&entry.second);
+    }
+    std::sort(groups.begin(), groups.end(), [&](const std::vector<PathId>* a, const std::vector<PathId>* b) {
+        if (bytes[a->front()] != bytes[b->front()]) return bytes[a->front()] > bytes[b->front()];
+        return hash[a->front()] < hash[b->front()];
+    });
+    DuplicateGroup group;
+    group.kind = DuplicateGroup::Kind::Directory;
+    for (const auto* dirs : groups) {
+        std::vector<PathId> sorted(*dirs);
+        std::sort(sorted.begin(), sorted.end());
+        group.size = bytes[sorted.front()];
+        group.hash = hash[sorted.front()];
+        group.wastedBytes = group.size * (sorted.size() - 1);
+        group.files.clear();
+        for (PathId id : sorted) group.files.push_back(m_paths.path(id));
+        if (m_onGroup) m_onGroup(group);
+    }
+    m_metrics.addGroups(groups.size());
+    return (int)groups.size();
+}
+
+int ScanContext::findExactDuplicates() {
+    m_metrics.reset("dedup");
+    m_tracer.reset();
+    //The time budget covers the whole scan, the walk included.
+    const bool budgeted = m_options.timeBudgetSec > 0 || m_options.byteBudget > 0;
+    const std::uint64_t deadlineNs = m_options.timeBudgetSec > 0
+        ? Metrics::nowNs() + (std::uint64_t)(m_options.timeBudgetSec * 1e9) : UINT64_MAX;
+    //main rejects these combinations; a caller setting them anyway is told what the scan does.
+    if (budgeted && m_options.directoryGroups) {
+        message("Directory groups aren't searched under a time or byte budget, files are reported one by one.\n");
+    }
+    if (budgeted && m_options.hashMode != ScanOptions::HashMode::Blake3) {
+        message("A time or byte budget hashes with BLAKE3 only, the hash mode is ignored.\n");
+    }
+    if (m_options.directoryGroups && !budgeted) {
+        return findDuplicateTrees();
+    }
+    if (!walk([this](const fs::path& p, PathId dir) { PathId id = PathStore::npos; return dedupReport(p, dir, id); })) {
+        return -1;
+    }
+
+    if(m_fileList.size()==0){
+        message("File List is empty.\n");
+        return 0;
+    }
+
+    auto small = std::stable_partition(m_fileList.begin(), m_fileList.end(),
+        [&](const FileInfo& f) { return f.getSize() > m_options.smallFileSize; });
+    std::vector<FileInfo> smallFiles(small, m_fileList.end());
+    m_fileList.erase(small, m_fileList.end());
+
+    if(budgeted){
+        //Small files are cheap to read, so they go first, but their reads count against the budget too.
+        std::uint64_t bytesLeft = m_options.byteBudget > 0 ? m_options.byteBudget : UINT64_MAX;
+        std::vector<FileInfo> unread;
+        int groups = filterSmallDuplicates(smallFiles, deadlineNs, &bytesLeft, &unread)
+            ? reportDuplicateGroups(smallFiles) : 0;
+        if(prefilterDuplicates(m_fileList, false, deadlineNs, &unread)==0 && unread.empty()){
+            return groups;
+        }
+        return groups + hashWithinBudget(m_fileList, deadlineNs, bytesLeft, unread);
+    }
+
+    if(!m_fileList.empty()){
+        filterDuplicates(m_fileList, nullptr);
+    }
+    filterSmallDuplicates(smallFiles);
+    //Small and large files never share a size, so their groups stay separate runs.
+    m_fileList.insert(m_fileList.end(), smallFiles.begin(), smallFiles.end());
+    if(m_fileList.size()==0){
+        return 0;
+    }
+
+    return reportDuplicateGroups(m_fileList);
+}
+
+/**
+ * @brief Finds the duplicates among files of at most smallFileSize bytes, reading each file once.
+ *
+ * filterDuplicates opens a file twice, once for its first bytes and once for
+ * its hash, and for a file of a few kilobytes both opens cost far more than
+ * the data. Here every file left after the size stage is read whole with one
+ * read and hashed in memory. The files are handed out to the pool in batches,
+ * in walk order so neighbouring files (and their inodes) are read together,
+ * and each batch reuses one buffer.
+ *
+ * In a budgeted scan, sizes are admitted whole while their bytes fit in
+ * bytesLeft, which is charged for them, and a batch started after deadlineNs
+ * reads nothing. A size not read in full can't be compared: its files are
+ * taken out of the list and appended to unread, if given.
+ */
+std::size_t ScanContext::filterSmallDuplicates(std::vector<FileInfo>& list, std::uint64_t deadlineNs,
+                                               std::uint64_t* bytesLeft, std::vector<FileInfo>* unread) {
+    if (list.empty()) {
+        return 0;
+    }
+    std::ostringstream msg;
+    msg << "Small files (up to " << m_options.smallFileSize << " bytes) before filtering: " << list.size() << "\n";
+    Utility deduper(list);
+    std::size_t before = list.size();
+    std::size_t removed;
+    {
+        Metrics::StageTimer timer(m_metrics, Metrics::Stage::SizeFilter);
+        Tracer::Scope stage(&m_tracer, "size_filter", "stage");
+        removed = deduper.removeUniqueSizes();
+    }
+    m_metrics.setFiles(Metrics::Stage::SizeFilter, before, list.size());
+    msg << "Removed " << removed << " small files with unique sizes.\n";
+
+    before = list.size();
+    {
+        Metrics::StageTimer timer(m_metrics, Metrics::Stage::Hash);
+        Tracer::Scope stage(&m_tracer, "small_hash", "stage");
+        //removeUniqueSizes left the list sorted by size.
+        std::vector<char> skipped(list.size(), 0);
+        for (std::size_t beg = 0, end; bytesLeft && beg < list.size(); beg = end) {
+            for (end = beg + 1; end < list.size() && list[end].getSize() == list[beg].getSize(); ++end) {}
+            std::uint64_t cost = (std::uint64_t)list[beg].getSize() * (end - beg);
+            if (cost > *bytesLeft) {
+                std::fill(skipped.begin() + beg, skipped.begin() + end, 1);
+            } else {
+                *bytesLeft -= cost;
+            }
+        }
+        std::vector<std::size_t> order;
+        order.reserve(list.size());
+        for (std::size_t i = 0; i < list.size(); ++i) {
+            if (!skipped[i]) order.push_back(i);
+        }
+        std::sort(order.begin(), order.end(),
+                  [&](std::size_t a, std::size_t b) { return list[a].getPathId() < list[b].getPathId(); });
+        const std::size_t batch = 256;
+        m_pool.parallelFor((order.size() + batch - 1) / batch, [&](std::size_t b) {
+            const std::size_t last = std::min(order.size(), (b + 1) * batch);
+            if (Metrics::nowNs() >= deadlineNs) {
+                for (std::size_t k = b * batch; k < last; ++k) skipped[order[k]] = 1;
+                return;
+            }
+            Metrics::WorkTimer work(m_metrics, Metrics::Stage::Hash);
+            Metrics::Counters& counted = m_metrics.local(Metrics::Stage::Hash);
+            std::vector<char> buffer;
+            for (std::size_t k = b * batch; k < last; ++k) {
+                FileInfo& file = list[order[k]];
+                counted.filesOpened++;
+                file.setBlake3Small(m_paths.string(file.getPathId()), buffer);
+                if (file.getBlake3().empty()) {
+                    file.setRemoveUniqueFlag(true);
+                }
+                else {
+                    counted.bytesRead += file.getSize();
+                }
+            }
+        });
+        const std::string failed = markedPaths(list);
+        //A size with a file left unread leaves the list whole, its read files can't be matched against it.
+        std::size_t late = 0;
+        for (std::size_t beg = 0, end; beg < list.size(); beg = end) {
+            for (end = beg + 1; end < list.size() && list[end].getSize() == list[beg].getSize(); ++end) {}
+            if (std::find(skipped.begin() + beg, skipped.begin() + end, 1) == skipped.begin() + end) continue;
+            for (std::size_t i = beg; i < end; ++i) {
+                if (unread) unread->push_back(list[i]);
+                list[i].setRemoveUniqueFlag(true);
+            }
+            late += end - beg;
+        }
+        if (late != 0) {
+            msg << "The budget left " << late << " small files unread\n";
+        }
+        removed = deduper.removeMarkedFiles() - late;
+        if (removed != 0) {
+            msg << "Removed " << removed << " small files which couldn't be read:\n" << failed;
+        }
+        removed = deduper.removeUniqueHashes();
+    }
+    m_metrics.setFiles(Metrics::Stage::Hash, before, list.size());
+    msg << "Removed " << removed << " small files with unique hashes\n";
+    msg << "Small files remaining " << list.size() << "\n\n";
+    message(msg.str());
+
+    return list.size();
+}
+
+//findExactDuplicates with directory groups: every file is recorded, the small ones too, since
+//a tree is only identical if all of its files are.
+int ScanContext::findDuplicateTrees() {
+    std::vector<PathId> walkedFiles, partialDirs;
+    std::vector<FileInfo> smallFiles;
+    auto report = [&](const fs::path& path, PathId dirId) {
+        PathId id = PathStore::npos;
+        FileInfo fi(PathStore::npos);
+        if (fi.readFileSize(path)) {
+            fi.setPathId(intern(path, dirId, id));
+            const bool small = fi.getSize() <= m_options.smallFileSize || fi.getSize() < m_options.minDedupSize;
+            (small ? smallFiles : m_fileList).push_back(fi);
+            walkedFiles.push_back(id);
+        } else {
+            partialDirs.push_back(dirId);
+        }
+        return 0;
+    };
+    if (!walk(report, [&](PathId dirId) { partialDirs.push_back(dirId); })) {
+        return -1;
+    }
+
+    if (!m_fileList.empty()) {
+        filterDuplicates(m_fileList, nullptr);
+    }
+    filterSmallDuplicates(smallFiles);
+
+    std::vector<FileInfo> duplicates(m_fileList);
+    duplicates.insert(duplicates.end(), smallFiles.begin(), smallFiles.end());
+    std::vector<char> inDuplicateTree;
+    int groups = reportDirectoryGroups(duplicates, walkedFiles, partialDirs, inDuplicateTree);
+    //Files below minDedupSize only count for the trees, they aren't reported on their own.
+    for (const auto& file : smallFiles) {
+        if (file.getSize() >= m_options.minDedupSize) m_fileList.push_back(file);
+    }
+    std::ostringstream msg;
+    msg << "Found " << groups << " groups of identical directories\n\n";
+    message(msg.str());
+    return groups + reportDuplicateGroups(m_fileList, m_options.collapseDirectories ? &inDuplicateTree : nullptr);
+}
+
+int ScanContext::findCrossTreeDuplicates() {
+    m_metrics.reset("cross");
+    m_tracer.reset();
+    if (m_options.referenceRoots.empty()) {
+        message("No reference directory given.\n");
+        return -1;
+    }
+    if (!walk([this](const fs::path& p, PathId dir) { PathId id = PathStore::npos; return dedupReport(p, dir, id); })) {
+        return -1;
+    }
+
+    //A reference file can only match a target of the same size, the others aren't even recorded.
+    const std::size_t targets = m_fileList.size();
+    std::unordered_set<std::uintmax_t> sizes;
+    for (const auto& file : m_fileList) {
+        sizes.insert(file.getSize());
+    }
+    auto referenceReport = [&](const fs::path& path, PathId dirId) {
+        FileInfo fi(PathStore::npos);
+        if (fi.readFileSize(path) && fi.getSize() >= m_options.minDedupSize && sizes.count(fi.getSize())) {
+            PathId id = PathStore::npos;
+            fi.setPathId(intern(path, dirId, id));
+            fi.setReference(true);
+            m_fileList.push_back(fi);
+        }
+        return 0;
+    };
+    for (const auto& root : m_options.referenceRoots) {
+        if (!walkRoot(root, referenceReport)) {
+            message("Cannot walk reference directory " + root + "\n");
+            return -1;
+        }
+    }
+
+    std::ostringstream msg;
+    msg << "Target files: " << targets << ", reference files sharing a target size: "
+        << m_fileList.size() - targets << "\n";
+    message(msg.str());
+    if (targets == 0 || m_fileList.size() == targets) {
+        return 0;
+    }
+
+    if(filterDuplicates(m_fileList, nullptr, true)==0){
+        return 0;
+    }
+
+    return reportDuplicateGroups(m_fileList);
+}
+
+int ScanContext::findChunkDuplicates() {
+    m_metrics.reset("chunk");
+    m_tracer.reset();
+    if (!walk([this](const fs::path& p, PathId dir) { PathId id = PathStore::npos; return dedupReport(p, dir, id); })) {
+        return -1;
+    }
+    const std::size_t n = m_fileList.size();
+    if (n == 0) {
+        message("File List is empty.\n");
+        return 0;
+    }
+
+    Chunker chunker(m_options.chunkSize);
+    ChunkIndex index;
+    std::vector<std::vector<std::uint32_t>> fileChunks(n);     // Distinct chunk ids of each file.
+    std::uint64_t chunkedBytes = 0, chunkCount = 0;
+    {
+        Metrics::StageTimer timer(m_metrics, Metrics::Stage::Hash);
+        Tracer::Scope stage(&m_tracer, "chunk", "stage");
+        //Files are chunked in parallel a batch at a time; only this thread touches the index.
+        const std::size_t batch = std::max<std::size_t>(64, 4 * m_pool.size());
+        std::vector<std::vector<Chunker::Chunk>> chunks(batch);
+        std::vector<char> ok(batch);
+        for (std::size_t beg = 0; beg < n; beg += batch) {
+            const std::size_t count = std::min(batch, n - beg);
+            m_pool.parallelFor(count, [&](std::size_t k) {
+                Metrics::WorkTimer work(m_metrics, Metrics::Stage::Hash);
+                Metrics::Counters& counted = m_metrics.local(Metrics::Stage::Hash);
+                const std::string path = m_paths.string(m_fileList[beg + k].getPathId());
+                Tracer::Scope scope(&m_tracer, "chunk_file", "io", path);
+                counted.filesOpened++;
+                ok[k] = chunker.chunkFile(path, chunks[k]);
+                if (ok[k]) counted.bytesRead += m_fileList[beg + k].getSize();
+            });
+            for (std::size_t k = 0; k < count; ++k) {
+                if (!ok[k]) continue;
+                std::vector<std::uint32_t>& ids = fileChunks[beg + k];
+                ids.reserve(chunks[k].size());
+                for (const auto& chunk : chunks[k]) {
+                    ids.push_back(index.insert(chunk.digest, chunk.length));
+                    chunkedBytes += chunk.length;
+                }
+                chunkCount += chunks[k].size();
+                std::sort(ids.begin(), ids.end());
+                ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+                ids.shrink_to_fit();
+            }
+        }
+    }
+    m_metrics.setFiles(Metrics::Stage::Hash, n, n);
+
+    int pairs = 0;
+    std::uint64_t uniqueBytes = 0;
+    for (std::uint32_t id = 0; id < index.size(); ++id) uniqueBytes += index.length(id);
+    {
+        Metrics::StageTimer timer(m_metrics, Metrics::Stage::Similarity);
+        Tracer::Scope stage(&m_tracer, "chunk_pairs", "similarity");
+        //Files of every shared chunk, as one array sliced by offsets.
+        constexpr std::uint32_t kMaxFilesPerChunk = 64;
+        std::vector<std::uint32_t> offsets(index.size() + 1, 0);
+        for (const auto& ids : fileChunks) {
+            for (std::uint32_t id : ids) offsets[id + 1]++;
+        }
+        for (std::size_t id = 0; id < index.size(); ++id) offsets[id + 1] += offsets[id];
+        std::vector<std::uint32_t> files(offsets.back());
+        std::vector<std::uint32_t> filled(offsets.begin(), offsets.end() - 1);
+        for (std::uint32_t f = 0; f < n; ++f) {
+            for (std::uint32_t id : fileChunks[f]) files[filled[id]++] = f;
+        }
+
+        std::unordered_map<std::uint64_t, std::uint64_t> shared;   // (file a << 32 | file b) -> bytes.
+        for (std::size_t id = 0; id < index.size(); ++id) {
+            const std::uint32_t beg = offsets[id], end = offsets[id + 1];
+            if (end - beg < 2 || end - beg > kMaxFilesPerChunk) continue;
+            for (std::uint32_t a = beg; a < end; ++a) {
+                for (std::uint32_t b = a + 1; b < end; ++b) {
+                    shared[(std::uint64_t)files[a] << 32 | files[b]] += index.length((std::uint32_t)id);
+                }
+            }
+        }
+
+        struct Pair {
+            std::uint32_t a, b;
+            std::uint64_t bytes;
+            double similarity;
+        };
+        std::vector<Pair> found;
+        for (const auto& entry : shared) {
+            const std::uint32_t a = (std::uint32_t)(entry.first >> 32), b = (std::uint32_t)entry.first;
+            const std::uintmax_t larger = std::max(m_fileList[a].getSize(), m_fileList[b].getSize());
+            const double similarity = larger ? (double)entry.second / larger : 0;
+            if (similarity >= m_options.chunkMinShared) found.push_back(Pair{a, b, entry.second, similarity});
+        }
+        std::sort(found.begin(), found.end(), [](const Pair& x, const Pair& y) {
+            if (x.similarity != y.similarity) return x.similarity > y.similarity;
+            if (x.bytes != y.bytes) return x.bytes > y.bytes;
+            return std::make_pair(x.a, x.b) < std::make_pair(y.a, y.b);
+        });
+        DuplicateGroup group;
+        group.kind = DuplicateGroup::Kind::Chunk;
+        for (const Pair& pair : found) {
+            group.files.clear();
+            group.files.push_back(m_paths.path(m_fileList[pair.a].getPathId()));
+            group.files.push_back(m_paths.path(m_fileList[pair.b].getPathId()));
+            group.wastedBytes = pair.bytes;
+            group.similarity = pair.similarity;
+            if (m_onGroup) m_onGroup(group);
+            pairs++;
+        }
+        m_metrics.setFiles(Metrics::Stage::Similarity, n, found.size());
+        m_metrics.addGroups(pairs);
+    }
+
+    std::ostringstream msg;
+    msg << "\n=== Chunks ===\n";
+    msg << "Chunked " << n << " files, " << chunkedBytes << " bytes, into " << chunkCount << " chunks ("
+        << index.size() << " distinct, " << (chunkCount ? chunkedBytes / chunkCount : 0) << " bytes on average)\n";
+    msg << "A chunk-level dedup would reclaim " << chunkedBytes - uniqueBytes << " bytes";
+    if (chunkedBytes) msg << std::fixed << std::setprecision(1) << " (" << 100.0 * (chunkedBytes - uniqueBytes) / chunkedBytes << "%)";
+    msg << "\n";
+    message(msg.str());
+    return pairs;
+}
+
+int ScanContext::estimateDuplicates() {
+    m_metrics.reset("estimate");
+    m_tracer.reset();
+    if (!walk([this](const fs::path& p, PathId dir) { PathId id = PathStore::npos; return dedupReport(p, dir, id); })) {
+        return -1;
+    }
+
+    struct Bucket {
+        std::uintmax_t size = 0;
+        std::size_t files = 0;
+        double maxWasted = 0;           // (files - 1) * size, every file of the size but one a copy.
+        double probability = 0;
+        double wasted = 0;              // Measured, for drawn buckets.
+    };
+    std::sort(m_fileList.begin(), m_fileList.end(),
+              [](const FileInfo& a, const FileInfo& b) { return a.getSize() < b.getSize(); });
+    std::vector<Bucket> buckets;
+    for (std::size_t beg = 0, end; beg < m_fileList.size(); beg = end) {
+        for (end = beg + 1; end < m_fileList.size() && m_fileList[end].getSize() == m_fileList[beg].getSize(); ++end) {}
+        if (end - beg < 2) continue;
+        Bucket b;
+        b.size = m_fileList[beg].getSize();
+        b.files = end - beg;
+        b.maxWasted = (double)(b.files - 1) * b.size;
+        buckets.push_back(b);
+    }
+    double candidateBytes = 0, maxWasted = 0;
+    for (const auto& b : buckets) {
+        candidateBytes += (double)b.files * b.size;
+        maxWasted += b.maxWasted;
+    }
+    if (buckets.empty()) {
+        message("No two files share a size: nothing is duplicated.\n");
+        return 0;
+    }
+
+    //probability = min(1, c * maxWasted); c is searched so that the expected bytes read hit the target.
+    const double fraction = std::min(1.0, std::max(0.0, m_options.sampleFraction));
+    auto expectedRead = [&](double c) {
+        double bytes = 0;
+        for (const auto& b : buckets) bytes += std::min(1.0, c * b.maxWasted) * b.files * b.size;
+        return bytes;
+    };
+    double lo = 0, hi = 1;
+    while (expectedRead(hi) < fraction * candidateBytes && hi < 1e300) hi *= 2;
+    for (int i = 0; i < 100; ++i) {
+        double mid = (lo + hi) / 2;
+        (expectedRead(mid) < fraction * candidateBytes ? lo : hi) = mid;
+    }
+    std::mt19937_64 rng(m_options.sampleSeed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::unordered_map<std::uintmax_t, std::size_t> drawn;        // Size -> bucket.
+    for (std::size_t i = 0; i < buckets.size(); ++i) {
+        buckets[i].probability = std::min(1.0, hi * buckets[i].maxWasted);
+        if (uniform(rng) < buckets[i].probability) drawn.emplace(buckets[i].size, i);
+    }
+
+    std::vector<FileInfo> sample;
+    for (const auto& file : m_fileList) {
+        if (drawn.count(file.getSize())) sample.push_back(file);
+    }
+    double sampleBytes = 0;
+    for (const auto& file : sample) sampleBytes += file.getSize();
+    if (!sample.empty() && filterDuplicates(sample, nullptr) > 0) {
+        //The list is left sorted by hash: every run is one duplicate group.
+        for (std::size_t beg = 0, end; beg < sample.size(); beg = end) {
+            for (end = beg + 1; end < sample.size() && sample[end].getBlake3() == sample[beg].getBlake3(); ++end) {}
+            buckets[drawn[sample[beg].getSize()]].wasted += (double)(end - beg - 1) * sample[beg].getSize();
+        }
+    }
+
+    //Ratio estimate: the wasted share of the drawn buckets' maximum, times the known total maximum.
+    //It only varies with the share, not with how many buckets happened to be drawn.
+    double wastedHT = 0, maxHT = 0, found = 0;
+    for (const auto& entry : drawn) {
+        const Bucket& b = buckets[entry.second];
+        wastedHT += b.wasted / b.probability;
+        maxHT += b.maxWasted / b.probability;
+        found += b.wasted;
+    }
+    const double ratio = maxHT > 0 ? wastedHT / maxHT : 0;
+    double estimate = ratio * maxWasted, variance = 0;
+    for (const auto& entry : drawn) {
+        const Bucket& b = buckets[entry.second];
+        const double residual = (b.wasted - ratio * b.maxWasted) / b.probability;
+        variance += (1 - b.probability) * residual * residual;
+    }
+    variance *= maxHT > 0 ? (maxWasted / maxHT) * (maxWasted / maxHT) : 0;
+    //Nothing can go below what was found nor above every candidate being a copy.
+    const double margin = 1.96 * std::sqrt(variance);
+    const double high = std::min(maxWasted, estimate + margin);
+    const double low = std::min(high, std::max(found, estimate - margin));
+    estimate = std::min(estimate, maxWasted);
+
+    std::ostringstream msg;
+    msg << std::fixed << std::setprecision(0);
+    msg << "\n=== Estimate ===\n";
+    msg << "Files walked:              " << m_fileList.size() << "\n";
+    msg << "Candidate size buckets:    " << buckets.size() << " (" << candidateBytes << " bytes)\n";
+    msg << "Sampled buckets:           " << drawn.size() << " (" << sampleBytes << " bytes, "
+        << std::setprecision(2) << 100.0 * sampleBytes / candidateBytes << "% of the candidate bytes)\n"
+        << std::setprecision(0);
+    msg << "Duplicate bytes found:     " << found << "\n";
+    msg << "Estimated duplicate bytes: " << estimate << "\n";
+    msg << "95% confidence interval:   " << low << " - " << high << "\n";
+    msg << "Upper bound (same size):   " << maxWasted << "\n";
+    message(msg.str());
+    return (int)drawn.size();
+}
+
+template<class Record>
+std::size_t ScanContext::fillRecords(Metrics::Stage stage, std::vector<Record>& records,
+                                     const std::function<bool(FileInfo&, Record&, Metrics::Counters&)>& fill) {
+    records.assign(m_fileList.size(), Record{});
+    std::vector<char> ok(m_fileList.size(), 0);
+    {
+        Metrics::StageTimer timer(m_metrics, stage);
+        Tracer::Scope scope(&m_tracer, Metrics::stageName(stage), "stage");
+        m_pool.parallelFor(m_fileList.size(), [&](std::size_t i) {
+            Metrics::WorkTimer work(m_metrics, stage);
+            ok[i] = fill(m_fileList[i], records[i], m_metrics.local(stage)) ? 1 : 0;
+        });
+    }
+    std::size_t kept = 0;
+    std::string failed;
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        if (!ok[i]) {
+            failed += "  " + m_paths.string(m_fileList[i].getPathId()) + "\n";
+            continue;
+        }
+        if (kept != i) records[kept] = std::move(records[i]);
+        kept++;
+    }
+    records.resize(kept);
+    m_metrics.setFiles(stage, m_fileList.size(), kept);
+    if (kept != m_fileList.size()) {
+        message("Left out " + std::to_string(m_fileList.size() - kept) + " files which couldn't be read:\n" + failed);
+    }
+    return kept;
+}
+
+//The paths of the records pending[i] whose file couldn't be hashed, one per line; they stay without a digest.
+static std::string unreadablePaths(const ShardFile& shard, const std::vector<std::size_t>& pending,
+                                   const std::vector<char>& unreadable) {
+    std::string failed;
+    for (std::size_t i = 0; i < pending.size(); ++i) {
+        if (unreadable[i]) failed += "  " + shard.records[pending[i]].path + "\n";
+    }
+    return failed;
+}
+
+int ScanContext::writeShard(const std::string& shardFile, const std::string& name) {
+    m_metrics.reset("shard");
+    m_tracer.reset();
+    if (!walk([this](const fs::path& p, PathId dir) { PathId id = PathStore::npos; return dedupReport(p, dir, id); })) {
+        return -1;
+    }
+
+    //Taken once here: fs::absolute throws if the working directory is gone, and pool jobs must not throw.
+    std::error_code ec;
+    const fs::path cwd = fs::current_path(ec);
+    if (ec) {
+        message("Cannot get the working directory: " + ec.message() + "\n");
+        return -1;
+    }
+    ShardFile shard;
+    shard.name = name;
+    const std::size_t kept = fillRecords<ShardFile::Record>(Metrics::Stage::Prefix, shard.records,
+        [&](FileInfo& file, ShardFile::Record& rec, Metrics::Counters& counted) {
+            const std::string path = m_paths.string(file.getPathId());
+            Tracer::Scope scope(&m_tracer, "read_prefix", "io", path);
+            counted.filesOpened++;
+            if (file.readFirstBytes(path) != 0) return false;
+            counted.bytesRead += std::min<std::uintmax_t>(file.getSize(), file.getBufferSize());
+            rec.path = (cwd / path).lexically_normal().string();
+            rec.size = file.getSize();
+            rec.mtime = file.getMtime();
+            rec.prefix = file.getPrefix();
+            return true;
+        });
+
+    //A collision within the shard stays a collision after any merge, so those files are hashed now.
+    std::vector<std::size_t> order(kept);
+    std::iota(order.begin(), order.end(), 0);
+    auto key = [&](std::size_t i) { return std::make_pair(shard.records[i].size, shard.records[i].prefix); };
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return key(a) < key(b); });
+    std::vector<std::size_t> pending;
+    for (std::size_t beg = 0, end; beg < order.size(); beg = end) {
+        for (end = beg + 1; end < order.size() && key(order[end]) == key(order[beg]); ++end) {}
+        if (end - beg > 1) pending.insert(pending.end(), order.begin() + beg, order.begin() + end);
+    }
+    std::vector<char> unreadable(pending.size(), 0);
+    {
+        Metrics::StageTimer timer(m_metrics, Metrics::Stage::Hash);
+        Tracer::Scope stage(&m_tracer, "hash", "stage");
+        m_pool.parallelFor(pending.size(), [&](std::size_t i) {
+            Metrics::WorkTimer work(m_metrics, Metrics::Stage::Hash);
+            Metrics::Counters& counted = m_metrics.local(Metrics::Stage::Hash);
+            ShardFile::Record& rec = shard.records[pending[i]];
+            Tracer::Scope scope(&m_tracer, "hash", "io", rec.path);
+            counted.filesOpened++;
+            rec.hasDigest = Checksum::computeDigest(rec.path, rec.digest.data());
+            if (rec.hasDigest) counted.bytesRead += rec.size;
+            else unreadable[i] = 1;
+        });
+    }
+    const std::string failed = unreadablePaths(shard, pending, unreadable);
+    if (!failed.empty()) message("Files which couldn't be hashed, recorded without a digest:\n" + failed);
+    m_metrics.setFiles(Metrics::Stage::Hash, pending.size(), pending.size());
+
+    if (!shard.write(shardFile)) {
+        message("Cannot write the shard to " + shardFile + "\n");
+        return -1;
+    }
+    std::ostringstream msg;
+    msg << "Wrote " << kept << " records (" << pending.size() << " hashed) of shard " << name
+        << " to " << shardFile << "\n";
+    message(msg.str());
+    return (int)kept;
+}
+
+int ScanContext::completeShard(const std::string& shardFile, const std::string& workList) {
+    m_metrics.reset("complete");
+    m_tracer.reset();
+    ShardFile shard;
+    std::string error;
+    if (!shard.read(shardFile, error)) {
+        message("Cannot read shard " + shardFile + ": " + error + "\n");
+        return -1;
+    }
+    std::ifstream list(workList);
+    if (!list) {
+        message("Cannot read work list " + workList + "\n");
+        return -1;
+    }
+    std::unordered_set<std::string> wanted;
+    std::string line;
+    while (std::getline(list, line)) {
+        std::size_t tab = line.find('\t');
+        if (tab != std::string::npos && line.compare(0, tab, shard.name) == 0 && tab == shard.name.size()) {
+            wanted.insert(line.substr(tab + 1));
+        }
+    }
+
+    std::vector<std::size_t> pending;
+    for (std::size_t i = 0; i < shard.records.size(); ++i) {
+        if (!shard.records[i].hasDigest && wanted.count(shard.records[i].path)) pending.push_back(i);
+    }
+    std::atomic<std::size_t> changed{0};
+    std::vector<char> unreadable(pending.size(), 0);
+    {
+        Metrics::StageTimer timer(m_metrics, Metrics::Stage::Hash);
+        Tracer::Scope stage(&m_tracer, "hash", "stage");
+        m_pool.parallelFor(pending.size(), [&](std::size_t i) {
+            Metrics::WorkTimer work(m_metrics, Metrics::Stage::Hash);
+            Metrics::Counters& counted = m_metrics.local(Metrics::Stage::Hash);
+            ShardFile::Record& rec = shard.records[pending[i]];
+            //The digest must describe the recorded size, a file changed since the scan is left unhashed.
+            FileInfo now(PathStore::npos);
+            if (!now.readFileSize(rec.path) || now.getSize() != rec.size || now.getMtime() != rec.mtime) {
+                changed++;
+                return;
+            }
+            Tracer::Scope scope(&m_tracer, "hash", "io", rec.path);
+            counted.filesOpened++;
+            rec.hasDigest = Checksum::computeDigest(rec.path, rec.digest.data());
+            if (rec.hasDigest) counted.bytesRead += rec.size;
+            else unreadable[i] = 1;
+        });
+    }
+    const std::string failed = unreadablePaths(shard, pending, unreadable);
+    if (!failed.empty()) message("Files which couldn't be hashed, recorded without a digest:\n" + failed);
+    m_metrics.setFiles(Metrics::Stage::Hash, pending.size(), pending.size() - changed);
+
+    if (!shard.write(shardFile)) {
+        message("Cannot write the shard to " + shardFile + "\n");
+        return -1;
+    }
+    std::ostringstream msg;
+    msg << "Hashed " << pending.size() - changed << " listed files of shard " << shard.name;
+    if (changed) msg << ", " << changed << " changed since the scan (scan the shard again)";
+    msg << "\n";
+    message(msg.str());
+    return (int)(pending.size() - changed);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//For detecting similar images.
+
+//Images are only recognised by their extension here. Decoding them once to check them would
+//cost as much as hashing them; the ones which can't be decoded get a hash of 0 and are
+//removed by hashImages.
+int ScanContext::imgReport(const fs::path& path_name, PathId dirId, PathId& fileId) {
+    if (!is_image_file(path_name.native())) {
+        return -1;
+    }
+    m_imageList.emplace_back(intern(path_name, dirId, fileId));
+    return 0;
+}
+
+/**
+ * @brief Runs one BKTree query per file on the context's thread pool.
+ *
+ * The tree is only read. Files are handed out in fixed batches and each batch
+ * collects its neighbours in its own buffer; the buffers are joined in batch
+ * order, so the result doesn't depend on the number of threads. The
+ * neighbours of list[i] (itself included) are ids[offsets[i], offsets[i + 1]).
+ */
+void ScanContext::queryNeighbours(const std::vector<FileInfo>& list, const BKTree& tree, int threshold,
+                                  std::vector<std::size_t>& offsets, std::vector<PathId>& ids) {
+    Tracer::Scope scope(&m_tracer, "bktree_query", "similarity");
+    const std::size_t batch = 1024;
+    const std::size_t batches = (list.size() + batch - 1) / batch;
+    std::vector<std::vector<PathId>> found(batches);
+    std::vector<std::vector<std::uint32_t>> counts(batches);
+    m_pool.parallelFor(batches, [&](std::size_t b) {
+        for (std::size_t i = b * batch; i < std::min(list.size(), (b + 1) * batch); ++i) {
+            const std::size_t before = found[b].size();
+            tree.findSimilarIds(list[i].getImgHash(), threshold, found[b]);
+            counts[b].push_back((std::uint32_t)(found[b].size() - before));
+        }
+    });
+    offsets.assign(1, 0);
+    ids.clear();
+    for (std::size_t b = 0; b < batches; ++b) {
+        for (std::uint32_t n : counts[b]) offsets.push_back(offsets.back() + n);
+        ids.insert(ids.end(), found[b].begin(), found[b].end());
+        std::vector<PathId>().swap(found[b]);
+    }
+}
+
+/**
+ * @brief Reports the groups of similar files under a built BKTree.
+ *
+ * The queries run in parallel (queryNeighbours); the groups are then formed in
+ * list order, each from the first file not grouped yet and its neighbours not
+ * grouped yet, so they are the same for any number of threads.
+ */
+int ScanContext::reportSimilarGroups(const std::vector<FileInfo>& list, const BKTree& tree, DuplicateGroup::Kind kind) {
+    std::vector<std::size_t> offsets;
+    std::vector<PathId> ids;
+    queryNeighbours(list, tree, m_options.imageThreshold, offsets, ids);
+
+    //Indexed by PathId, one bit per recorded path instead of a set of path copies.
+    std::vector<bool> visited(m_paths.size(), false);
+    int count=0;
+    std::size_t grouped=0;
+    DuplicateGroup group;
+    group.kind = kind;
+    for(std::size_t i=0; i<list.size(); ++i){
+        if(visited[list[i].getPathId()]) continue;
+
+        group.files.clear();
+        for(std::size_t k=offsets[i]; k<offsets[i+1]; ++k){
+            if(!visited[ids[k]]) group.files.push_back(m_paths.path(ids[k]));
+        }
+
+        if(group.files.size()>1){
+            for(std::size_t k=offsets[i]; k<offsets[i+1]; ++k){
+                visited[ids[k]]=true;
+            }
+            reportSimilarGroup(group);
+            count++;
+            grouped+=group.files.size();
+        }
+        else{
+            visited[list[i].getPathId()]=true;
+        }
+    }
+    m_metrics.setFiles(Metrics::Stage::Similarity, list.size(), grouped);
+    m_metrics.addGroups(count);
+    return count;
+}
+
+//Fills in the wasted bytes of a group of similar files (all but the largest) and hands it on.
+void ScanContext::reportSimilarGroup(DuplicateGroup& group) {
+    std::uintmax_t total=0, largest=0;
+    for(const auto& path: group.files){
+        std::error_code ec;
+        std::uintmax_t size=fs::file_size(path, ec);
+        if(!ec){
+            total+=size;
+            largest=std::max(largest, size);
+        }
+    }
+    group.wastedBytes=total-largest;
+    if (m_onGroup) m_onGroup(group);
+}
+
+/**
+ * @brief Computes the 64 bit perceptual hash of the given kind, 0 if the image can't be decoded.
+ *
+ * The average and difference hashes come from a reduced decode. pHash comes from a
+ * full one, so it matches the hashes computed along with the exact search.
+ * With thumbnails set, a JPEG's EXIF thumbnail is decoded instead when it has one.
+ */
+static uint64_t imageHash64(const std::string& path, ScanOptions::ImageHash kind, bool thumbnails) {
+    cv::Mat gray;
+    if (thumbnails) gray = Checksum::loadThumbnailGray(path);
+    if (kind == ScanOptions::ImageHash::AHash || kind == ScanOptions::ImageHash::DHash) {
+        if (gray.empty()) gray = Checksum::loadReducedGray(path);
+        if (gray.empty()) return 0;
+        return kind == ScanOptions::ImageHash::AHash ? Checksum::ahashFromMat(gray) : Checksum::dhashFromMat(gray);
+    }
+    return gray.empty() ? Checksum::computeImagePHash64(path) : Checksum::phashFromMat(gray);
+}
+
+/**
+ * @brief Sets the 64 bit hash of the given kind on every image, and removes the ones which can't be decoded.
+ *
+ * The removed images are listed in a message.
+ * @param known pHashes already computed by an earlier stage, keyed by path. May be null, only used for PHash.
+ * @param thumbnails Hash the EXIF thumbnail of a JPEG file when it has one; only for the prefilter.
+ * @return Number of images removed.
+ */
+std::size_t ScanContext::hashImages(std::vector<FileInfo>& list, ScanOptions::ImageHash kind,
+                                    const std::unordered_map<PathId, uint64_t>* known, bool thumbnails) {
+    if(kind!=ScanOptions::ImageHash::PHash){
+        known=nullptr;
+    }
+    std::size_t before=list.size();
+    std::size_t removed;
+    std::string failed;
+    {
+        Metrics::StageTimer timer(m_metrics, Metrics::Stage::ImageHash);
+        Tracer::Scope stage(&m_tracer, "image_hash", "stage");
+        m_pool.parallelFor(list.size(), [&](std::size_t i) {
+            FileInfo& it = list[i];
+            bool reused=false;
+            if(known){
+                auto found=known->find(it.getPathId());
+                if(found!=known->end()){
+                    it.setImgHash(found->second);
+                    reused=true;
+                }
+            }
+            if(!reused){
+                Metrics::WorkTimer work(m_metrics, Metrics::Stage::ImageHash, true);
+                Metrics::Counters& counted = m_metrics.local(Metrics::Stage::ImageHash);
+                const std::string path = m_paths.string(it.getPathId());
+                counted.filesOpened++;
+                if(m_metrics.isEnabled()){
+                    std::error_code ec;
+                    std::uintmax_t size = fs::file_size(path, ec);
+                    if(!ec) counted.bytesRead += size;
+                }
+                Tracer::Scope scope(&m_tracer, "decode_image", "decode", path);
+                it.setImgHash(imageHash64(path, kind, thumbnails));
+            }
+            if(it.getImgHash()==0){
+                it.setRemoveUniqueFlag(true);
+            }
+        });
+        failed=markedPaths(list);
+        Utility deduper(list);
+        removed=deduper.removeMarkedFiles();
+    }
+    m_metrics.setFiles(Metrics::Stage::ImageHash, before, list.size());
+    if(removed){
+        message("Removed "+std::to_string(removed)+" images which could not be opened for hashing:\n"+failed);
+    }
+    return removed;
+}
+
+/**
+ * @brief First stage of the image cascade: drops the images no other image comes near under a cheap hash.
+ *
+ * offsets and ids receive, for each image left and in list order, the path ids of
+ * the images within prefilterThreshold of it (itself included): image i's are
+ * ids[offsets[i]] to ids[offsets[i+1]-1].
+ * @return Number of images left.
+ */
+std::size_t ScanContext::prefilterImages(std::vector<FileInfo>& list, ScanOptions::ImageHash kind,
+                                         const std::unordered_map<PathId, uint64_t>* known,
+                                         std::vector<std::size_t>& offsets, std::vector<PathId>& ids) {
+    hashImages(list, kind, known, m_options.exifThumbnails);
+    std::size_t before=list.size();
+    {
+        Metrics::StageTimer timer(m_metrics, Metrics::Stage::Similarity);
+        Tracer::Scope stage(&m_tracer, "image_prefilter", "similarity");
+        BKTree tree;
+        for(const auto& file: list){
+            tree.insert(file);
+        }
+        std::vector<std::size_t> found;
+        std::vector<PathId> foundIds;
+        queryNeighbours(list, tree, m_options.prefilterThreshold, found, foundIds);
+        //The image itself is always found. The neighbour lists of the images left are
+        //moved to the front, in the order removeMarkedFiles keeps.
+        offsets.assign(1, 0);
+        ids.clear();
+        for(std::size_t i=0; i<list.size(); ++i){
+            if(found[i+1]-found[i]<2){
+                list[i].setRemoveUniqueFlag(true);
+                continue;
+            }
+            ids.insert(ids.end(), foundIds.begin()+found[i], foundIds.begin()+found[i+1]);
+            offsets.push_back(ids.size());
+        }
+        Utility(list).removeMarkedFiles();
+    }
+    std::ostringstream msg;
+    msg<<"Removed "<<before-list.size()<<" images with no other image near them under the prefilter hash.\n";
+    message(msg.str());
+    return list.size();
+}
+
+//Hamming distance of two 256 bit hashes.
+static int hammingDistance256(const std::array<uint64_t, 4>& a, const std::array<uint64_t, 4>& b) {
+    int distance=0;
+    for(int w=0; w<4; ++w){
+        distance+=__builtin_popcountll(a[w]^b[w]);
+    }
+    return distance;
+}
+
+/**
+ * @brief Last stage of the cascade for PHash256: confirms the prefilter's neighbours with the 256 bit hash.
+ *
+ * An image is only compared with the neighbours the prefilter's BKTree found for
+ * it, so the work grows with the number of near pairs, not with the square of a
+ * cluster chained together from them. Like reportSimilarGroups, each group is the
+ * first image left in list order and every neighbour left within 4 x imageThreshold of it.
+ */
+int ScanContext::reportImageNeighbours(std::vector<FileInfo>& list, const std::vector<std::size_t>& offsets,
+                                       const std::vector<PathId>& ids) {
+    std::vector<std::array<uint64_t, 4>> hashes(list.size());
+    std::vector<char> ok(list.size(), 0);
+    {
+        Metrics::StageTimer timer(m_metrics, Metrics::Stage::ImageHash);
+        Tracer::Scope stage(&m_tracer, "image_hash256", "stage");
+        m_pool.parallelFor(list.size(), [&](std::size_t i) {
+            Metrics::WorkTimer work(m_metrics, Metrics::Stage::ImageHash, true);
+            m_metrics.local(Metrics::Stage::ImageHash).filesOpened++;
+            const std::string path = m_paths.string(list[i].getPathId());
+            Tracer::Scope scope(&m_tracer, "decode_image", "decode", path);
+            cv::Mat img = cv::imread(path, cv::IMREAD_GRAYSCALE);
+            if(!img.empty()){
+                Checksum::phash256FromMat(img, hashes[i].data());
+                ok[i]=1;
+            }
+        });
+    }
+
+    Metrics::StageTimer timer(m_metrics, Metrics::Stage::Similarity);
+    Tracer::Scope stage(&m_tracer, "similarity", "stage");
+    const std::size_t none=list.size();
+    std::vector<std::size_t> indexOf(m_paths.size(), none);
+    for(std::size_t i=0; i<list.size(); ++i){
+        indexOf[list[i].getPathId()]=i;
+    }
+
+    const int threshold=4*m_options.imageThreshold;
+    std::vector<char> grouped(list.size(), 0);
+    int count=0;
+    std::size_t files=0;
+    DuplicateGroup group;
+    group.kind = DuplicateGroup::Kind::Image;
+    for(std::size_t seed=0; seed<list.size(); ++seed){
+        if(grouped[seed] || !ok[seed]) continue;
+        grouped[seed]=1;
+        group.files.assign(1, m_paths.path(list[seed].getPathId()));
+        for(std::size_t k=offsets[seed]; k<offsets[seed+1]; ++k){
+            const std::size_t other=indexOf[ids[k]];
+            if(other!=none && !grouped[other] && ok[other] &&
+               hammingDistance256(hashes[seed], hashes[other])<=threshold){
+                grouped[other]=1;
+                group.files.push_back(m_paths.path(ids[k]));
+            }
+        }
+        if(group.files.size()>1){
+            reportSimilarGroup(group);
+            count++;
+            files+=group.files.size();
+        }
+    }
+    m_metrics.setFiles(Metrics::Stage::Similarity, list.size(), files);
+    m_metrics.addGroups(count);
+    return count;
+}
+
+/**
+ * @brief Hashes the images, builds the BKTree and reports the similar groups.
+ *
+ * With an image prefilter (or PHash256, which always gets one, pHash by default)
+ * the images are hashed in a cascade: the cheap hash first, and the grouping
+ * hash only for the images the prefilter keeps.
+ * EXIF thumbnails only ever feed the prefilter, which they turn on (with the
+ * grouping hash) if it is off. A thumbnail may be stale or cropped, so the
+ * grouping hash always comes from the full image, and a thumbnail hash is never
+ * compared with a full image hash at that stage.
+ *
+ * @param list Image files to compare.
+ * @param known Image hashes already computed by an earlier stage, keyed by path. May be null.
+ */
+int ScanContext::processImages(std::vector<FileInfo>& list,
+                               const std::unordered_map<PathId, uint64_t>* known) {
+    using ImageHash = ScanOptions::ImageHash;
+    ImageHash prefilter = m_options.imagePrefilter;
+    if((m_options.imageHash==ImageHash::PHash256 || m_options.exifThumbnails) && prefilter==ImageHash::None){
+        prefilter=m_options.imageHash==ImageHash::PHash256 ? ImageHash::PHash : m_options.imageHash;
+    }
+    std::vector<std::size_t> offsets;
+    std::vector<PathId> ids;
+    if(prefilter!=ImageHash::None && prefilterImages(list, prefilter, known, offsets, ids)==0){
+        return 0;
+    }
+    if(m_options.imageHash==ImageHash::PHash256){
+        return reportImageNeighbours(list, offsets, ids);
+    }
+
+    //The pHashes of the exact search come from the thumbnails as well then.
+    if(prefilter!=m_options.imageHash || m_options.exifThumbnails){
+        hashImages(list, m_options.imageHash, m_options.exifThumbnails ? nullptr : known, false);
+    }
+    std::ostringstream msg;
+    msg<<"Total images to be processed: "<<list.size()<<"\n";
+    message(msg.str());
+
+    Metrics::StageTimer timer(m_metrics, Metrics::Stage::Similarity);
+    Tracer::Scope stage(&m_tracer, "similarity", "stage");
+    BKTree tree;
+    {
+        Tracer::Scope scope(&m_tracer, "bktree_insert", "similarity");
+        for(auto &file: list){
+            tree.insert(file);
+        }
+    }
+    return reportSimilarGroups(list, tree, DuplicateGroup::Kind::Image);
+}
+
+int ScanContext::findSimilarImages() {
+    m_metrics.reset("img");
+    m_tracer.reset();
+    if (!walk([this](const fs::path& p, PathId dir) { PathId id = PathStore::npos; return imgReport(p, dir, id); })) {
+        return -1;
+    }
+
+    if(m_imageList.size()==0){
+        message("File List is empty.\n");
+        return 0;
+    }
+    int groups = processImages(m_imageList, nullptr);
+    message("Finished processing similar images\n");
+    return groups;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//For finding different vidoes which differ only in terms of quality.
+
+//Opens the video to read its duration and adds it to the given list.
+int ScanContext::addVideo(const fs::path& path_name, PathId dirId, PathId& fileId, std::vector<FileInfo>& list) {
+    Tracer::Scope scope(&m_tracer, "open_video", "io", path_name.native());
+    cv::VideoCapture cap(path_name.string());
+    if(!cap.isOpened()){
+        return -1; //Not a video file.
+    }
+    m_metrics.local(Metrics::Stage::Walk).filesOpened++;
+
+    double totalFrames=cap.get(cv::CAP_PROP_FRAME_COUNT);
+    double fps=cap.get(cv::CAP_PROP_FPS);
+
+    if(fps<=0 || totalFrames<=0){
+        return -1;
+    }
+    FileInfo file(intern(path_name, dirId, fileId));
+    int duration=(int)(totalFrames/fps);
+    file.setDuration(duration);
+    list.emplace_back(file);
+
+    return 0;
+}
+
+int ScanContext::vidReport(const fs::path& path_name, PathId dirId, PathId& fileId) {
+    if(!is_video_file(path_name.native())){
+        return -1;
+    }
+    return addVideo(path_name, dirId, fileId, m_videoList);
+}
+
+/**
+ * @brief Hashes the videos and reports the similar groups within each duration bucket.
+ *
+ * Videos longer than videoSegmentSeconds have their frames sampled in segments
+ * on separate threads, one per videoSegmentSeconds, at most one per pool thread.
+ */
+int ScanContext::processVideos(std::vector<FileInfo>& list) {
+    std::size_t before=list.size();
+    std::size_t removed;
+    std::ostringstream msg;
+    {
+        Metrics::StageTimer timer(m_metrics, Metrics::Stage::VideoHash);
+        Tracer::Scope stage(&m_tracer, "video_hash", "stage");
+        //The samples of a long video are split into segments, runs of consecutive samples
+        //decoded through their own capture. Every segment of every video is one task of the
+        //pool, so no more decoders are open than the pool has threads.
+        const int samples=std::max(m_options.videoFrames, 1);
+        std::vector<std::pair<std::size_t, int>> tasks;     // (video, segment)
+        std::vector<int> segments(list.size(), 1);
+        for(std::size_t i=0; i<list.size(); ++i){
+            if(m_options.videoSegmentSeconds>0){
+                segments[i]=std::min({1+list[i].getDuration()/m_options.videoSegmentSeconds, (int)m_pool.size(), samples});
+            }
+            for(int s=0; s<segments[i]; ++s) tasks.emplace_back(i, s);
+        }
+        std::vector<std::vector<uint64_t>> hashes(list.size(), std::vector<uint64_t>(samples));
+        std::vector<int> read(tasks.size());
+        m_pool.parallelFor(tasks.size(), [&](std::size_t t) {
+            Metrics::WorkTimer work(m_metrics, Metrics::Stage::VideoHash, true);
+            m_metrics.local(Metrics::Stage::VideoHash).filesOpened++;
+            const std::size_t i=tasks[t].first;
+            const int s=tasks[t].second, begin=s*samples/segments[i], end=(s+1)*samples/segments[i];
+            const std::string path = m_paths.string(list[i].getPathId());
+            Tracer::Scope scope(&m_tracer, "decode_video", "decode", path);
+            read[t]=Checksum::sampleVideoFrames(path, samples, begin, end, hashes[i].data());
+        });
+        //If a frame couldn't be read, keep the samples before it, as one sequential pass would.
+        for(std::size_t t=0; t<tasks.size();){
+            const std::size_t i=tasks[t].first;
+            int kept=0;
+            bool cut=false;
+            for(int s=0; s<segments[i]; ++s, ++t){
+                if(cut) continue;
+                kept+=read[t];
+                cut=read[t]<(s+1)*samples/segments[i]-s*samples/segments[i];
+            }
+            hashes[i].resize(kept);
+            list[i].setVideoHashes(std::move(hashes[i]));
+            if(kept==0){
+                list[i].setRemoveUniqueFlag(true);
+            }
+        }
+
+        std::string failed=markedPaths(list);
+        Utility deduper(list);
+        removed=deduper.removeMarkedFiles();
+        if(removed){
+            msg<<"Removed "<<removed<<" video files which couldn't be hashed:\n"<<failed;
+        }
+
+        removed = deduper.removeUniqueDuration();//This sorts it accoring to durtion. This is why we can call upper bound below.
+    }
+    m_metrics.setFiles(Metrics::Stage::VideoHash, before, list.size());
+    msg << "Removed " << removed << " files with unique duration.\n";
+    msg << "Files remaining: " << list.size() << "\n\n";
+    message(msg.str());
+
+    Metrics::StageTimer timer(m_metrics, Metrics::Stage::Similarity);
+    Tracer::Scope stage(&m_tracer, "similarity", "stage");
+    int groups=0;
+    size_t start=0, end;
+    while(start!=list.size()){
+        end=std::upper_bound(list.begin()+start, list.end(), list[start].getDuration(), cmpDurationValFile)-list.begin();
+        BKTree tree;
+        std::vector<FileInfo> temp;
+        {
+            Tracer::Scope scope(&m_tracer, "bktree_insert", "similarity");
+            while(start!=end){
+                tree.insertVideoHashes(list[start]);
+                temp.push_back(list[start]);
+                start++;
+            }
+        }
+
+        groups+=reportSimilarGroups(temp, tree, DuplicateGroup::Kind::Video);
+    }
+    return groups;
+}
+
+int ScanContext::findSimilarVideos() {
+    m_metrics.reset("vid");
+    m_tracer.reset();
+    if (!walk([this](const fs::path& p, PathId dir) { PathId id = PathStore::npos; return vidReport(p, dir, id); })) {
+        return -1;
+    }
+
+    if(m_videoList.size()==0){
+        message("File List is empty.\n");
+        return 0;
+    }
+
+    std::ostringstream msg;
+    msg<<"Found "<<m_videoList.size()<<" video files in "<<fs::path(m_options.root)<<" directory\n";
+    message(msg.str());
+
+    return processVideos(m_videoList);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Combined mode: one traversal feeding the exact, image and video analyzers.
+
+/**
+ * @brief Routes a file to every analyzer it applies to.
+ *
+ * Images are not decoded here (imgReport does a full imread just to validate),
+ * undecodable images are dropped later when their hash comes out as 0.
+ */
+int ScanContext::allReport(const fs::path& path_name, PathId dirId) {
+    //The same path id is shared by all lists the file ends up in.
+    PathId fileId = PathStore::npos;
+    dedupReport(path_name, dirId, fileId);
+
+    if(is_image_file(path_name.native())){
+        m_imageList.emplace_back(intern(path_name, dirId, fileId));
+    }
+    else if(is_video_file(path_name.native())){
+        addVideo(path_name, dirId, fileId, m_videoList);
+    }
+    return 0;
+}
+
+int ScanContext::findAll() {
+    m_metrics.reset("all");
+    m_tracer.reset();
+    if (!walk([this](const fs::path& p, PathId dir) { return allReport(p, dir); })) {
+        return -1;
+    }
+
+    int groups=0;
+
+    message("\n=== Exact duplicates ===\n");
+    //Images which make it to the hash stage get their perceptual hash from the same read.
+    std::unordered_map<PathId, uint64_t> knownImageHashes;
+    if(!m_fileList.empty() && filterDuplicates(m_fileList, &knownImageHashes)!=0){
+        groups+=reportDuplicateGroups(m_fileList);
+    }
+
+    message("\n=== Similar images ===\n");
+    if(!m_imageList.empty()){
+        groups+=processImages(m_imageList, &knownImageHashes);
+    }
+
+    message("\n=== Similar videos ===\n");
+    if(!m_videoList.empty()){
+        std::ostringstream msg;
+        msg<<"Found "<<m_videoList.size()<<" video files in "<<fs::path(m_options.root)<<" directory\n";
+        message(msg.str());
+        groups+=processVideos(m_videoList);
+    }
+
+    return groups;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Writing a DuplicateIndex for later queries.
+
+int ScanContext::writeIndex(const std::string& indexFile) {
+    m_metrics.reset("index");
+    m_tracer.reset();
+    if (!walk([this](const fs::path& p, PathId dir) { PathId id = PathStore::npos; return dedupReport(p, dir, id); })) {
+        return -1;
+    }
+
+    //See writeShard: the paths are made absolute against a working directory taken once, here.
+    std::error_code ec;
+    const fs::path cwd = fs::current_path(ec);
+    if (ec) {
+        message("Cannot get the working directory: " + ec.message() + "\n");
+        return -1;
+    }
+    std::vector<DuplicateIndex::Entry> entries;
+    const std::size_t kept = fillRecords<DuplicateIndex::Entry>(Metrics::Stage::Hash, entries,
+        [&](FileInfo& file, DuplicateIndex::Entry& entry, Metrics::Counters& counted) {
+            const std::string path = m_paths.string(file.getPathId());
+            Tracer::Scope scope(&m_tracer, "hash", "io", path);
+            counted.filesOpened++;
+            if (!Checksum::computeDigest(path, entry.digest.data())) return false;
+            counted.bytesRead += file.getSize();
+            entry.size = file.getSize();
+            //Absolute, so queries from any working directory can compare paths.
+            entry.path = (cwd / path).lexically_normal().string();
+            return true;
+        });
+
+    if (!DuplicateIndex::write(indexFile, entries)) {
+        message("Cannot write the index to " + indexFile + "\n");
+        return -1;
+    }
+    std::ostringstream msg;
+    msg << "Indexed " << kept << " files in " << indexFile << "\n";
+    message(msg.str());
+    return (int)kept;
+}
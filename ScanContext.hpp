@@ -0,0 +1,246 @@
+#ifndef SCANCONTEXT_HPP
+#define SCANCONTEXT_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BKTree.hpp"
+#include "FileInfo.hpp"
+#include "FileTree.hpp"
+#include "Metrics.hpp"
+#include "PathFilter.hpp"
+#include "PathStore.hpp"
+#include "ScanOptions.hpp"
+#include "ScanResult.hpp"
+#include "ThreadPool.hpp"
+#include "Tracer.hpp"
+
+/**
+ * @class ScanContext
+ * @brief The duplicate detection engine.
+ *
+ * A ScanContext owns everything a scan needs: its options, the compiled
+ * filter, the file tables and a thread pool. Nothing is global, so several
+ * contexts can scan in parallel within one process. Results are handed to
+ * the group callback and progress to the message callback; the context never
+ * prints on its own.
+ *
+ * A single context runs one scan at a time.
+ */
+class ScanContext {
+public:
+    /**
+     * @brief Creates a context and starts its thread pool.
+     * @param options Options for all scans run by this context.
+     */
+    explicit ScanContext(const ScanOptions& options);
+
+    /**
+     * @brief Sets the function receiving each finalized group.
+     */
+    void setGroupCallback(GroupCallback callback) { m_onGroup = std::move(callback); }
+
+    /**
+     * @brief Sets the function receiving progress messages.
+     */
+    void setMessageCallback(MessageCallback callback) { m_onMessage = std::move(callback); }
+
+    const ScanOptions& getOptions() const { return m_options; }
+
+    /**
+     * @brief Per-stage counters of the last scan.
+     *
+     * Times are only filled in when ScanOptions::collectMetrics is set.
+     */
+    const Metrics& getMetrics() const { return m_metrics; }
+
+    /**
+     * @brief Events of the last scan, empty unless ScanOptions::collectTrace is set.
+     */
+    const Tracer& getTracer() const { return m_tracer; }
+
+    /**
+     * @brief Finds files with identical content (size, first bytes, then BLAKE3).
+     *
+     * With ScanOptions::timeBudgetSec or byteBudget set the scan is an anytime
+     * scan: the most rewarding candidates are hashed first, groups are reported
+     * as soon as they are confirmed and the candidates left when the budget runs
+     * out are listed as unverified.
+     *
+     * With ScanOptions::directoryGroups set, identical directory trees are
+     * reported first, as directory groups (see reportDirectoryGroups).
+     * @return Number of groups reported, -1 if the root couldn't be walked.
+     */
+    int findExactDuplicates();
+
+    /**
+     * @brief Finds perceptually similar images.
+     * @return Number of groups reported, -1 if the root couldn't be walked.
+     */
+    int findSimilarImages();
+
+    /**
+     * @brief Finds videos of the same duration with similar sampled frames.
+     * @return Number of groups reported, -1 if the root couldn't be walked.
+     */
+    int findSimilarVideos();
+
+    /**
+     * @brief Runs all three searches from a single traversal.
+     *
+     * Images reaching the BLAKE3 stage are read only once for both hashes.
+     * @return Number of groups reported, -1 if the root couldn't be walked.
+     */
+    int findAll();
+
+    /**
+     * @brief Finds files under the root (the target) which also exist under a reference root.
+     *
+     * Only groups with both target and reference files are reported, reference
+     * files first. The filters are one-sided: a reference file is only recorded
+     * if a target file has its size, and only hashed if a target file also has
+     * its first bytes. Nothing is reported for duplicates within one side.
+     * The roots are expected not to overlap.
+     * @return Number of groups reported, -1 if a root couldn't be walked.
+     */
+    int findCrossTreeDuplicates();
+
+    /**
+     * @brief Finds pairs of files sharing much of their content, such as appended logs.
+     *
+     * Every file is split into content-defined chunks (Chunker) whose digests
+     * go into one ChunkIndex. Pairs sharing at least chunkMinShared of the
+     * larger file are reported as chunk groups, most similar first, followed by
+     * what a chunk-level dedup of all files would reclaim. Chunks found in more
+     * than 64 files (runs of zeros, boilerplate) count for the reclaimable total
+     * but not for the pairs, which would grow quadratically with them.
+     * @return Number of pairs reported, -1 if the root couldn't be walked.
+     */
+    int findChunkDuplicates();
+
+    /**
+     * @brief Estimates the duplicate bytes under the root from a sample of the size buckets.
+     *
+     * The tree is walked (metadata only) and the sizes shared by several files
+     * form the candidate buckets. Each bucket is drawn independently with a
+     * probability proportional to the bytes it could waste at most, scaled so
+     * that about ScanOptions::sampleFraction of the candidate bytes is read.
+     * Only the drawn buckets go through the prefix and hash stages. The total is
+     * a ratio estimate (the wasted share of the sample times the known maximum)
+     * with a 95% normal confidence interval, reported through the message
+     * callback; no groups are reported.
+     * @return Number of buckets sampled, -1 if the root couldn't be walked.
+     */
+    int estimateDuplicates();
+
+    /**
+     * @brief Hashes every file of at least minDedupSize and writes them to a DuplicateIndex file.
+     *
+     * Unlike the searches, nothing is skipped for having a unique size: a later
+     * query must never need to hash an indexed file.
+     * @return Number of files indexed, -1 if the root couldn't be walked or the index written.
+     */
+    int writeIndex(const std::string& indexFile);
+
+    /**
+     * @brief Writes the partial result of this shard (the root) as a ShardFile.
+     *
+     * Every file gets its size and prefix fingerprint. Files sharing both with
+     * another file of the shard are hashed right away, since any merge needs
+     * their digests; the others are left to the work list of the merge.
+     * @param name Shard owner recorded in the file, see ShardFile::name.
+     * @return Number of records written, -1 if the root couldn't be walked or the shard written.
+     */
+    int writeShard(const std::string& shardFile, const std::string& name);
+
+    /**
+     * @brief Hashes the files a merge listed for this shard and rewrites the shard file.
+     *
+     * Work list lines are "<shard name>\t<path>"; lines for other shards are ignored.
+     * @return Number of files hashed, -1 if the shard or the work list couldn't be read or written.
+     */
+    int completeShard(const std::string& shardFile, const std::string& workList);
+
+private:
+    ScanOptions m_options;
+    PathFilter m_filter;
+    ThreadPool m_pool;
+    GroupCallback m_onGroup;
+    MessageCallback m_onMessage;
+    Metrics m_metrics;
+    Tracer m_tracer;
+
+    PathStore m_paths;                  // Paths of everything walked; the lists below only keep ids.
+    std::vector<FileInfo> m_fileList;   // Exact duplicate candidates.
+    std::vector<FileInfo> m_imageList;
+    std::vector<FileInfo> m_videoList;
+
+    void message(const std::string& text) const;
+    //The paths of the files of list marked for removal, one per line; Checksum doesn't print the files it can't read.
+    std::string markedPaths(const std::vector<FileInfo>& list) const;
+    void clear();
+
+    /**
+     * @brief Walks the root, calling report for each accepted file.
+     * @param skipped If set, receives the directory of every entry the walk leaves out.
+     * @return true if the root was a directory and was walked.
+     */
+    bool walk(const FileTree::ReportFcnType& report, const FileTree::SkipFcnType& skipped = nullptr);
+    //Walks one more root into the same tables, without clearing them.
+    bool walkRoot(const std::string& root, const FileTree::ReportFcnType& report,
+                  const FileTree::SkipFcnType& skipped = nullptr);
+    PathId intern(const std::filesystem::path& path, PathId dirId, PathId& fileId);
+
+    // The report functions add the file to the store (once, through fileId) only if they keep it.
+    int dedupReport(const std::filesystem::path& path, PathId dirId, PathId& fileId);
+    int imgReport(const std::filesystem::path& path, PathId dirId, PathId& fileId);
+    int vidReport(const std::filesystem::path& path, PathId dirId, PathId& fileId);
+    int allReport(const std::filesystem::path& path, PathId dirId);
+    int addVideo(const std::filesystem::path& path, PathId dirId, PathId& fileId, std::vector<FileInfo>& list);
+
+    std::size_t prefilterDuplicates(std::vector<FileInfo>& list, bool crossTree,
+                                    std::uint64_t deadlineNs = UINT64_MAX, std::vector<FileInfo>* unread = nullptr);
+    std::size_t filterDuplicates(std::vector<FileInfo>& list,
+                                 std::unordered_map<PathId, uint64_t>* imageHashes,
+                                 bool crossTree = false);
+    std::size_t filterSmallDuplicates(std::vector<FileInfo>& list, std::uint64_t deadlineNs = UINT64_MAX,
+                                      std::uint64_t* bytesLeft = nullptr, std::vector<FileInfo>* unread = nullptr);
+    int reportDuplicateGroups(std::vector<FileInfo>& list, const std::vector<char>* collapsed = nullptr);
+    int findDuplicateTrees();
+    int reportDirectoryGroups(const std::vector<FileInfo>& duplicates, const std::vector<PathId>& walkedFiles,
+                              const std::vector<PathId>& partialDirs, std::vector<char>& inDuplicateTree);
+    bool reportGroup(std::vector<FileInfo>& list, std::size_t beg, std::size_t end, DuplicateGroup& group);
+    int hashWithinBudget(std::vector<FileInfo>& list, std::uint64_t deadlineNs, std::uint64_t bytesLeft,
+                         const std::vector<FileInfo>& unread);
+
+    /**
+     * @brief Fills one record per entry of m_fileList in parallel, timed and traced as stage.
+     *
+     * fill returns false to drop the record of a file it couldn't read. The kept records
+     * are moved to the front of records in file list order and the rest are erased.
+     * @return Number of records kept.
+     */
+    template<class Record>
+    std::size_t fillRecords(Metrics::Stage stage, std::vector<Record>& records,
+                            const std::function<bool(FileInfo&, Record&, Metrics::Counters&)>& fill);
+    int processImages(std::vector<FileInfo>& list,
+                      const std::unordered_map<PathId, uint64_t>* known);
+    std::size_t hashImages(std::vector<FileInfo>& list, ScanOptions::ImageHash kind,
+                           const std::unordered_map<PathId, uint64_t>* known, bool thumbnails);
+    std::size_t prefilterImages(std::vector<FileInfo>& list, ScanOptions::ImageHash kind,
+                                const std::unordered_map<PathId, uint64_t>* known,
+                                std::vector<std::size_t>& offsets, std::vector<PathId>& ids);
+    int reportImageNeighbours(std::vector<FileInfo>& list, const std::vector<std::size_t>& offsets,
+                              const std::vector<PathId>& ids);
+    void reportSimilarGroup(DuplicateGroup& group);
+    int processVideos(std::vector<FileInfo>& list);
+    int reportSimilarGroups(const std::vector<FileInfo>& list, const BKTree& tree, DuplicateGroup::Kind kind);
+    void queryNeighbours(const std::vector<FileInfo>& list, const BKTree& tree, int threshold,
+                         std::vector<std::size_t>& offsets, std::vector<PathId>& ids);
+};
+
+#endif // SCANCONTEXT_HPP
@@ -0,0 +1,60 @@
+#ifndef SCANOPTIONS_HPP
+#define SCANOPTIONS_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "PathFilter.hpp"
+
+/**
+ * @struct ScanOptions
+ * @brief Everything a ScanContext needs to know before it starts.
+ *
+ * Filled in by the frontend (main.cpp) from the command line, or directly by
+ * code embedding the engine.
+ */
+struct ScanOptions {
+    /// Perceptual image hashes, from the cheapest to the most exact.
+    enum class ImageHash {
+        None,           // No hash: only as imagePrefilter, to turn the prefilter off.
+        AHash,          // 8x8 average hash from a reduced decode.
+        DHash,          // 9x8 difference hash from a reduced decode.
+        PHash,          // 64 bit DCT hash, the default.
+        PHash256        // 256 bit DCT hash, compared only between images the prefilter finds near each other.
+    };
+
+    /// How the exact search hashes the candidates left after the first bytes stage.
+    enum class HashMode {
+        Blake3,         // BLAKE3 over every candidate.
+        Tiered,         // FastHash over every candidate, BLAKE3 only where fast hashes match.
+        Fast            // FastHash only; its groups are reported but never acted on.
+    };
+
+    std::string root;                   // Directory to scan.
+    std::vector<std::string> referenceRoots;  // Trees the root is compared against by the cross-tree search.
+    bool followSymlinks = false;        // Whether to follow symbolic links during traversal.
+    FilterRules filterRules;            // Include/exclude rules, compiled once per scan.
+    unsigned threads = 0;               // Threads used for the per-file stages, 0 = hardware concurrency.
+    std::uintmax_t minDedupSize = 1024; // Files below this size are ignored by the duplicate searches.
+    HashMode hashMode = HashMode::Blake3;
+    std::uintmax_t smallFileSize = 4096;  // Exact search: files up to this size are read whole once, skipping the first bytes stage.
+    bool directoryGroups = false;       // Exact search: also report identical directory trees (Merkle hashes).
+    bool collapseDirectories = false;   // With directoryGroups: leave out file groups inside duplicated trees.
+    double timeBudgetSec = 0;           // Exact search only: stop hashing after this many seconds, 0 = no limit.
+    std::uint64_t byteBudget = 0;       // Exact search only: hash at most this many bytes, 0 = no limit.
+    double sampleFraction = 0.05;       // Estimate: expected share of the candidate bytes which is read.
+    std::uint64_t sampleSeed = 1;       // Estimate: seed of the bucket sampling, the same seed gives the same sample.
+    std::size_t chunkSize = 8192;       // Chunk search: average content-defined chunk size.
+    double chunkMinShared = 0.5;        // Chunk search: report pairs sharing at least this share of the larger file.
+    int imageThreshold = 10;            // Maximum hamming distance for two images/videos to be similar (x4 for PHash256).
+    ImageHash imagePrefilter = ImageHash::None;  // Image search: cheap hash run first, only images near another go on.
+    ImageHash imageHash = ImageHash::PHash;      // Image search: the hash images are grouped by.
+    bool exifThumbnails = false;        // Image search: the prefilter hashes the EXIF thumbnail of JPEG files when they have one.
+    int videoFrames = 10;               // Video search: frames sampled per video.
+    int videoSegmentSeconds = 600;      // Video search: longer videos are sampled in parallel segments of about this length, 0 = never.
+    int prefilterThreshold = 16;        // Hamming distance within which the prefilter keeps images.
+    bool collectMetrics = false;        // Time every stage; the file and byte counts are always kept.
+    bool collectTrace = false;          // Record per-file and per-stage events for a timeline.
+};
+
+#endif // SCANOPTIONS_HPP
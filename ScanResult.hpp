@@ -0,0 +1,44 @@
+#ifndef SCANRESULT_HPP
+#define SCANRESULT_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @struct DuplicateGroup
+ * @brief One group of files found by a scan.
+ *
+ * For exact duplicates all files share size and BLAKE3 hash, for images and
+ * videos the files are within the similarity threshold of each other. Chunk
+ * groups are pairs of files sharing content-defined chunks. Directory groups
+ * list directories whose whole trees are identical; size is the bytes of one tree.
+ */
+struct DuplicateGroup {
+    enum class Kind { Exact, Image, Video, Chunk, Directory };
+
+    Kind kind = Kind::Exact;
+    std::uintmax_t size = 0;                        // Size of each file, only meaningful for exact groups.
+    std::string hash;                               // BLAKE3 (or, unconfirmed, FastHash) hex hash, only set for exact groups.
+    std::uintmax_t wastedBytes = 0;                 // Bytes freed by keeping only one file (the largest for similar groups),
+                                                    // the bytes the two files share for chunk groups.
+    double similarity = 0;                          // Chunk groups: shared bytes / size of the larger file.
+    std::vector<std::filesystem::path> files;
+    std::vector<std::int64_t> mtimes;               // Modification time (ns) of each file when it was sized, exact groups only.
+    std::size_t references = 0;                     // Cross-tree groups: the first files, under a reference root and never changed.
+    bool confirmed = true;                          // Exact groups: false if only the fast hash matched (--hash fast).
+};
+
+/**
+ * @brief Called once for every group as soon as the scan has finalized it.
+ */
+using GroupCallback = std::function<void(const DuplicateGroup&)>;
+
+/**
+ * @brief Called with human readable progress messages ("Removed N files with unique sizes.").
+ */
+using MessageCallback = std::function<void(const std::string&)>;
+
+#endif // SCANRESULT_HPP
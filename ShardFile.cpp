@@ -0,0 +1,122 @@
+#include "ShardFile.hpp"
+#include "BufferedWriter.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+static const char kMagic[8] = {'D', 'D', 'U', 'P', 'S', 'H', 'D', '1'};
+
+bool ShardFile::write(const std::string& file) const {
+    BufferedWriter out(file);
+    if (!out.ok()) {
+        return false;
+    }
+    out.write(kMagic, sizeof(kMagic));
+    out.writeLE(name.size(), 4);
+    out.write(name);
+    out.writeLE(records.size(), 8);
+    for (const auto& r : records) {
+        out.writeLE(r.size, 8);
+        out.writeLE((std::uint64_t)r.mtime, 8);
+        out.writeLE(r.prefix, 8);
+        out.writeLE(r.hasDigest ? 1 : 0, 1);
+        if (r.hasDigest) {
+            out.write(r.digest.data(), r.digest.size());
+        }
+        out.writeLE(r.path.size(), 4);
+        out.write(r.path);
+    }
+    return out.flush();
+}
+
+namespace {
+
+//Bounds checked little endian reader over the whole file.
+class Reader {
+public:
+    explicit Reader(const std::vector<char>& data) : m_data(data) {}
+
+    bool ok() const { return m_ok; }
+    bool atEnd() const { return m_pos == m_data.size(); }
+
+    std::uint64_t le(int bytes) {
+        if (!take(bytes)) return 0;
+        std::uint64_t value = 0;
+        for (int i = bytes - 1; i >= 0; --i) {
+            value = (value << 8) | (unsigned char)m_data[m_pos - bytes + i];
+        }
+        return value;
+    }
+
+    const char* bytes(std::size_t size) {
+        return take(size) ? m_data.data() + m_pos - size : nullptr;
+    }
+
+private:
+    const std::vector<char>& m_data;
+    std::size_t m_pos = 0;
+    bool m_ok = true;
+
+    bool take(std::size_t size) {
+        if (!m_ok || m_data.size() - m_pos < size) {
+            m_ok = false;
+            return false;
+        }
+        m_pos += size;
+        return true;
+    }
+};
+
+}
+
+bool ShardFile::read(const std::string& file, std::string& error) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        error = std::strerror(errno);
+        return false;
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    Reader r(data);
+    const char* magic = r.bytes(sizeof(kMagic));
+    if (!magic || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+        error = "not a shard file";
+        return false;
+    }
+    std::size_t nameSize = r.le(4);
+    const char* nameBytes = r.bytes(nameSize);
+    std::uint64_t count = r.le(8);
+    if (!r.ok()) {
+        error = "truncated shard file";
+        return false;
+    }
+    name.assign(nameBytes, nameSize);
+    records.clear();
+    //Every record takes at least 29 bytes, a corrupt count mustn't reserve more than the file can hold.
+    records.reserve(std::min<std::uint64_t>(count, data.size() / 29));
+    for (std::uint64_t i = 0; i < count && r.ok(); ++i) {
+        Record rec;
+        rec.size = r.le(8);
+        rec.mtime = (std::int64_t)r.le(8);
+        rec.prefix = r.le(8);
+        rec.hasDigest = (r.le(1) & 1) != 0;
+        if (rec.hasDigest) {
+            const char* digest = r.bytes(rec.digest.size());
+            if (digest) std::memcpy(rec.digest.data(), digest, rec.digest.size());
+        }
+        std::size_t pathSize = r.le(4);
+        const char* path = r.bytes(pathSize);
+        if (path) rec.path.assign(path, pathSize);
+        records.push_back(std::move(rec));
+    }
+    if (!r.ok() || !r.atEnd()) {
+        records.clear();
+        error = "truncated or corrupt shard file";
+        return false;
+    }
+    return true;
+}
+
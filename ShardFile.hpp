@@ -0,0 +1,56 @@
+#ifndef SHARDFILE_HPP
+#define SHARDFILE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Checksum.hpp"
+
+/**
+ * @class ShardFile
+ * @brief Partial exact-duplicate scan of one shard of a volume, mergeable with the other shards.
+ *
+ * Every file of at least minDedupSize gets a record with its size, a
+ * fingerprint of its first bytes and, when it was worth computing, its BLAKE3
+ * digest. Digests are only computed where a group is already certain to need
+ * them; merging the shards tells which of the remaining files must be hashed.
+ *
+ * Format, all integers little endian so shards can be moved between hosts:
+ * - header: the 8 bytes "DDUPSHD1", u32 name length and the name, u64 record count
+ * - per record: u64 size, i64 mtime (ns), u64 prefix fingerprint, u8 flags
+ *   (1 = digest present), the 32 digest bytes if present, u32 path length and the path bytes
+ */
+class ShardFile {
+public:
+    using Digest = std::array<std::uint8_t, Checksum::DigestSize>;
+
+    struct Record {
+        std::string path;               // Absolute path on the host which scanned the shard.
+        std::uint64_t size = 0;
+        std::int64_t mtime = 0;
+        std::uint64_t prefix = 0;       // FileInfo::getPrefix(), see Checksum::fingerprint.
+        bool hasDigest = false;
+        Digest digest{};
+    };
+
+    std::string name;                   // Shard owner, the host name by default. Work lists are addressed by it.
+    std::vector<Record> records;
+
+    /**
+     * @brief Writes the shard.
+     * @return false if the file couldn't be written.
+     */
+    bool write(const std::string& file) const;
+
+    /**
+     * @brief Reads a shard written by write(), replacing name and records.
+     * @param error Receives the reason on failure.
+     * @return false if the file can't be read or isn't a valid shard.
+     */
+    bool read(const std::string& file, std::string& error);
+};
+
+#endif // SHARDFILE_HPP
@@ -0,0 +1,73 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 1;
+    }
+    for (unsigned i = 1; i < threads; ++i) {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+//Takes indices from the shared counter until the job is exhausted.
+void ThreadPool::runJob() {
+    for (std::size_t i = m_next.fetch_add(1); i < m_count; i = m_next.fetch_add(1)) {
+        (*m_job)(i);
+    }
+}
+
+void ThreadPool::workerLoop() {
+    std::uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+        if (m_stop) return;
+        seen = m_generation;
+
+        lock.unlock();
+        runJob();
+        lock.lock();
+
+        if (--m_busy == 0) {
+            m_done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(std::size_t count, const std::function<void(std::size_t)>& fn) {
+    if (count == 0) return;
+
+    //Not worth waking anyone up.
+    if (m_workers.empty() || count == 1) {
+        for (std::size_t i = 0; i < count; ++i) fn(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = &fn;
+        m_count = count;
+        m_next = 0;
+        m_busy = m_workers.size();
+        ++m_generation;
+    }
+    m_wake.notify_all();
+
+    runJob();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [&] { return m_busy == 0; });
+    m_job = nullptr;
+}
@@ -0,0 +1,66 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief A fixed set of worker threads used to run the per-file stages in parallel.
+ *
+ * Work is handed out one index at a time from a shared counter, so a few very
+ * large files don't leave the other threads idle. The calling thread takes part
+ * in the work too, hence a pool of size n starts n-1 threads.
+ *
+ * A pool runs one parallelFor at a time and must not be used from inside its own jobs.
+ */
+class ThreadPool {
+public:
+    /**
+     * @brief Starts the workers.
+     * @param threads Total number of threads including the caller. 0 picks the hardware concurrency.
+     */
+    explicit ThreadPool(unsigned threads = 0);
+
+    /**
+     * @brief Stops and joins all workers.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Calls fn(i) for every i in [0, count) and returns once all calls finished.
+     * @param count Number of work items.
+     * @param fn Function to run for each index. It must not throw.
+     */
+    void parallelFor(std::size_t count, const std::function<void(std::size_t)>& fn);
+
+    /**
+     * @brief Returns the number of threads taking part in parallelFor.
+     */
+    unsigned size() const { return (unsigned)m_workers.size() + 1; }
+
+private:
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;     // Signals workers that a new job is available.
+    std::condition_variable m_done;     // Signals the caller that all workers are finished.
+    const std::function<void(std::size_t)>* m_job = nullptr;
+    std::atomic<std::size_t> m_next{0};
+    std::size_t m_count = 0;
+    std::size_t m_busy = 0;             // Workers which haven't finished the current job.
+    std::uint64_t m_generation = 0;     // Incremented for every job so workers don't run one twice.
+    bool m_stop = false;
+
+    void workerLoop();
+    void runJob();
+};
+
+#endif // THREADPOOL_HPP
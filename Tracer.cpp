@@ -0,0 +1,96 @@
+#include "Tracer.hpp"
+
+#include <atomic>
+#include <cstdio>
+
+//Same scheme as the metrics: a thread keeps a pointer to its buffer for the tracer it last recorded to.
+struct TracerBufferCache {
+    std::uint64_t owner = 0;
+    void* buffer = nullptr;
+};
+static thread_local TracerBufferCache t_bufferCache;
+static std::atomic<std::uint64_t> g_nextTracerId{1};
+
+//Escapes a string for use inside a JSON string literal.
+static void writeEscaped(std::ostream& out, std::string_view text) {
+    for (char ch : text) {
+        unsigned char c = (unsigned char)ch;
+        if (c == '"' || c == '\\') {
+            out << '\\' << ch;
+        } else if (c < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out << buf;
+        } else {
+            out << ch;
+        }
+    }
+}
+
+Tracer::Tracer() : m_id(g_nextTracerId++) {}
+
+void Tracer::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& buffer : m_buffers) {
+        buffer->events.clear();
+    }
+    m_driver = std::this_thread::get_id();
+    m_startNs = Metrics::nowNs();
+}
+
+Tracer::ThreadBuffer& Tracer::local() {
+    if (t_bufferCache.owner != m_id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const std::thread::id self = std::this_thread::get_id();
+        ThreadBuffer* found = nullptr;
+        for (auto& buffer : m_buffers) {
+            if (buffer->thread == self) {
+                found = buffer.get();
+                break;
+            }
+        }
+        if (!found) {
+            m_buffers.push_back(std::make_unique<ThreadBuffer>());
+            found = m_buffers.back().get();
+            found->thread = self;
+            found->tid = (int)m_buffers.size();
+            found->events.reserve(1024);
+        }
+        t_bufferCache.owner = m_id;
+        t_bufferCache.buffer = found;
+    }
+    return *static_cast<ThreadBuffer*>(t_bufferCache.buffer);
+}
+
+void Tracer::record(const char* name, const char* category, std::uint64_t startNs, std::uint64_t endNs,
+                    std::string_view detail) {
+    local().events.push_back(Event{name, category, startNs, endNs - startNs, std::string(detail)});
+}
+
+void Tracer::writeJson(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    char number[32];
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& buffer : m_buffers) {
+        out << (first ? "" : ",\n")
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+            << ",\"args\":{\"name\":\"" << (buffer->thread == m_driver ? "scan" : "worker") << "\"}}";
+        first = false;
+        for (const auto& e : buffer->events) {
+            //Timestamps are microseconds since the scan started.
+            out << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"" << e.category << "\",\"ph\":\"X\"";
+            std::snprintf(number, sizeof(number), "%.3f", (e.startNs - m_startNs) / 1e3);
+            out << ",\"ts\":" << number;
+            std::snprintf(number, sizeof(number), "%.3f", e.durationNs / 1e3);
+            out << ",\"dur\":" << number << ",\"pid\":1,\"tid\":" << buffer->tid;
+            if (!e.detail.empty()) {
+                out << ",\"args\":{\"path\":\"";
+                writeEscaped(out, e.detail);
+                out << "\"}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+}
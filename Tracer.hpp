@@ -0,0 +1,115 @@
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "Metrics.hpp"
+
+/**
+ * @class Tracer
+ * @brief Records timed events of a scan for the Chrome trace viewer / Perfetto.
+ *
+ * Each thread appends to its own event buffer, so recording never takes a lock
+ * once the thread has registered. The buffers are written out as Chrome trace
+ * event JSON after the scan.
+ *
+ * When tracing is disabled a Scope costs one branch.
+ */
+class Tracer {
+public:
+    Tracer();
+
+    void setEnabled(bool enabled) { m_enabled = enabled; }
+    bool isEnabled() const { return m_enabled; }
+
+    /**
+     * @brief Drops all recorded events, called at the start of each scan.
+     */
+    void reset();
+
+    /**
+     * @brief Adds a complete event to the calling thread's buffer.
+     * @param name Event name, must be a string literal.
+     * @param category Event category, must be a string literal.
+     * @param detail Shown as the "path" argument of the event, may be empty.
+     */
+    void record(const char* name, const char* category, std::uint64_t startNs, std::uint64_t endNs,
+                std::string_view detail);
+
+    /**
+     * @brief Writes all recorded events as a Chrome trace JSON object.
+     *
+     * Must not be called while a scan is running.
+     */
+    void writeJson(std::ostream& out) const;
+
+    /**
+     * @class Scope
+     * @brief Records the enclosing block as one event.
+     *
+     * detail is not copied until the block ends, it has to outlive the Scope.
+     * A null tracer is allowed and records nothing.
+     */
+    class Scope {
+    public:
+        Scope(Tracer* tracer, const char* name, const char* category, std::string_view detail = {})
+            : m_tracer((tracer && tracer->m_enabled) ? tracer : nullptr)
+        {
+            if (m_tracer) {
+                m_name = name;
+                m_category = category;
+                m_detail = detail;
+                m_startNs = Metrics::nowNs();
+            }
+        }
+
+        ~Scope() {
+            if (m_tracer) {
+                m_tracer->record(m_name, m_category, m_startNs, Metrics::nowNs(), m_detail);
+            }
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Tracer* m_tracer;
+        const char* m_name = nullptr;
+        const char* m_category = nullptr;
+        std::string_view m_detail;
+        std::uint64_t m_startNs = 0;
+    };
+
+private:
+    struct Event {
+        const char* name;
+        const char* category;
+        std::uint64_t startNs;
+        std::uint64_t durationNs;
+        std::string detail;
+    };
+
+    struct ThreadBuffer {
+        std::thread::id thread;
+        int tid = 0;                    // Small id shown by the viewer.
+        std::vector<Event> events;
+    };
+
+    ThreadBuffer& local();
+
+    const std::uint64_t m_id;           // Distinguishes instances in the thread local cache.
+    bool m_enabled = false;
+    std::uint64_t m_startNs = 0;
+    std::thread::id m_driver;           // Thread which called reset.
+    mutable std::mutex m_mutex;         // Guards m_buffers when a new thread registers.
+    std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+};
+
+#endif // TRACER_HPP
@@ -1,5 +1,4 @@
 #include <algorithm> 
-#include <cstring> //used for memcmp
 #include <iostream>
 #include <unordered_set>
 
@@ -27,9 +26,11 @@ bool cmpSize(const FileInfo& a, const FileInfo& b){
   return a.getSize() < b.getSize();
 }
 
-//Lexicographical comparator on raw binary content.
+//Orders by size, then by the fingerprint of the first bytes; equal first bytes alone
+//don't make files of different sizes candidates.
 bool cmpBuffers(const FileInfo& a, const FileInfo& b){
-  return std::memcmp(a.getbyteptr(), b.getbyteptr(), a.getBufferSize()) < 0;
+  if(a.getSize()!=b.getSize()) return a.getSize()<b.getSize();
+  return a.getPrefix()<b.getPrefix();
 }
 
 //Lexicographical comparator on the blake3 hashes of the files.
@@ -37,6 +38,12 @@ bool cmpHash(const FileInfo &a, const FileInfo &b){
     return a.getBlake3()<b.getBlake3();
 }
 
+//Orders by size, then by the fast hash; a fast hash alone may collide across sizes.
+bool cmpFastHash(const FileInfo &a, const FileInfo &b){
+    if(a.getSize()!=b.getSize()) return a.getSize()<b.getSize();
+    return a.getFastHash()<b.getFastHash();
+}
+
 //Sort all the functions in the given list according to size.
 void Utility::sortFilesBySize(){
     std::sort(m_list.begin(), m_list.end(), cmpSize);
@@ -49,6 +56,26 @@ auto handle_size_group = [](auto first, auto last) {
     } 
 };
 
+//Cross-tree variant: a group without a file from each side has no match to report.
+auto handle_cross_group = [](auto first, auto last) {
+    bool reference = false, target = false;
+    for (auto it = first; it != last; ++it) {
+        (it->isReference() ? reference : target) = true;
+    }
+    if (!reference || !target) {
+        for (auto it = first; it != last; ++it) it->setRemoveUniqueFlag(true);
+    }
+};
+
+template <typename Comparator>
+void Utility::markGroups(Comparator comp) {
+    if (m_crossTree) {
+        apply_on_range(m_list.begin(), m_list.end(), comp, handle_cross_group);
+    } else {
+        apply_on_range(m_list.begin(), m_list.end(), comp, handle_size_group);
+    }
+}
+
 /// Remove all entries marked for removal
 std::size_t Utility::cleanup() {
     const auto old_size = m_list.size();
@@ -68,7 +95,7 @@ std::size_t Utility::removeUniqueSizes() {
     std::sort(m_list.begin(), m_list.end(), cmpSize);
 
     // Step 2: Apply removal marking logic to the groups.
-    apply_on_range(m_list.begin(), m_list.end(), cmpSize, handle_size_group);
+    markGroups(cmpSize);
 
     // Step 3: Remove marked files
     return cleanup();
@@ -81,7 +108,7 @@ std::size_t Utility::removeUniqueBuffer() {
     std::sort(m_list.begin(), m_list.end(), cmpBuffers);
 
     // Step 2: Apply removal marking logic to the groups.
-    apply_on_range(m_list.begin(), m_list.end(), cmpBuffers, handle_size_group);
+    markGroups(cmpBuffers);
 
     // Step 3: Remove marked files
     return cleanup();
@@ -93,12 +120,20 @@ std::size_t Utility::removeUniqueHashes(){
     std::sort(m_list.begin(), m_list.end(), cmpHash);
 
     // Step 2: Apply removal marking logic to the groups.
-    apply_on_range(m_list.begin(), m_list.end(), cmpHash, handle_size_group);
+    markGroups(cmpHash);
 
     // Step 3: Remove marked files
     return cleanup();
 }
 
+std::size_t Utility::removeUniqueFastHashes(){
+    std::sort(m_list.begin(), m_list.end(), cmpFastHash);
+
+    markGroups(cmpFastHash);
+
+    return cleanup();
+}
+
 std::size_t Utility::removeUniqueDuration(){
     // Step 1: Sort by size
     std::sort(m_list.begin(), m_list.end(), cmpDuration);
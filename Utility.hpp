@@ -22,6 +22,16 @@ public:
     explicit Utility(std::vector<FileInfo>& list)
         : m_list(list) {}
 
+    /**
+     * @brief Constructs a Utility object comparing a target tree against reference trees.
+     *
+     * With crossTree set, the removeUnique functions keep a group only if it has
+     * both a reference file (FileInfo::isReference) and a target file, so files
+     * are never kept for matching others from their own side.
+     */
+    Utility(std::vector<FileInfo>& list, bool crossTree)
+        : m_list(list), m_crossTree(crossTree) {}
+
     /**
      * @brief Removes files that have unique file sizes.
      * 
@@ -40,8 +50,8 @@ public:
     /**
      * @brief Removes files that have unique binary buffers.
      * 
-     * After sorting by buffer content files that do not share
-     * their buffer content with any other file are removed.
+     * After sorting by size and buffer content, files that do not share
+     * both with any other file are removed.
      * 
      * @return The number of files removed.
      */
@@ -56,6 +66,13 @@ public:
      */
     std::size_t removeUniqueHashes();
 
+    /**
+     * @brief Removes files whose size and fast hash (FileInfo::getFastHash) are not shared with any other.
+     *
+     * @return The number of files removed.
+     */
+    std::size_t removeUniqueFastHashes();
+
     /**
      * @brief Sorts the list of files by their size in ascending order.
      * 
@@ -74,6 +91,11 @@ public:
 
 private:
     std::vector<FileInfo>& m_list;
+    bool m_crossTree = false;
+
+    //Marks the files of every group which can't hold a duplicate, see m_crossTree.
+    template <typename Comparator>
+    void markGroups(Comparator comp);
 
     /**
      * @brief Removes all files marked for deletion from the file list.
@@ -0,0 +1,292 @@
+#include "Watcher.hpp"
+#include "Checksum.hpp"
+#include "FileTree.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static constexpr std::uint32_t kWatchMask =
+    IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE | IN_DELETE_SELF | IN_ONLYDIR;
+
+static bool isBelow(const std::string& path, const std::string& dir) {
+    return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 && path[dir.size()] == '/';
+}
+
+Watcher::Watcher(const ScanOptions& options)
+    : m_options(options),
+      m_filter(options.filterRules)
+{}
+
+Watcher::~Watcher() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+void Watcher::message(const std::string& text) const {
+    if (m_onMessage) {
+        m_onMessage(text);
+    }
+}
+
+int Watcher::start() {
+    std::error_code ec;
+    if (!fs::is_directory(m_options.root, ec)) {
+        message("Not a directory: " + m_options.root + "\n");
+        return -1;
+    }
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        message(std::string("Cannot set up inotify: ") + std::strerror(errno) + "\n");
+        return -1;
+    }
+
+    //Index everything first and hash the colliding sizes in one parallel pass.
+    m_indexing = true;
+    std::string root = fs::path(m_options.root).lexically_normal().string();
+    if (root.size() > 1 && root.back() == '/') root.pop_back();
+    addDirectory(root);
+    std::vector<std::string> pending;
+    for (const auto& bucket : m_bySize) {
+        if (bucket.second.size() < 2) continue;
+        pending.insert(pending.end(), bucket.second.begin(), bucket.second.end());
+    }
+    std::vector<std::string> digests(pending.size());
+    ThreadPool pool(m_options.threads);
+    pool.parallelFor(pending.size(), [&](std::size_t i) { digests[i] = Checksum::compute(pending[i]); });
+    for (std::size_t i = 0; i < pending.size(); ++i) {
+        if (!digests[i].empty()) addDigest(pending[i], digests[i]);
+        else message("Cannot hash " + pending[i] + "\n");
+    }
+    m_hashed = pending.size();
+    m_indexing = false;
+
+    std::ostringstream msg;
+    msg << "Watching " << m_dirs.size() << " directories, " << m_files.size() << " files indexed, "
+        << m_hashed << " hashed\n";
+    message(msg.str());
+    return reportAll();
+}
+
+int Watcher::addDirectory(const std::string& dir) {
+    int groups = 0;
+    FileTree walker(false);
+    walker.setFilter(&m_filter);
+    walker.setMessageCallback([this](const std::string& text) { message(text); });
+    //Each directory is watched before it is read, so files created meanwhile show up in one or the other.
+    walker.setDirectoryCallback([this](const fs::path& path, PathId) {
+        int wd = inotify_add_watch(m_fd, path.c_str(), kWatchMask);
+        if (wd < 0) {
+            message("Cannot watch " + path.string() + ": " + std::strerror(errno) + "\n");
+            return false;
+        }
+        m_dirs[wd] = path.string();
+        return true;
+    });
+    walker.setCallback([&](const fs::path& path, PathId) {
+        groups += update(path.string(), nullptr);
+        return 0;
+    });
+    walker.walk(dir);
+    return groups;
+}
+
+void Watcher::removeDirectory(const std::string& dir) {
+    for (auto it = m_dirs.begin(); it != m_dirs.end();) {
+        if (it->second == dir || isBelow(it->second, dir)) {
+            inotify_rm_watch(m_fd, it->first);
+            it = m_dirs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    std::vector<std::string> gone;
+    for (const auto& file : m_files) {
+        if (isBelow(file.first, dir)) gone.push_back(file.first);
+    }
+    for (const auto& path : gone) {
+        remove(path);
+    }
+}
+
+void Watcher::remove(const std::string& path) {
+    auto it = m_files.find(path);
+    if (it == m_files.end()) return;
+
+    auto bucket = m_bySize.find(it->second.size);
+    if (bucket != m_bySize.end()) {
+        bucket->second.erase(path);
+        if (bucket->second.empty()) m_bySize.erase(bucket);
+    }
+    if (!it->second.digest.empty()) {
+        auto same = m_byDigest.find(it->second.digest);
+        if (same != m_byDigest.end()) {
+            same->second.erase(path);
+            if (same->second.empty()) m_byDigest.erase(same);
+        }
+    }
+    m_files.erase(it);
+}
+
+int Watcher::update(const std::string& path, const Entry* known) {
+    remove(path);
+
+    struct stat st;
+    if (::lstat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+    if ((std::uintmax_t)st.st_size < m_options.minDedupSize) return 0;
+    if (!m_filter.acceptFile(fs::directory_entry(path))) return 0;
+
+    Entry entry;
+    entry.size = (std::uintmax_t)st.st_size;
+    entry.mtime = (std::int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    //A file moved within the tree keeps its digest as long as it wasn't written to.
+    const std::string digest = (known && known->size == entry.size && known->mtime == entry.mtime)
+                             ? known->digest : std::string();
+    m_files[path] = entry;
+    m_bySize[entry.size].insert(path);
+
+    if (m_indexing) return 0;
+    //The digest is kept, but other files of the size may still be unhashed.
+    int groups = digest.empty() ? 0 : addDigest(path, digest);
+    return groups + hashBucket(entry.size);
+}
+
+int Watcher::hashBucket(std::uintmax_t size) {
+    auto bucket = m_bySize.find(size);
+    if (bucket == m_bySize.end() || bucket->second.size() < 2) return 0;
+
+    int groups = 0;
+    //addDigest doesn't change the size index, so the bucket can be iterated while hashing.
+    for (const auto& path : bucket->second) {
+        if (!m_files[path].digest.empty()) continue;
+        std::string digest = Checksum::compute(path);
+        m_hashed++;
+        if (!digest.empty()) groups += addDigest(path, digest);
+        else message("Cannot hash " + path + "\n");
+    }
+    return groups;
+}
+
+int Watcher::addDigest(const std::string& path, const std::string& digest) {
+    m_files[path].digest = digest;
+    auto& same = m_byDigest[digest];
+    same.insert(path);
+    if (m_indexing || same.size() < 2) return 0;
+    reportGroup(same, digest);
+    return 1;
+}
+
+void Watcher::reportGroup(const std::unordered_set<std::string>& files, const std::string& digest) {
+    std::vector<std::string> sorted(files.begin(), files.end());
+    std::sort(sorted.begin(), sorted.end());
+
+    DuplicateGroup group;
+    group.kind = DuplicateGroup::Kind::Exact;
+    group.hash = digest;
+    group.size = m_files[sorted.front()].size;
+    group.wastedBytes = group.size * (sorted.size() - 1);
+    for (const auto& path : sorted) {
+        group.files.push_back(path);
+        group.mtimes.push_back(m_files[path].mtime);
+    }
+    if (m_onGroup) m_onGroup(group);
+}
+
+int Watcher::reportAll() {
+    int groups = 0;
+    for (const auto& same : m_byDigest) {
+        if (same.second.size() < 2) continue;
+        reportGroup(same.second, same.first);
+        groups++;
+    }
+    return groups;
+}
+
+int Watcher::poll(int timeoutMs) {
+    pollfd pfd{m_fd, POLLIN, 0};
+    int ready = ::poll(&pfd, 1, timeoutMs);
+    if (ready < 0) return errno == EINTR ? 0 : -1;
+    if (ready == 0) return 0;
+
+    int groups = 0;
+    alignas(inotify_event) char buf[64 * 1024];
+    while (true) {
+        ssize_t len = ::read(m_fd, buf, sizeof(buf));
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EINTR) break;
+            return -1;
+        }
+        for (char* p = buf; p < buf + len;) {
+            const inotify_event* ev = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                //Events were lost, the index can't be trusted any more.
+                message("Event queue overflowed, indexing the tree again\n");
+                for (const auto& dir : m_dirs) inotify_rm_watch(m_fd, dir.first);
+                m_dirs.clear();
+                m_files.clear();
+                m_bySize.clear();
+                m_byDigest.clear();
+                m_moved.clear();
+                ::close(m_fd);
+                m_fd = -1;
+                //The rest of the buffer belongs to the old descriptor.
+                if (m_onResync) m_onResync();
+                int res = start();
+                return res < 0 ? -1 : groups + res;
+            }
+
+            auto dir = m_dirs.find(ev->wd);
+            if (dir == m_dirs.end()) continue;
+            if (ev->mask & IN_DELETE_SELF) {
+                removeDirectory(dir->second);
+                continue;
+            }
+            if (ev->mask & IN_IGNORED) {
+                m_dirs.erase(dir);
+                continue;
+            }
+            if (ev->len == 0) continue;
+            const std::string path = dir->second + "/" + ev->name;
+
+            if (ev->mask & IN_ISDIR) {
+                if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    //Files found by the walk of a new directory are hashed like new files.
+                    if (!m_filter.skipDirectory(path)) groups += addDirectory(path);
+                } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    removeDirectory(path);
+                }
+                continue;
+            }
+
+            if (ev->mask & IN_MOVED_FROM) {
+                auto it = m_files.find(path);
+                if (it != m_files.end()) m_moved[ev->cookie] = it->second;
+                remove(path);
+            } else if (ev->mask & IN_MOVED_TO) {
+                auto moved = m_moved.find(ev->cookie);
+                groups += update(path, moved != m_moved.end() ? &moved->second : nullptr);
+                if (moved != m_moved.end()) m_moved.erase(moved);
+            } else if (ev->mask & IN_DELETE) {
+                remove(path);
+            } else if (ev->mask & (IN_CREATE | IN_CLOSE_WRITE)) {
+                //IN_CREATE alone is usually an empty file still being written, it is updated again on close.
+                groups += update(path, nullptr);
+            }
+        }
+    }
+    //Files moved out of the tree never get their IN_MOVED_TO.
+    m_moved.clear();
+    return groups;
+}
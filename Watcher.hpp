@@ -0,0 +1,104 @@
+#ifndef WATCHER_HPP
+#define WATCHER_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "PathFilter.hpp"
+#include "ScanOptions.hpp"
+#include "ScanResult.hpp"
+
+/**
+ * @class Watcher
+ * @brief Keeps an exact duplicate index of a directory tree up to date through inotify.
+ *
+ * start() walks the tree once, watches every directory and reports the
+ * duplicate groups found. From then on poll() reads the inotify events and
+ * updates two indexes: size -> files and BLAKE3 digest -> files. A file is
+ * only hashed once another file of its size exists, and only files which
+ * were created, written, or moved in are hashed again. Whenever a file joins
+ * a digest which already had a file, its whole group is reported. If
+ * inotify drops events the tree is indexed again, and the resync callback
+ * runs before its groups are reported again.
+ *
+ * Symbolic links are not followed.
+ */
+class Watcher {
+public:
+    explicit Watcher(const ScanOptions& options);
+    ~Watcher();
+
+    Watcher(const Watcher&) = delete;
+    Watcher& operator=(const Watcher&) = delete;
+
+    void setGroupCallback(GroupCallback callback) { m_onGroup = std::move(callback); }
+    void setMessageCallback(MessageCallback callback) { m_onMessage = std::move(callback); }
+
+    /**
+     * @brief Sets the function called when the inotify queue overflowed.
+     *
+     * The tree is then indexed again and all its groups are reported anew, so
+     * the groups reported after the call replace every group reported before it.
+     */
+    void setResyncCallback(std::function<void()> callback) { m_onResync = std::move(callback); }
+
+    /**
+     * @brief Sets up inotify, indexes the tree and reports the groups already present.
+     * @return Number of groups reported, -1 if inotify or the root couldn't be set up.
+     */
+    int start();
+
+    /**
+     * @brief Waits up to timeoutMs for events and applies them to the index.
+     * @return Number of groups reported, -1 on an inotify error.
+     */
+    int poll(int timeoutMs);
+
+    std::size_t fileCount() const { return m_files.size(); }
+    std::size_t hashedCount() const { return m_hashed; }
+
+private:
+    struct Entry {
+        std::uintmax_t size = 0;
+        std::int64_t mtime = 0;
+        std::string digest;             // Empty until a second file of the same size shows up.
+    };
+
+    ScanOptions m_options;
+    PathFilter m_filter;
+    GroupCallback m_onGroup;
+    MessageCallback m_onMessage;
+    std::function<void()> m_onResync;
+    int m_fd = -1;
+    bool m_indexing = false;            // During start() groups are reported at the end, not per file.
+    std::size_t m_hashed = 0;           // Files hashed since start().
+
+    std::unordered_map<int, std::string> m_dirs;                       // inotify watch -> directory.
+    std::unordered_map<std::string, Entry> m_files;
+    std::unordered_map<std::uintmax_t, std::unordered_set<std::string>> m_bySize;
+    std::unordered_map<std::string, std::unordered_set<std::string>> m_byDigest;
+    std::unordered_map<std::uint32_t, Entry> m_moved;                  // Entries moved out, by inotify cookie.
+
+    void message(const std::string& text) const;
+
+    //Watches dir and everything below it, indexing the files found. Returns the groups reported.
+    int addDirectory(const std::string& dir);
+    //Forgets a directory which was deleted or moved away, and the files below it.
+    void removeDirectory(const std::string& dir);
+
+    //Re-reads a file after it was created, written or moved in. known is reused if the file is unchanged.
+    int update(const std::string& path, const Entry* known);
+    void remove(const std::string& path);
+
+    //Hashes the unhashed files of a size bucket.
+    int hashBucket(std::uintmax_t size);
+    int addDigest(const std::string& path, const std::string& digest);
+    void reportGroup(const std::unordered_set<std::string>& files, const std::string& digest);
+    int reportAll();
+};
+
+#endif // WATCHER_HPP
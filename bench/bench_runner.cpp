@@ -0,0 +1,446 @@
+// bench_runner.cpp
+//
+// Per-stage microbenchmarks and end-to-end timings over a tree made by gen_tree.
+// Every benchmark is written as one JSON object per line to the --out file, so runs
+// from different commits can be diffed or compared with --compare.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "BKTree.hpp"
+#include "Checksum.hpp"
+#include "FileInfo.hpp"
+#include "FileTree.hpp"
+#include "PathStore.hpp"
+#include "ScanContext.hpp"
+#include "Utility.hpp"
+
+namespace fs = std::filesystem;
+
+struct BenchOptions {
+    std::string tree = "bench_tree";
+    std::string out = "bench_results.json";
+    std::string compare;                        // Earlier results file to compare against.
+    std::string label;                          // Usually the commit id.
+    int reps = 5;
+    std::uint64_t hashBytes = 512ull << 20;     // Cap on the bytes hashed by the checksum benchmark.
+    std::size_t bkItems = 20000;
+    std::size_t bkQueries = 1000;
+    unsigned threads = 0;
+};
+
+struct Result {
+    std::string name;
+    int reps = 0;
+    double minSec = 0;
+    double medianSec = 0;
+    std::uint64_t items = 0;        // Files, hashes, ... processed per repetition.
+    std::uint64_t bytes = 0;        // Bytes read per repetition, 0 if not meaningful.
+};
+
+//Keeps the min and median of the collected wall times.
+static Result summarize(const std::string& name, std::vector<double> times,
+                        std::uint64_t items, std::uint64_t bytes) {
+    Result r;
+    r.name = name;
+    r.reps = (int)times.size();
+    std::sort(times.begin(), times.end());
+    r.minSec = times.front();
+    r.medianSec = times[times.size() / 2];
+    r.items = items;
+    r.bytes = bytes;
+    return r;
+}
+
+/**
+ * @brief Runs fn reps times and keeps the min and median wall time.
+ *
+ * fn returns the number of items it processed and may set bytes.
+ */
+static Result measure(const std::string& name, int reps,
+                      const std::function<std::uint64_t(std::uint64_t& bytes)>& fn) {
+    std::vector<double> times;
+    std::uint64_t items = 0, bytes = 0;
+    for (int i = 0; i < reps; ++i) {
+        bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        items = fn(bytes);
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double>(end - start).count());
+    }
+    return summarize(name, times, items, bytes);
+}
+
+//Current resident set size, from /proc/self/statm.
+static std::size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    std::size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * (std::size_t)sysconf(_SC_PAGESIZE);
+}
+
+static std::string toJson(const Result& r, const std::string& label) {
+    std::ostringstream oss;
+    oss << std::setprecision(9)
+        << "{\"name\":\"" << r.name << "\",\"label\":\"" << label << "\",\"reps\":" << r.reps
+        << ",\"min_sec\":" << r.minSec << ",\"median_sec\":" << r.medianSec
+        << ",\"items\":" << r.items << ",\"bytes\":" << r.bytes
+        << ",\"items_per_sec\":" << (r.medianSec > 0 ? r.items / r.medianSec : 0)
+        << ",\"mb_per_sec\":" << (r.medianSec > 0 ? r.bytes / r.medianSec / 1e6 : 0) << "}";
+    return oss.str();
+}
+
+//Reads "name" and "median_sec" back from a results file written by toJson.
+static std::map<std::string, double> loadResults(const std::string& file) {
+    std::map<std::string, double> results;
+    std::ifstream in(file);
+    std::string line;
+    while (std::getline(in, line)) {
+        auto n = line.find("\"name\":\"");
+        auto m = line.find("\"median_sec\":");
+        if (n == std::string::npos || m == std::string::npos) continue;
+        n += 8;
+        std::string name = line.substr(n, line.find('"', n) - n);
+        results[name] = std::stod(line.substr(m + 13));
+    }
+    return results;
+}
+
+static bool parseArgs(int argc, char* argv[], BenchOptions& o) {
+    for (int i = 1; i < argc; ++i) {
+        std::string opt = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << opt << "\n";
+            return false;
+        }
+        std::string v = argv[++i];
+        if (opt == "--tree") o.tree = v;
+        else if (opt == "--out") o.out = v;
+        else if (opt == "--compare") o.compare = v;
+        else if (opt == "--label") o.label = v;
+        else if (opt == "--reps") o.reps = std::stoi(v);
+        else if (opt == "--hash-bytes") o.hashBytes = std::stoull(v);
+        else if (opt == "--bk-items") o.bkItems = std::stoull(v);
+        else if (opt == "--bk-queries") o.bkQueries = std::stoull(v);
+        else if (opt == "--threads") o.threads = (unsigned)std::stoul(v);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--tree dir] [--out file] [--compare file] [--label text]\n"
+                      << "       [--reps n] [--hash-bytes n] [--bk-items n] [--bk-queries n] [--threads n]\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions o;
+    if (!parseArgs(argc, argv, o)) return 1;
+    if (!fs::is_directory(o.tree)) {
+        std::cerr << "No benchmark tree at " << o.tree << ", run gen_tree first\n";
+        return 1;
+    }
+
+    //Resident memory held by the walked file paths: PathStore ids against one std::filesystem::path
+    //per file as the file list used to keep. This runs before anything else has freed memory the
+    //two could reuse, and the store goes first, so reuse can only make the difference look smaller.
+    std::size_t storeRss = 0, storeBytes = 0, pathRss = 0, walkedFiles = 0;
+    {
+        const std::size_t before = residentBytes();
+        PathStore paths;
+        std::vector<PathId> ids;
+        FileTree walker(false);
+        walker.setPathStore(&paths);
+        walker.setCallback([&](const fs::path& p, PathId dir) { ids.push_back(paths.add(dir, p.filename().string())); return 0; });
+        walker.walk(o.tree);
+        storeRss = residentBytes() - before;
+        storeBytes = paths.memoryUsage() + ids.capacity() * sizeof(PathId);
+        walkedFiles = ids.size();
+    }
+    {
+        const std::size_t before = residentBytes();
+        std::vector<fs::path> paths;
+        FileTree walker(false);
+        walker.setCallback([&](const fs::path& p, PathId) { paths.push_back(p); return 0; });
+        walker.walk(o.tree);
+        pathRss = residentBytes() - before;
+    }
+    const double fileCount = (double)std::max<std::size_t>(walkedFiles, 1);
+
+    //Inputs shared by the microbenchmarks.
+    std::vector<std::string> dataFiles, images, dirs{o.tree};
+    for (const auto& entry : fs::recursive_directory_iterator(o.tree)) {
+        if (entry.is_directory()) dirs.push_back(entry.path().string());
+        if (!entry.is_regular_file()) continue;
+        const std::string ext = entry.path().extension().string();
+        if (ext == ".bin") dataFiles.push_back(entry.path().string());
+        else if (ext == ".jpg" || ext == ".png") images.push_back(entry.path().string());
+    }
+    std::sort(dataFiles.begin(), dataFiles.end());
+    std::sort(images.begin(), images.end());
+
+    std::vector<Result> results;
+
+    //FileTree::walk, with and without recording paths.
+    results.push_back(measure("walk", o.reps, [&](std::uint64_t&) {
+        std::uint64_t count = 0;
+        FileTree walker(false);
+        walker.setCallback([&](const fs::path&, PathId) { count++; return 0; });
+        walker.walk(o.tree);
+        return count;
+    }));
+    results.push_back(measure("walk_pathstore", o.reps, [&](std::uint64_t&) {
+        std::uint64_t count = 0;
+        PathStore store;
+        FileTree walker(false);
+        walker.setPathStore(&store);
+        walker.setCallback([&](const fs::path& p, PathId dir) { store.add(dir, p.filename().string()); count++; return 0; });
+        walker.walk(o.tree);
+        return count;
+    }));
+
+    //The visited check of the walk: canonical path strings as it used to be, against (st_dev, st_ino).
+    std::size_t canonicalBytes = 0, canonicalComponents = 0;
+    results.push_back(measure("walk_visit_canonical", o.reps, [&](std::uint64_t&) {
+        std::unordered_set<fs::path> visited;
+        std::error_code ec;
+        canonicalBytes = canonicalComponents = 0;
+        for (const auto& d : dirs) {
+            fs::path canonical = fs::weakly_canonical(d, ec);
+            canonicalComponents += std::distance(canonical.begin(), canonical.end());
+            canonicalBytes += sizeof(fs::path) + canonical.native().capacity() + 1;
+            visited.insert(std::move(canonical));
+        }
+        return (std::uint64_t)visited.size();
+    }));
+    results.push_back(measure("walk_visit_inode", o.reps, [&](std::uint64_t&) {
+        auto hash = [](const std::pair<dev_t, ino_t>& k) { return std::hash<ino_t>()(k.second) ^ k.first; };
+        std::unordered_set<std::pair<dev_t, ino_t>, decltype(hash)> visited(dirs.size(), hash);
+        struct stat st;
+        for (const auto& d : dirs) {
+            if (::lstat(d.c_str(), &st) == 0) visited.emplace(st.st_dev, st.st_ino);
+        }
+        return (std::uint64_t)visited.size();
+    }));
+    const double dirCount = (double)std::max<std::size_t>(dirs.size(), 1);
+
+    //Checksum::compute over the data files, up to hashBytes.
+    results.push_back(measure("checksum_compute", o.reps, [&](std::uint64_t& bytes) {
+        std::uint64_t count = 0;
+        for (const auto& f : dataFiles) {
+            if (bytes >= o.hashBytes) break;
+            Checksum::compute(f);
+            bytes += fs::file_size(f);
+            count++;
+        }
+        return count;
+    }));
+
+    //Checksum::computeFast over the same files, the first tier of --hash tiered.
+    results.push_back(measure("checksum_fast", o.reps, [&](std::uint64_t& bytes) {
+        std::uint64_t count = 0;
+        for (const auto& f : dataFiles) {
+            if (bytes >= o.hashBytes) break;
+            Checksum::computeFast(f);
+            bytes += fs::file_size(f);
+            count++;
+        }
+        return count;
+    }));
+    //Tiered hashing reads every candidate once with FastHash and the duplicates again with
+    //BLAKE3, so it pays off while the share of duplicates among the candidates stays below
+    //1 - t(fast) / t(blake3) for the same bytes.
+    const double blake3Sec = results[results.size() - 2].medianSec;
+    const double fastSec = results.back().medianSec;
+    const double crossover = blake3Sec > 0 ? 1.0 - fastSec / blake3Sec : 0;
+
+    //Checksum::computeImagePHash64 over all images.
+    results.push_back(measure("image_phash64", o.reps, [&](std::uint64_t& bytes) {
+        for (const auto& f : images) {
+            Checksum::computeImagePHash64(f);
+            bytes += fs::file_size(f);
+        }
+        return (std::uint64_t)images.size();
+    }));
+
+    //Utility::removeUnique*: the list is prepared once, each repetition filters a fresh copy.
+    PathStore store;
+    std::vector<FileInfo> prepared;
+    for (const auto& f : dataFiles) {
+        FileInfo fi(store.addRoot(f));
+        if (!fi.readFileSize(f)) continue;
+        fi.readFirstBytes(f);
+        fi.setBlake3(f);
+        prepared.push_back(fi);
+    }
+    const std::pair<const char*, std::size_t (Utility::*)()> filters[] = {
+        {"utility_remove_unique_sizes", &Utility::removeUniqueSizes},
+        {"utility_remove_unique_buffer", &Utility::removeUniqueBuffer},
+        {"utility_remove_unique_hashes", &Utility::removeUniqueHashes},
+    };
+    for (const auto& filter : filters) {
+        std::vector<double> times;
+        for (int i = 0; i < o.reps; ++i) {
+            std::vector<FileInfo> copy = prepared;     // Not timed.
+            Utility u(copy);
+            auto start = std::chrono::steady_clock::now();
+            (u.*filter.second)();
+            times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        results.push_back(summarize(filter.first, times, prepared.size(), 0));
+    }
+
+    //BKTree insert and query on random 64 bit hashes.
+    std::mt19937_64 rng(7);
+    std::vector<FileInfo> hashed;
+    for (std::size_t i = 0; i < o.bkItems; ++i) {
+        FileInfo fi((PathId)i);
+        fi.setImgHash(rng());
+        hashed.push_back(fi);
+    }
+    BKTree tree;
+    results.push_back(measure("bktree_insert", 1, [&](std::uint64_t&) {
+        for (const auto& f : hashed) tree.insert(f);
+        return (std::uint64_t)hashed.size();
+    }));
+    std::vector<bool> visited(hashed.size(), false);
+    results.push_back(measure("bktree_query", o.reps, [&](std::uint64_t&) {
+        std::size_t queries = std::min(hashed.size(), o.bkQueries);
+        for (std::size_t i = 0; i < queries; ++i) {
+            std::vector<FileInfo> similar;
+            tree.findSimilar(hashed[i].getImgHash(), 10, similar, visited);
+        }
+        return (std::uint64_t)queries;
+    }));
+    results.push_back(measure("bktree_query_ids", o.reps, [&](std::uint64_t&) {
+        std::size_t queries = std::min(hashed.size(), o.bkQueries);
+        std::vector<PathId> similar;
+        for (std::size_t i = 0; i < queries; ++i) {
+            similar.clear();
+            tree.findSimilarIds(hashed[i].getImgHash(), 10, similar);
+        }
+        return (std::uint64_t)queries;
+    }));
+
+    //End to end, through the library like the command line does.
+    ScanOptions scan;
+    scan.root = o.tree;
+    scan.threads = o.threads;
+    const struct {
+        const char* name;
+        int (ScanContext::*run)();
+        ScanOptions::HashMode hashMode;
+    } modes[] = {
+        {"e2e_dedup", &ScanContext::findExactDuplicates, ScanOptions::HashMode::Blake3},
+        {"e2e_dedup_tiered", &ScanContext::findExactDuplicates, ScanOptions::HashMode::Tiered},
+        {"e2e_dedup_fast", &ScanContext::findExactDuplicates, ScanOptions::HashMode::Fast},
+        {"e2e_img", &ScanContext::findSimilarImages, ScanOptions::HashMode::Blake3},
+        {"e2e_vid", &ScanContext::findSimilarVideos, ScanOptions::HashMode::Blake3},
+        {"e2e_all", &ScanContext::findAll, ScanOptions::HashMode::Blake3},
+    };
+    for (const auto& mode : modes) {
+        scan.hashMode = mode.hashMode;
+        results.push_back(measure(mode.name, std::max(1, o.reps / 2), [&](std::uint64_t&) {
+            ScanContext context(scan);
+            std::uint64_t files = 0;
+            context.setGroupCallback([&](const DuplicateGroup& g) { files += g.files.size(); });
+            (context.*mode.run)();
+            return files;
+        }));
+    }
+
+    //Image hash cascades: the time of each, and how many of the pairs grouped by pHash alone
+    //it groups too (recall) or groups only itself (extra).
+    using ImageHash = ScanOptions::ImageHash;
+    const struct {
+        const char* name;
+        ImageHash prefilter, hash;
+    } cascades[] = {
+        {"img_phash", ImageHash::None, ImageHash::PHash},
+        {"img_ahash", ImageHash::None, ImageHash::AHash},
+        {"img_dhash", ImageHash::None, ImageHash::DHash},
+        {"img_ahash_phash", ImageHash::AHash, ImageHash::PHash},
+        {"img_dhash_phash", ImageHash::DHash, ImageHash::PHash},
+        {"img_dhash_phash256", ImageHash::DHash, ImageHash::PHash256},
+    };
+    scan.hashMode = ScanOptions::HashMode::Blake3;
+    std::set<std::pair<std::string, std::string>> phashPairs;
+    std::vector<std::string> accuracy;
+    for (const auto& cascade : cascades) {
+        scan.imagePrefilter = cascade.prefilter;
+        scan.imageHash = cascade.hash;
+        std::set<std::pair<std::string, std::string>> pairs;
+        results.push_back(measure(cascade.name, std::max(1, o.reps / 2), [&](std::uint64_t&) {
+            ScanContext context(scan);
+            pairs.clear();
+            context.setGroupCallback([&](const DuplicateGroup& g) {
+                for (std::size_t i = 0; i < g.files.size(); ++i) {
+                    for (std::size_t j = i + 1; j < g.files.size(); ++j) {
+                        pairs.emplace(std::min(g.files[i], g.files[j]).string(), std::max(g.files[i], g.files[j]).string());
+                    }
+                }
+            });
+            context.findSimilarImages();
+            return (std::uint64_t)images.size();
+        }));
+        if (cascade.hash == ImageHash::PHash && cascade.prefilter == ImageHash::None) phashPairs = pairs;
+        std::size_t common = 0;
+        for (const auto& pair : pairs) common += phashPairs.count(pair);
+        std::ostringstream line;
+        line << std::left << std::setw(32) << cascade.name << std::right << std::fixed << std::setprecision(1)
+             << std::setw(8) << (phashPairs.empty() ? 100.0 : 100.0 * common / phashPairs.size()) << "% recall"
+             << std::setw(8) << pairs.size() - common << " extra pairs";
+        accuracy.push_back(line.str());
+    }
+    scan.imagePrefilter = ImageHash::None;
+    scan.imageHash = ImageHash::PHash;
+
+    std::map<std::string, double> baseline;
+    if (!o.compare.empty()) baseline = loadResults(o.compare);
+
+    std::ofstream out(o.out);
+    std::cout << std::left << std::setw(32) << "benchmark" << std::right << std::setw(14) << "median ms"
+              << std::setw(14) << "items/s" << std::setw(12) << "MB/s"
+              << (baseline.empty() ? "" : "    vs baseline") << "\n";
+    for (const auto& r : results) {
+        out << toJson(r, o.label) << "\n";
+        std::cout << std::left << std::setw(32) << r.name << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(14) << r.medianSec * 1e3
+                  << std::setw(14) << std::setprecision(0) << (r.medianSec > 0 ? r.items / r.medianSec : 0)
+                  << std::setw(12) << std::setprecision(1) << (r.medianSec > 0 ? r.bytes / r.medianSec / 1e6 : 0);
+        auto it = baseline.find(r.name);
+        if (it != baseline.end() && it->second > 0) {
+            std::cout << std::setw(14) << std::showpos << (r.medianSec / it->second - 1.0) * 100 << "%" << std::noshowpos;
+        }
+        std::cout << "\n";
+    }
+    std::cout << "Image hash accuracy against pHash alone:\n";
+    for (const auto& line : accuracy) std::cout << "  " << line << "\n";
+    std::cout << "Tiered hashing is cheaper than BLAKE3 alone while under " << std::setprecision(0)
+              << std::max(0.0, crossover) * 100 << "% of the hashed candidates are duplicates\n";
+    std::cout << "Walked paths of " << walkedFiles << " files: PathStore " << std::setprecision(1)
+              << storeRss / 1e6 << " MB RSS (" << std::setprecision(0) << storeRss / fileCount
+              << " B/file, " << storeBytes / fileCount << " B/file allocated), std::filesystem::path " << std::setprecision(1) << pathRss / 1e6 << " MB RSS ("
+              << std::setprecision(0) << pathRss / fileCount << " B/file)\n";
+    std::cout << "Visited directory keys: a canonical path resolves " << std::setprecision(1)
+              << canonicalComponents / dirCount << " components (one lstat each) and keeps "
+              << std::setprecision(0) << canonicalBytes / dirCount << " bytes per directory; "
+              << "(st_dev, st_ino) takes 1 lstat and " << sizeof(std::pair<dev_t, ino_t>) << " bytes\n";
+    std::cout << "Results written to " << o.out << "\n";
+    return 0;
+}
@@ -0,0 +1,609 @@
+// check_runner.cpp
+//
+// Correctness checks of the engine's building blocks, run by make check.
+// Each check builds the small inputs it needs under a scratch directory and
+// prints one line; the exit status is the number of failed checks.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+#include "blake3.h"
+#include "BufferedWriter.hpp"
+#include "Checksum.hpp"
+#include "DedupAction.hpp"
+#include "DuplicateIndex.hpp"
+#include "ExifThumbnail.hpp"
+#include "FastHash.hpp"
+#include "FileTree.hpp"
+#include "PathStore.hpp"
+#include "ResultSink.hpp"
+#include "ScanContext.hpp"
+#include "ShardFile.hpp"
+
+namespace fs = std::filesystem;
+
+static int failures = 0;
+
+static void expect(bool ok, const std::string& what) {
+    std::cout << (ok ? "ok     " : "FAILED ") << what << "\n";
+    if (!ok) failures++;
+}
+
+static void skip(const std::string& what, const std::string& why) {
+    std::cout << "skip   " << what << " (" << why << ")\n";
+}
+
+static void writeFile(const fs::path& p, const std::string& content) {
+    std::ofstream out(p, std::ios::binary | std::ios::trunc);
+    out << content;
+}
+
+//Every node of a deep chain, with a name larger than an arena block among them, builds back its path.
+static void checkPathStoreRoundTrip() {
+    for (const std::string root : {"/", "root", "root/"}) {
+        PathStore store;
+        std::vector<PathId> ids{store.addRoot(root)};
+        std::vector<std::string> expected{root};
+        for (int depth = 1; depth <= 3000; ++depth) {
+            std::string name = (depth == 1500) ? std::string(70000, 'x') : "d" + std::to_string(depth);
+            ids.push_back(store.add(ids.back(), name));
+            const std::string& parent = expected.back();
+            expected.push_back(parent + (parent.back() == '/' ? "" : "/") + name);
+        }
+        bool same = true;
+        for (std::size_t i = 0; i < ids.size(); ++i) {
+            same = same && store.string(ids[i]) == expected[i];
+            same = same && (i == 0 ? store.parent(ids[i]) == PathStore::npos : store.parent(ids[i]) == ids[i - 1]);
+        }
+        expect(same, "PathStore round trip of a 3000 level chain below \"" + root + "\"");
+    }
+}
+
+//The walker records directories in the store; every reported file is its directory's path plus its name.
+static void checkPathStoreWalk(const fs::path& scratch) {
+    fs::path dir = scratch / "deep";
+    for (int depth = 0; depth < 200; ++depth) {
+        dir /= "level_" + std::to_string(depth);
+    }
+    fs::create_directories(dir);
+    std::size_t written = 0;
+    for (fs::path p = dir; p != scratch; p = p.parent_path()) {
+        writeFile(p / "file.txt", p.string());
+        written++;
+    }
+
+    PathStore store;
+    FileTree walker(false);
+    walker.setPathStore(&store);
+    std::size_t reported = 0;
+    bool same = true;
+    walker.setCallback([&](const fs::path& p, PathId dirId) {
+        PathId id = store.add(dirId, p.filename().string());
+        same = same && store.path(id) == p && store.path(dirId) == p.parent_path();
+        reported++;
+        return 0;
+    });
+    walker.walk((scratch / "deep").string());
+    expect(same && reported == written, "PathStore paths of a walked 200 level tree");
+}
+
+//FastHash is XXH3-128: the sanity vectors of xxHash's own test suite, whole and fed in uneven pieces.
+static void checkFastHashVectors(const fs::path& scratch) {
+    //The test buffer of xxhsum: the top byte of a 64 bit multiplicative sequence.
+    std::vector<std::uint8_t> buffer(2367);
+    std::uint64_t byteGen = 2654435761U;
+    for (auto& byte : buffer) {
+        byte = (std::uint8_t)(byteGen >> 56);
+        byteGen *= 11400714785074694797ULL;
+    }
+    const std::vector<std::pair<std::size_t, std::string>> vectors = {
+        {0, "99aa06d3014798d86001c324468d497f"},    {1, "a6cd5e9392000f6ac44bdff4074eecdb"},
+        {6, "082afe0b8162d12a3e7039bdda43cfc6"},    {12, "6e3efd8fc7802b18061a192713f69ad9"},
+        {24, "0ce966e4678d37611e7044d28b1b901d"},   {48, "a002ac4e5478227ef942219aed80f67b"},
+        {81, "4952f58181ab00425e8bafb9f95fb803"},   {222, "337e09641b948717f1aebd597cec6b3a"},
+        {403, "1b6de21e332dd73dcdeb804d65c6dea4"},  {512, "18d2d110dcc9bca1617e49599013cb6b"},
+        {2048, "f736557fd47073a5dd59e2c3a5f038e0"}, {2240, "ccb134fbfa7ce49d6e73a90539cf2948"},
+        {2367, "e89c0f6ff369b427cb37aeb9e5d361ed"},
+    };
+    bool whole = true, pieces = true;
+    for (const auto& v : vectors) {
+        std::uint8_t digest[FastHash::DigestSize];
+        FastHash one;
+        one.update(buffer.data(), v.first);
+        one.finalize(digest);
+        whole = whole && Checksum::toHex(digest, FastHash::DigestSize) == v.second;
+
+        FastHash split;
+        for (std::size_t at = 0, step = 1; at < v.first; at += step, step = step * 3 + 1) {
+            split.update(buffer.data() + at, std::min(step, v.first - at));
+        }
+        split.finalize(digest);
+        pieces = pieces && Checksum::toHex(digest, FastHash::DigestSize) == v.second;
+    }
+    expect(whole, "FastHash matches the XXH3-128 reference vectors");
+    expect(pieces, "FastHash gives the same digest when fed in pieces");
+
+    writeFile(scratch / "vector.bin", std::string(buffer.begin(), buffer.end()));
+    expect(Checksum::computeFast((scratch / "vector.bin").string()) == vectors.back().second,
+           "Checksum::computeFast of a file is its XXH3-128");
+}
+
+//Checksum::compute hashes the holes of a sparse file as the zeros they read as, without reading them:
+//its digest is the BLAKE3 of a plain read of every byte, wherever the holes are.
+static void checkSparseHashing(const fs::path& scratch) {
+    const fs::path root = scratch / "sparse";
+    fs::create_directories(root);
+    std::string data(100000, '\0');
+    for (std::size_t i = 0; i < data.size(); ++i) data[i] = (char)(i * 131 + i / 4096);
+    const off_t n = (off_t)data.size(), hole = 1 << 20;
+    const struct {
+        const char* name;
+        std::vector<off_t> extents;     // Offsets at which data is written.
+        off_t size;
+    } layouts[] = {
+        {"a leading hole", {2 * hole}, 2 * hole + n},
+        {"a hole in the middle", {0, n + 2 * hole}, 2 * n + 2 * hole},
+        {"a trailing hole", {0}, n + 2 * hole},
+        {"nothing but a hole", {}, 3 * hole},
+        {"no hole", {0}, n},
+    };
+    for (const auto& layout : layouts) {
+        const fs::path file = root / layout.name;
+        int fd = ::open(file.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+        bool written = fd >= 0;
+        for (off_t at : layout.extents) {
+            written = written && ::pwrite(fd, data.data(), data.size(), at) == (ssize_t)data.size();
+        }
+        written = written && ::ftruncate(fd, layout.size) == 0;
+        if (fd >= 0) ::close(fd);
+
+        std::ifstream in(file, std::ios::binary);
+        const std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        blake3_hasher hasher;
+        blake3_hasher_init(&hasher);
+        blake3_hasher_update(&hasher, bytes.data(), bytes.size());
+        std::uint8_t digest[BLAKE3_OUT_LEN];
+        blake3_hasher_finalize(&hasher, digest, BLAKE3_OUT_LEN);
+        expect(written && bytes.size() == (std::size_t)layout.size &&
+               Checksum::compute(file.string()) == Checksum::toHex(digest),
+               std::string("Checksum::compute of a file with ") + layout.name + " is the BLAKE3 of a plain read");
+    }
+}
+
+//DuplicateIndex finds each written entry by size and digest, with the entries sharing both, and nothing else.
+static void checkIndexRoundTrip(const fs::path& scratch) {
+    auto digestOf = [](int seed) {
+        DuplicateIndex::Digest d{};
+        for (std::size_t i = 0; i < d.size(); ++i) d[i] = (std::uint8_t)(seed * 37 + i);
+        return d;
+    };
+    const std::vector<DuplicateIndex::Entry> entries = {
+        {5000, digestOf(1), "/data/a"},
+        {5000, digestOf(1), "/data/copy of a"},
+        {5000, digestOf(2), "/data/b"},
+        {1, digestOf(3), "/data/" + std::string(5000, 'l')},
+        {1ULL << 40, digestOf(1), "/data/large"},
+    };
+    std::vector<DuplicateIndex::Entry> sorted = entries;
+    const std::string file = (scratch / "round_trip.idx").string();
+    DuplicateIndex index;
+    std::string error;
+    bool ok = DuplicateIndex::write(file, sorted) && index.open(file, error) && index.fileCount() == entries.size();
+    for (const auto& entry : entries) {
+        if (!ok) break;
+        std::vector<std::string> found;
+        auto range = index.find(entry.size, entry.digest);
+        for (std::uint64_t id = range.first; id < range.second; ++id) found.emplace_back(index.path(id));
+        std::vector<std::string> expected;
+        for (const auto& other : entries) {
+            if (other.size == entry.size && other.digest == entry.digest) expected.push_back(other.path);
+        }
+        std::sort(found.begin(), found.end());
+        std::sort(expected.begin(), expected.end());
+        ok = index.hasSize(entry.size) && found == expected;
+    }
+    auto none = index.find(5000, digestOf(3));
+    ok = ok && !index.hasSize(4999) && none.first == none.second;
+    expect(ok, "DuplicateIndex finds every written entry by size and digest");
+}
+
+//A shard file read back holds the records written, digests and their absence included.
+static void checkShardRoundTrip(const fs::path& scratch) {
+    ShardFile shard;
+    shard.name = "host-1";
+    ShardFile::Record withDigest;
+    withDigest.path = "/volume/a file";
+    withDigest.size = 123456789012ULL;
+    withDigest.mtime = -1;
+    withDigest.prefix = UINT64_MAX;
+    withDigest.hasDigest = true;
+    for (std::size_t i = 0; i < withDigest.digest.size(); ++i) withDigest.digest[i] = (std::uint8_t)(255 - i);
+    ShardFile::Record without;
+    without.path = "/volume/" + std::string(70000, 'p');
+    without.size = 4097;
+    without.mtime = 1700000000123456789LL;
+    without.prefix = 42;
+    shard.records = {withDigest, without};
+
+    const std::string file = (scratch / "round_trip.shard").string();
+    ShardFile read;
+    std::string error;
+    bool ok = shard.write(file) && read.read(file, error) && read.name == shard.name &&
+              read.records.size() == shard.records.size();
+    for (std::size_t i = 0; ok && i < shard.records.size(); ++i) {
+        const ShardFile::Record& a = shard.records[i];
+        const ShardFile::Record& b = read.records[i];
+        ok = a.path == b.path && a.size == b.size && a.mtime == b.mtime && a.prefix == b.prefix &&
+             a.hasDigest == b.hasDigest && (!a.hasDigest || a.digest == b.digest);
+    }
+    expect(ok, "ShardFile reads back the records it wrote");
+}
+
+//Little endian integer of the given width at data[at], advancing at.
+static std::uint64_t readLE(const std::string& data, std::size_t& at, int width) {
+    std::uint64_t value = 0;
+    for (int i = 0; i < width && at + i < data.size(); ++i) value |= (std::uint64_t)(std::uint8_t)data[at + i] << (8 * i);
+    at += width;
+    return value;
+}
+
+//The binary result format decodes, as its layout in ResultSink.hpp describes, to the groups written.
+static void checkBinarySinkRoundTrip(const fs::path& scratch) {
+    DuplicateGroup exact;
+    exact.size = 5000;
+    exact.hash = std::string(64, 'a').replace(0, 4, "0f1e");
+    exact.wastedBytes = 5000;
+    exact.files = {"/data/a", "/data/b"};
+    DuplicateGroup chunk;
+    chunk.kind = DuplicateGroup::Kind::Chunk;
+    chunk.size = 1 << 20;
+    chunk.wastedBytes = 1 << 19;
+    chunk.similarity = 0.5;
+    chunk.files = {"/data/c", "/data/" + std::string(300, 'd')};
+    DuplicateGroup directory;
+    directory.kind = DuplicateGroup::Kind::Directory;
+    directory.size = 10;
+    directory.files = {"/data/e", "/data/f", "/data/g"};
+    const std::vector<DuplicateGroup> written = {exact, chunk, directory};
+
+    const std::string file = (scratch / "round_trip.bin").string();
+    {
+        BufferedWriter out(file);
+        BinarySink sink(out);
+        sink.group(exact);
+        sink.resync();
+        sink.group(chunk);
+        sink.group(directory);
+        sink.finish();
+    }
+    std::ifstream in(file, std::ios::binary);
+    const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    bool ok = data.compare(0, 8, "DDUPRES2") == 0;
+    std::size_t at = 8, groups = 0, resyncs = 0;
+    std::vector<DuplicateGroup> decoded;
+    while (ok && at < data.size()) {
+        const std::uint64_t tag = readLE(data, at, 1);
+        if (tag == 0xFF) {
+            groups = readLE(data, at, 8);
+            break;
+        }
+        if (tag == 0xFE) {
+            resyncs++;
+            continue;
+        }
+        DuplicateGroup g;
+        g.kind = (DuplicateGroup::Kind)tag;
+        g.size = readLE(data, at, 8);
+        g.wastedBytes = readLE(data, at, 8);
+        g.similarity = readLE(data, at, 4) / 1e6;
+        const std::size_t hashLength = readLE(data, at, 1);
+        g.hash = at + hashLength <= data.size() ? Checksum::toHex((const std::uint8_t*)data.data() + at, (int)hashLength) : "";
+        at += hashLength;
+        for (std::uint64_t files = readLE(data, at, 4); files > 0 && at <= data.size(); --files) {
+            const std::size_t length = readLE(data, at, 4);
+            g.files.emplace_back(data.substr(std::min(at, data.size()), length));
+            at += length;
+        }
+        ok = at <= data.size();
+        decoded.push_back(g);
+    }
+    ok = ok && at == data.size() && groups == written.size() && resyncs == 1 && decoded.size() == written.size();
+    for (std::size_t i = 0; ok && i < written.size(); ++i) {
+        const DuplicateGroup& a = written[i];
+        const DuplicateGroup& b = decoded[i];
+        ok = a.kind == b.kind && a.size == b.size && a.wastedBytes == b.wastedBytes && a.hash == b.hash &&
+             a.similarity == b.similarity && a.files == b.files;
+    }
+    expect(ok, "BinarySink output decodes to the groups written");
+}
+
+//Walks root and counts how often each file is reported.
+static std::map<std::string, int> walkCounts(const fs::path& root, bool follow) {
+    std::map<std::string, int> seen;
+    FileTree walker(follow);
+    walker.setCallback([&](const fs::path& p, PathId) { seen[p.filename().string()]++; return 0; });
+    walker.setMessageCallback([](const std::string&) {});
+    walker.walk(root.string());
+    return seen;
+}
+
+//Followed symlinks back up the tree, to themselves and to a directory walked anyway end the recursion.
+static void checkSymlinkLoops(const fs::path& scratch) {
+    const fs::path root = scratch / "loops";
+    fs::create_directories(root / "a" / "b");
+    fs::create_directories(root / "c");
+    writeFile(root / "top.txt", "top");
+    writeFile(root / "a" / "b" / "deep.txt", "deep");
+    writeFile(root / "c" / "side.txt", "side");
+    fs::create_directory_symlink("../..", root / "a" / "b" / "up");     // Back to the root.
+    fs::create_directory_symlink("self", root / "a" / "self");          // A link to itself, never resolves.
+    fs::create_directory_symlink("../c", root / "a" / "to_c");          // A directory also walked directly.
+    const std::map<std::string, int> seen = walkCounts(root, true);
+    const std::map<std::string, int> once{{"top.txt", 1}, {"deep.txt", 1}, {"side.txt", 1}};
+    expect(seen == once, "A walk following symlinks reports each file once through loops");
+}
+
+//A directory bind mounted below the walked tree has the same device and inode as its source: walked once.
+static void checkBindMount(const fs::path& scratch) {
+    const std::string what = "A directory reached again through a bind mount is walked once";
+    const fs::path root = scratch / "bind";
+    fs::create_directories(root / "source");
+    fs::create_directories(root / "view");
+    writeFile(root / "source" / "file.txt", "bound");
+    if (::mount((root / "source").c_str(), (root / "view").c_str(), nullptr, MS_BIND, nullptr) != 0) {
+        skip(what, std::string("bind mount not permitted: ") + std::strerror(errno));
+        return;
+    }
+    const std::map<std::string, int> seen = walkCounts(root, false);
+    ::umount2((root / "view").c_str(), MNT_DETACH);
+    expect(seen == std::map<std::string, int>{{"file.txt", 1}}, what);
+}
+
+static ino_t inodeOf(const fs::path& p) {
+    struct stat st;
+    return ::stat(p.c_str(), &st) == 0 ? st.st_ino : 0;
+}
+
+//A group of files as the scan reports it, with their current sizes and mtimes.
+static DuplicateGroup groupOf(const std::vector<fs::path>& files, std::size_t references) {
+    DuplicateGroup g;
+    g.size = fs::file_size(files[0]);
+    g.references = references;
+    g.files = files;
+    for (const auto& f : files) {
+        struct stat st;
+        ::stat(f.c_str(), &st);
+        g.mtimes.push_back((std::int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec);
+    }
+    return g;
+}
+
+//DedupAction never changes a reference file, whether the group marks it or it lies under a protected root,
+//nor a group only the fast hash found.
+static void checkReferencesUntouched(const fs::path& scratch) {
+    const fs::path ref = scratch / "ref", target = scratch / "target";
+    fs::create_directories(ref);
+    fs::create_directories(target);
+    for (const auto& p : {ref / "a", ref / "b", target / "c"}) writeFile(p, "same bytes");
+    for (const auto& p : {ref / "d", target / "e"}) writeFile(p, "other bytes");
+    for (const auto& p : {target / "f", target / "g"}) writeFile(p, "fast bytes");
+
+    ActionOptions options;
+    options.mode = ActionOptions::Mode::Hardlink;
+    options.protectedRoots.push_back(ref.string() + "/");
+    DedupAction action(options);
+    action.add(groupOf({ref / "a", ref / "b", target / "c"}, 2));
+    action.add(groupOf({target / "e", ref / "d"}, 0));            // Unmarked, caught by the protected root.
+    action.add(groupOf({ref / "a", ref / "b"}, 2));               // Nothing but references, dropped.
+    DuplicateGroup fastOnly = groupOf({target / "f", target / "g"}, 0);
+    fastOnly.confirmed = false;                                 // Only the fast hash matched, dropped.
+    action.add(fastOnly);
+    ActionSummary done = action.run();
+    expect(inodeOf(target / "c") == inodeOf(ref / "a") && inodeOf(ref / "b") != inodeOf(ref / "a") &&
+           inodeOf(ref / "d") != inodeOf(target / "e") && inodeOf(target / "f") != inodeOf(target / "g") &&
+           done.hardlinked == 1 && done.failed == 1, "DedupAction leaves reference files and unconfirmed groups alone");
+}
+
+//A dry run plans what a real run does: a file on another filesystem is shared in no mode.
+static void checkDryRunAcrossDevices(const fs::path& scratch) {
+    const std::string what = "A dry run doesn't plan sharing a file across filesystems";
+    const fs::path root = scratch / "devices";
+    fs::create_directories(root / "other");
+    if (::mount("tmpfs", (root / "other").c_str(), "tmpfs", 0, nullptr) != 0) {
+        skip(what, std::string("tmpfs mount not permitted: ") + std::strerror(errno));
+        return;
+    }
+    writeFile(root / "a", "same bytes");
+    writeFile(root / "other" / "b", "same bytes");
+    ActionOptions options;
+    options.dryRun = true;
+    DedupAction dryRun(options);
+    dryRun.add(groupOf({root / "a", root / "other" / "b"}, 0));
+    ActionSummary planned = dryRun.run();
+    options.dryRun = false;
+    DedupAction realRun(options);
+    realRun.add(groupOf({root / "a", root / "other" / "b"}, 0));
+    ActionSummary done = realRun.run();
+    ::umount2((root / "other").c_str(), MNT_DETACH);
+    expect(planned.planned == 0 && planned.failed == 1 && done.reflinked + done.hardlinked == 0 && done.failed == 1,
+           what);
+}
+
+//Directories differing only in an entry the walk leaves out are not reported as identical trees.
+static void checkPartialTrees(const fs::path& scratch) {
+    const fs::path root = scratch / "trees";
+    for (const char* dir : {"a", "b", "c", "d", "e"}) {
+        fs::create_directories(root / dir);
+        writeFile(root / dir / "x.txt", "hello");
+        writeFile(root / dir / "y.txt", std::string(3000, 'y'));
+    }
+    writeFile(root / "a" / "z.log", "first");      // Excluded by the filter, and different.
+    writeFile(root / "b" / "z.log", "second");
+    ::mkfifo((root / "c" / "pipe").c_str(), 0600);  // Not a regular file.
+    for (const char* dir : {"f", "g"}) {                // Same but for a directory f can't open.
+        fs::create_directories(root / dir / "locked");
+        writeFile(root / dir / "x.txt", "hello");
+        writeFile(root / dir / "y.txt", std::string(3000, 'y'));
+    }
+    writeFile(root / "f" / "locked" / "hidden.txt", "only in f");
+    fs::permissions(root / "f" / "locked", fs::perms::none);
+    std::error_code unreadable;
+    fs::directory_iterator((root / "f" / "locked"), unreadable);
+
+    ScanOptions options;
+    options.root = root.string();
+    options.directoryGroups = true;
+    options.filterRules.excludeGlobs.push_back("*.log");
+    ScanContext context(options);
+    std::vector<std::vector<fs::path>> trees;
+    context.setGroupCallback([&](const DuplicateGroup& group) {
+        if (group.kind != DuplicateGroup::Kind::Directory) return;
+        trees.push_back(group.files);
+        std::sort(trees.back().begin(), trees.back().end());
+    });
+    context.setMessageCallback([](const std::string&) {});
+    context.findExactDuplicates();
+    fs::permissions(root / "f" / "locked", fs::perms::owner_all);
+    const bool onlyComplete = trees.size() == 1 && trees[0] == std::vector<fs::path>{root / "d", root / "e"};
+    expect(onlyComplete, "Directory groups leave out trees with filtered or special entries");
+    if (unreadable) {
+        expect(onlyComplete, "Directory groups leave out trees with a directory that can't be opened");
+    } else {
+        skip("Directory groups leave out trees with a directory that can't be opened", "run as root, every directory opens");
+    }
+}
+
+//Cross mode hashes no reference file unless a target shares both its size and its first bytes.
+static void checkCrossPrefixBySize(const fs::path& scratch) {
+    const fs::path ref = scratch / "cross_ref", target = scratch / "cross_target";
+    fs::create_directories(ref);
+    fs::create_directories(target);
+    const std::string a(4096, 'a'), b(4096, 'b'), c(4096, 'c');
+    writeFile(ref / "r", a + std::string(1904, 'r'));           // Size of t2, first bytes of t.
+    writeFile(ref / "r2", c + std::string(2904, 'r'));          // Size of t, first bytes of neither.
+    writeFile(target / "t", a + std::string(2904, 't'));
+    writeFile(target / "t2", b + std::string(1904, 't'));
+
+    ScanOptions options;
+    options.root = target.string();
+    options.referenceRoots.push_back(ref.string());
+    options.collectMetrics = true;
+    ScanContext context(options);
+    context.setMessageCallback([](const std::string&) {});
+    context.findCrossTreeDuplicates();
+    expect(context.getMetrics().total(Metrics::Stage::Hash).filesIn == 0,
+           "Cross mode keeps only files sharing size and first bytes for hashing");
+}
+
+//A JPEG of a gradient running across (or, vertical, down) the image.
+static std::vector<std::uint8_t> gradientJpeg(int size, bool vertical) {
+    cv::Mat img(size, size, CV_8UC1);
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) img.at<uchar>(y, x) = (uchar)((vertical ? y : x) * 255 / size);
+    }
+    std::vector<std::uint8_t> jpeg;
+    cv::imencode(".jpg", img, jpeg);
+    return jpeg;
+}
+
+//The JPEG with an EXIF APP1 segment carrying thumbnail: big endian TIFF, an empty IFD0, and an IFD1
+//holding the JPEGInterchangeFormat tags.
+static std::string withThumbnail(const std::vector<std::uint8_t>& jpeg, const std::vector<std::uint8_t>& thumbnail) {
+    std::string tiff("MM\0\x2A\0\0\0\x08", 8);
+    auto be = [&](std::uint32_t v, int bytes) {
+        for (int i = bytes - 1; i >= 0; --i) tiff += (char)((v >> (8 * i)) & 0xFF);
+    };
+    be(0, 2);                                               // IFD0: no entries,
+    be(14, 4);                                              // IFD1 right after it.
+    be(2, 2);
+    be(0x0201, 2), be(4, 2), be(1, 4), be(14 + 2 + 2 * 12 + 4, 4);
+    be(0x0202, 2), be(4, 2), be(1, 4), be((std::uint32_t)thumbnail.size(), 4);
+    be(0, 4);
+    tiff.append(thumbnail.begin(), thumbnail.end());
+    const std::string payload = std::string("Exif\0\0", 6) + tiff;
+    std::string out(jpeg.begin(), jpeg.begin() + 2);
+    out += "\xFF\xE1";
+    out += (char)((payload.size() + 2) >> 8);
+    out += (char)((payload.size() + 2) & 0xFF);
+    out += payload;
+    out.append(jpeg.begin() + 2, jpeg.end());
+    return out;
+}
+
+//With --exif-thumbnails the thumbnail only prefilters: an image with one and its copy without one are
+//grouped, and an image carrying a stale thumbnail of another is not grouped with it.
+static void checkThumbnailsOnlyPrefilter(const fs::path& scratch) {
+    const std::string what = "EXIF thumbnails only prefilter the image search";
+    const std::vector<std::uint8_t> across = gradientJpeg(256, false), down = gradientJpeg(256, true);
+    const std::vector<std::uint8_t> thumbnail = gradientJpeg(64, false);
+    if (across.empty() || thumbnail.empty() ||
+        cv::imdecode(across, cv::IMREAD_GRAYSCALE).empty()) {
+        skip(what, "OpenCV can't encode and decode JPEG here");
+        return;
+    }
+    const fs::path dir = scratch / "thumbnails";
+    fs::create_directories(dir);
+    writeFile(dir / "with.jpg", withThumbnail(across, thumbnail));
+    writeFile(dir / "without.jpg", std::string(across.begin(), across.end()));
+    writeFile(dir / "stale.jpg", withThumbnail(down, thumbnail));
+    std::vector<std::uint8_t> found;
+    if (!ExifThumbnail::read((dir / "with.jpg").string(), found) || found != thumbnail) {
+        expect(false, what + ": the thumbnail written is found");
+        return;
+    }
+
+    ScanOptions options;
+    options.root = dir.string();
+    options.exifThumbnails = true;
+    ScanContext context(options);
+    std::vector<std::vector<fs::path>> groups;
+    context.setGroupCallback([&](const DuplicateGroup& group) {
+        groups.push_back(group.files);
+        std::sort(groups.back().begin(), groups.back().end());
+    });
+    context.setMessageCallback([](const std::string&) {});
+    context.findSimilarImages();
+    expect(groups.size() == 1 && groups[0] == std::vector<fs::path>{dir / "with.jpg", dir / "without.jpg"}, what);
+}
+
+int main() {
+    const fs::path scratch = fs::temp_directory_path() / ("dedup_check_" + std::to_string(::getpid()));
+    fs::create_directories(scratch);
+
+    checkPathStoreRoundTrip();
+    checkFastHashVectors(scratch);
+    checkSparseHashing(scratch);
+    checkIndexRoundTrip(scratch);
+    checkShardRoundTrip(scratch);
+    checkBinarySinkRoundTrip(scratch);
+    checkPathStoreWalk(scratch);
+    checkSymlinkLoops(scratch);
+    checkBindMount(scratch);
+    checkReferencesUntouched(scratch);
+    checkDryRunAcrossDevices(scratch);
+    checkPartialTrees(scratch);
+    checkCrossPrefixBySize(scratch);
+    checkThumbnailsOnlyPrefilter(scratch);
+
+    std::error_code ec;
+    fs::remove_all(scratch, ec);
+    std::cout << (failures ? std::to_string(failures) + " checks failed\n" : "All checks passed\n");
+    return failures;
+}
@@ -0,0 +1,266 @@
+// gen_tree.cpp
+//
+// Deterministic synthetic dataset generator for the benchmarks.
+// The same seed and parameters always produce byte-identical trees, so timings
+// taken on different commits can be compared.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+namespace fs = std::filesystem;
+
+struct GenOptions {
+    std::string out = "bench_tree";
+    std::uint64_t seed = 42;
+    std::size_t files = 20000;          // Regular (non media) files.
+    int depth = 6;                      // Directory depth.
+    int fanout = 3;                     // Subdirectories per directory.
+    double dupRatio = 0.2;              // Fraction of files which copy an earlier file.
+    double prefixRatio = 0.1;           // Fraction sharing the first 4 KB with an earlier file, but not the rest.
+    double sharedNameRatio = 0.5;       // Fraction of directories using a long common name prefix.
+    std::string sizeDist = "mixed";     // small | mixed | large
+    std::size_t images = 200;           // Distinct base images.
+    int imageVariants = 3;              // Resized / recompressed / blurred copies per base image.
+    std::size_t videos = 4;             // Distinct base videos.
+};
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--out dir] [--seed n] [--files n] [--depth n] [--fanout n]\n"
+              << "       [--dup-ratio r] [--prefix-ratio r] [--shared-name-ratio r]\n"
+              << "       [--size-dist small|mixed|large] [--images n] [--image-variants n] [--videos n]\n";
+}
+
+//Written into every generated tree; only a directory holding it is ever deleted.
+static const char* const markerName = ".gen_tree";
+
+/**
+ * @brief Makes room for a new tree at o.out.
+ *
+ * A missing or empty directory is used as it is, and one holding the marker is
+ * an earlier tree, which is replaced. Anything else is left alone, so a wrong
+ * --out can't delete data.
+ */
+static bool prepareOut(const GenOptions& o) {
+    std::error_code ec;
+    const fs::path out(o.out);
+    if (!fs::exists(fs::symlink_status(out, ec))) return true;
+    if (!fs::is_directory(fs::symlink_status(out, ec))) {
+        std::cerr << o.out << " exists and is not a directory, refusing to overwrite it\n";
+        return false;
+    }
+    if (fs::is_empty(out, ec) && !ec) return true;
+    if (!fs::is_regular_file(fs::symlink_status(out / markerName, ec))) {
+        std::cerr << o.out << " is not empty and was not made by gen_tree (no " << markerName
+                  << " file), refusing to delete it\n";
+        return false;
+    }
+    fs::remove_all(out, ec);
+    if (ec) {
+        std::cerr << "Cannot remove the old tree " << o.out << ": " << ec.message() << "\n";
+        return false;
+    }
+    return true;
+}
+
+static bool parseArgs(int argc, char* argv[], GenOptions& o) {
+    for (int i = 1; i < argc; ++i) {
+        std::string opt = argv[i];
+        if (i + 1 >= argc) { usage(argv[0]); return false; }
+        std::string v = argv[++i];
+        try {
+            if (opt == "--out") o.out = v;
+            else if (opt == "--seed") o.seed = std::stoull(v);
+            else if (opt == "--files") o.files = std::stoull(v);
+            else if (opt == "--depth") o.depth = std::stoi(v);
+            else if (opt == "--fanout") o.fanout = std::stoi(v);
+            else if (opt == "--dup-ratio") o.dupRatio = std::stod(v);
+            else if (opt == "--prefix-ratio") o.prefixRatio = std::stod(v);
+            else if (opt == "--shared-name-ratio") o.sharedNameRatio = std::stod(v);
+            else if (opt == "--size-dist") o.sizeDist = v;
+            else if (opt == "--images") o.images = std::stoull(v);
+            else if (opt == "--image-variants") o.imageVariants = std::stoi(v);
+            else if (opt == "--videos") o.videos = std::stoull(v);
+            else { usage(argv[0]); return false; }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << opt << ": " << v << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+//Builds the directory list breadth first. Some directories get long names sharing a common
+//prefix, which is what makes path storage expensive on real trees.
+static std::vector<fs::path> makeDirs(const GenOptions& o, std::mt19937_64& rng) {
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::vector<fs::path> dirs{fs::path(o.out)};
+    std::size_t levelBegin = 0;
+    for (int d = 0; d < o.depth; ++d) {
+        std::size_t levelEnd = dirs.size();
+        for (std::size_t i = levelBegin; i < levelEnd; ++i) {
+            for (int c = 0; c < o.fanout; ++c) {
+                std::string name = (coin(rng) < o.sharedNameRatio)
+                    ? "shared_directory_name_prefix_for_benchmarks_" + std::to_string(c)
+                    : "d" + std::to_string(c);
+                dirs.push_back(dirs[i] / name);
+            }
+        }
+        levelBegin = levelEnd;
+    }
+    for (const auto& d : dirs) fs::create_directories(d);
+    return dirs;
+}
+
+static std::size_t drawSize(const GenOptions& o, std::mt19937_64& rng) {
+    if (o.sizeDist == "small") {
+        return std::uniform_int_distribution<std::size_t>(64, 4096)(rng);
+    }
+    if (o.sizeDist == "large") {
+        return std::uniform_int_distribution<std::size_t>(1 << 20, 64 << 20)(rng);
+    }
+    //Log-normal around 16 KB, clipped to [1 KB, 8 MB]: many small files and a long tail.
+    std::lognormal_distribution<double> dist(std::log(16384.0), 1.5);
+    double s = dist(rng);
+    return (std::size_t)std::min(std::max(s, 1024.0), 8.0 * 1024 * 1024);
+}
+
+static void fillRandom(std::vector<char>& buf, std::mt19937_64& rng) {
+    std::size_t i = 0;
+    for (; i + 8 <= buf.size(); i += 8) {
+        std::uint64_t v = rng();
+        std::copy(reinterpret_cast<char*>(&v), reinterpret_cast<char*>(&v) + 8, buf.begin() + i);
+    }
+    for (; i < buf.size(); ++i) buf[i] = (char)rng();
+}
+
+static void writeFile(const fs::path& p, const std::vector<char>& buf) {
+    std::ofstream out(p, std::ios::binary | std::ios::trunc);
+    out.write(buf.data(), (std::streamsize)buf.size());
+}
+
+static void makeFiles(const GenOptions& o, const std::vector<fs::path>& dirs, std::mt19937_64& rng) {
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::uniform_int_distribution<std::size_t> pickDir(0, dirs.size() - 1);
+    std::vector<fs::path> written;
+    std::vector<std::size_t> large;     // Indexes in written of the files larger than 4 KB.
+    std::vector<char> buf;
+
+    for (std::size_t i = 0; i < o.files; ++i) {
+        fs::path target = dirs[pickDir(rng)] / ("file_" + std::to_string(i) + ".bin");
+        double r = coin(rng);
+        std::size_t size;
+
+        if (!written.empty() && r < o.dupRatio) {
+            //Exact duplicate of an earlier file.
+            const fs::path& src = written[std::uniform_int_distribution<std::size_t>(0, written.size() - 1)(rng)];
+            fs::copy_file(src, target, fs::copy_options::overwrite_existing);
+            size = (std::size_t)fs::file_size(target);
+        } else if (!large.empty() && r < o.dupRatio + o.prefixRatio) {
+            //Same size and first 4 KB as an earlier file, differing further in: survives the
+            //size and prefix stages and is only rejected by the full hash. Only a file with
+            //bytes past the first 4 KB can be the source, or the variant would change size.
+            const fs::path& src = written[large[std::uniform_int_distribution<std::size_t>(0, large.size() - 1)(rng)]];
+            std::ifstream in(src, std::ios::binary);
+            buf.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            buf[std::uniform_int_distribution<std::size_t>(4096, buf.size() - 1)(rng)] ^= 0x5a;
+            writeFile(target, buf);
+            size = buf.size();
+        } else {
+            buf.resize(drawSize(o, rng));
+            fillRandom(buf, rng);
+            writeFile(target, buf);
+            size = buf.size();
+        }
+        if (size > 4096) large.push_back(written.size());
+        written.push_back(target);
+    }
+}
+
+static cv::Mat makeBaseImage(std::mt19937_64& rng) {
+    std::uniform_int_distribution<int> x(0, 639), y(0, 479), c(0, 255), r(10, 120);
+    cv::Mat img(480, 640, CV_8UC3, cv::Scalar(c(rng), c(rng), c(rng)));
+    for (int s = 0; s < 12; ++s) {
+        cv::Scalar color(c(rng), c(rng), c(rng));
+        if (s % 2 == 0) cv::rectangle(img, cv::Point(x(rng), y(rng)), cv::Point(x(rng), y(rng)), color, -1);
+        else cv::circle(img, cv::Point(x(rng), y(rng)), r(rng), color, -1);
+    }
+    return img;
+}
+
+static void makeImages(const GenOptions& o, const std::vector<fs::path>& dirs, std::mt19937_64& rng) {
+    std::uniform_int_distribution<std::size_t> pickDir(0, dirs.size() - 1);
+    for (std::size_t i = 0; i < o.images; ++i) {
+        cv::Mat base = makeBaseImage(rng);
+        cv::imwrite((dirs[pickDir(rng)] / ("img_" + std::to_string(i) + ".png")).string(), base);
+        for (int v = 0; v < o.imageVariants; ++v) {
+            cv::Mat variant;
+            switch (v % 3) {
+                case 0: cv::resize(base, variant, cv::Size(320, 240)); break;
+                case 1: variant = base; break;  // Same pixels, lossy re-encode below.
+                default: cv::GaussianBlur(base, variant, cv::Size(5, 5), 1.5); break;
+            }
+            fs::path p = dirs[pickDir(rng)] / ("img_" + std::to_string(i) + "_v" + std::to_string(v) + ".jpg");
+            cv::imwrite(p.string(), variant);
+        }
+    }
+}
+
+static void makeVideos(const GenOptions& o, const std::vector<fs::path>& dirs, std::mt19937_64& rng) {
+    std::uniform_int_distribution<std::size_t> pickDir(0, dirs.size() - 1);
+    for (std::size_t i = 0; i < o.videos; ++i) {
+        std::vector<cv::Mat> frames;
+        for (int f = 0; f < 40; ++f) frames.push_back(makeBaseImage(rng));
+
+        //Original and a lower resolution copy of the same 4 second clip.
+        const cv::Size sizes[] = {cv::Size(640, 480), cv::Size(320, 240)};
+        for (int v = 0; v < 2; ++v) {
+            fs::path p = dirs[pickDir(rng)] / ("vid_" + std::to_string(i) + "_v" + std::to_string(v) + ".avi");
+            cv::VideoWriter writer(p.string(), cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), 10.0, sizes[v]);
+            if (!writer.isOpened()) {
+                std::cerr << "Cannot write video " << p << ", skipping videos\n";
+                return;
+            }
+            for (const auto& frame : frames) {
+                cv::Mat scaled;
+                cv::resize(frame, scaled, sizes[v]);
+                writer.write(scaled);
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    GenOptions o;
+    if (!parseArgs(argc, argv, o)) return 1;
+
+    if (!prepareOut(o)) return 1;
+
+    //Each part gets its own generator so changing e.g. the image count doesn't change the files.
+    std::mt19937_64 dirRng(o.seed), fileRng(o.seed + 1), imgRng(o.seed + 2), vidRng(o.seed + 3);
+    std::vector<fs::path> dirs = makeDirs(o, dirRng);
+    std::ofstream(fs::path(o.out) / markerName) << "Generated by bench/gen_tree, deleted by its next run.\n";
+    makeFiles(o, dirs, fileRng);
+    makeImages(o, dirs, imgRng);
+    makeVideos(o, dirs, vidRng);
+
+    std::ofstream manifest(fs::path(o.out) / "manifest.json");
+    manifest << "{\"seed\":" << o.seed << ",\"files\":" << o.files << ",\"depth\":" << o.depth
+             << ",\"fanout\":" << o.fanout << ",\"dup_ratio\":" << o.dupRatio
+             << ",\"prefix_ratio\":" << o.prefixRatio << ",\"shared_name_ratio\":" << o.sharedNameRatio
+             << ",\"size_dist\":\"" << o.sizeDist << "\",\"images\":" << o.images
+             << ",\"image_variants\":" << o.imageVariants << ",\"videos\":" << o.videos
+             << ",\"directories\":" << dirs.size() << "}\n";
+
+    std::cout << "Generated " << o.files << " files, " << o.images * (1 + o.imageVariants) << " images and "
+              << o.videos * 2 << " videos in " << dirs.size() << " directories under " << o.out << "\n";
+    return 0;
+}
@@ -1,38 +1,277 @@
 #include <iostream>
+#include <sstream>
 
 #include "Manager.hpp"
+#include "ScanOptions.hpp"
+
+//Splits a comma separated list such as ".jpg,.png" into its items.
+static std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+//Parses an --image-hash cascade such as "dhash,phash": an optional prefilter, then the grouping hash.
+static bool parseImageHashes(const std::string& value, ScanOptions& options) {
+    auto parse = [](const std::string& name, ScanOptions::ImageHash& hash) {
+        if(name=="ahash") hash=ScanOptions::ImageHash::AHash;
+        else if(name=="dhash") hash=ScanOptions::ImageHash::DHash;
+        else if(name=="phash") hash=ScanOptions::ImageHash::PHash;
+        else if(name=="phash256") hash=ScanOptions::ImageHash::PHash256;
+        else return false;
+        return true;
+    };
+    std::vector<std::string> names=splitList(value);
+    if(names.empty() || names.size()>2) return false;
+    options.imagePrefilter=ScanOptions::ImageHash::None;
+    if(names.size()==2 && !parse(names[0], options.imagePrefilter)) return false;
+    return parse(names.back(), options.imageHash);
+}
 
 int main(int argc, char* argv[]) {
     if (argc < 3) {
         std::cerr << "Error: Not enough arguments.\n";
         std::cerr << "Expected usage:\n"
-                << "  " << argv[0] << " dedup <directory> [follow_symlinks]   # Deduplicate files\n"
-                << "  " << argv[0] << " img <directory>   [follow_symlinks]   # Filter image files\n"
-                << "  " << argv[0] << " vid <directory>   [follow_symlinks]   # Filter video files\n"
-                << "   [follow_symlinks] by default set to false.\n";
+                << "  " << argv[0] << " dedup <directory> [follow_symlinks] [options]   # Deduplicate files\n"
+                << "  " << argv[0] << " img <directory>   [follow_symlinks] [options]   # Filter image files\n"
+                << "  " << argv[0] << " vid <directory>   [follow_symlinks] [options]   # Filter video files\n"
+                << "  " << argv[0] << " all <directory>   [follow_symlinks] [options]   # All of the above in one pass\n"
+                << "  " << argv[0] << " cross <directory> [follow_symlinks] --reference <dir> [options]  # Files already under a reference directory\n"
+                << "  " << argv[0] << " shard <directory> [follow_symlinks] [options]   # Write a partial result to --shard <file>\n"
+                << "  " << argv[0] << " merge <shard files...> [options]                # Report groups, list files still to hash in --work-list\n"
+                << "  " << argv[0] << " complete <shard file> [options]                 # Hash the shard's --work-list entries\n"
+                << "  " << argv[0] << " watch <directory> [options]                     # Report new duplicates as files change\n"
+                << "  " << argv[0] << " chunk <directory> [follow_symlinks] [options]   # Files sharing most of their content\n"
+                << "  " << argv[0] << " estimate <directory> [follow_symlinks] [options]  # Estimate the duplicate bytes from a sample\n"
+                << "  " << argv[0] << " index <directory> [follow_symlinks] [options]   # Hash every file into --index <file>\n"
+                << "  " << argv[0] << " query <index file> [files...|-] [options]       # Check files (or stdin paths) against an index\n"
+                << "   [follow_symlinks] by default set to false.\n"
+                << "Options:\n"
+                << "   --exclude <glob>          Skip files/directories matching glob (repeatable)\n"
+                << "   --include <glob>          Only report files matching glob (repeatable)\n"
+                << "   --exclude-prefix <dir>    Skip the subtree below dir (repeatable)\n"
+                << "   --ext <.a,.b,...>         Only report files with these extensions\n"
+                << "   --min-size <bytes>        Only report files of at least this size\n"
+                << "   --max-size <bytes>        Only report files of at most this size\n"
+                << "   --no-default-excludes     Also scan .git, .cache, .config, ...\n"
+                << "   --threads <n>             Threads used for reading and hashing (default: all cores)\n"
+                << "   --format <text|ndjson|binary>  Output format of the groups (default: text)\n"
+                << "   --output <file>           Write the groups to file instead of standard output\n"
+                << "   --action <auto|reflink|hardlink>  Share the storage of exact duplicates (dedup/all)\n"
+                << "   --hash <blake3|tiered|fast>  Full hash of the candidates: BLAKE3, a fast 128 bit hash confirmed\n"
+                << "                             by BLAKE3 where it matches, or the fast hash alone, without --action (default: blake3)\n"
+                << "   --image-hash <[pre,]hash> img/all: hash images are grouped by, ahash, dhash, phash or phash256,\n"
+                << "                             optionally after a cheaper prefilter, e.g. dhash,phash (default: phash)\n"
+                << "   --exif-thumbnails         img/all: prefilter on the embedded EXIF thumbnail of JPEG files when there is one\n"
+                << "   --video-frames <n>        vid/all: frames sampled per video (default: 10)\n"
+                << "   --segment-seconds <n>     vid/all: sample longer videos in parallel segments of this length, 0 = never (default: 600)\n"
+                << "   --prefilter-threshold <n> Hamming distance within which the prefilter keeps images (default: 16)\n"
+                << "   --min-dedup-size <bytes>  Ignore smaller files in the duplicate searches (default: 1024, 0 includes empty files)\n"
+                << "   --small-file-size <bytes> dedup: read files up to this size whole, once (default: 4096)\n"
+                << "   --time-budget <seconds>   dedup: hash the most rewarding candidates first, stop after this time\n"
+                << "   --byte-budget <bytes>     dedup: the same, but stop before hashing more than this many bytes\n"
+                << "   --dirs                    dedup: also report directories whose whole trees are identical\n"
+                << "   --collapse-dirs           dedup: the same, and leave out file groups inside those trees\n"
+                << "   --chunk-size <bytes>      chunk: average chunk size (default: 8192)\n"
+                << "   --min-shared <ratio>      chunk: smallest shared share of the larger file to report (default: 0.5)\n"
+                << "   --sample <fraction>       estimate: share of the candidate bytes to read (default: 0.05)\n"
+                << "   --seed <n>                estimate: seed of the sampling (default: 1)\n"
+                << "   --reference <dir>         Reference directory for the cross mode (repeatable)\n"
+                << "   --index <file>            Index file written by the index mode (default: dedup.idx)\n"
+                << "   --shard <file>            Shard file of the shard mode (default: dedup.shard)\n"
+                << "   --shard-name <name>       Owner recorded in the shard, used by work lists (default: host name)\n"
+                << "   --work-list <file>        Files to hash, written by merge, read by complete (default: dedup.work)\n"
+                << "   --dry-run                 With --action, only report what would be done\n"
+                << "   --metrics <file|->        Write per-stage timings and counters as JSON\n"
+                << "   --trace <file|->          Write a Chrome trace (chrome://tracing, Perfetto) of the scan\n";
 
         return 1;
     }
     std::string mode=std::string(argv[1]);
-    bool follow_symlinks=false;
-    if(argc==4){
+    ScanOptions options;
+    options.root=argv[2];
+    FilterRules& rules=options.filterRules;
+    ReportOptions report;
+    std::vector<std::string> inputs;
+
+    int i=3;
+    if(mode=="query" || mode=="merge"){
+        //query: index file, then the files to check. merge: the shard files.
+        if(mode=="query") report.indexFile=argv[2];
+        else inputs.push_back(argv[2]);
+        while(i<argc && std::string(argv[i]).rfind("--", 0)!=0){
+            inputs.push_back(argv[i++]);
+        }
+    }
+    else if(mode=="complete"){
+        report.shardFile=argv[2];
+    }
+    else if(argc>3 && std::string(argv[3]).rfind("--", 0)!=0){
         std::string check=std::string(argv[3]);
         if(check=="true"){
-            follow_symlinks=true;
+            options.followSymlinks=true;
         }
         else if(check!="false"){
             std::cerr<<"follow_symlinks parameter should be either true or false. Found "<<check<<"\n";
             return 0;
         }
+        i=4;
     }
+    for(; i<argc; ++i){
+        std::string opt=std::string(argv[i]);
+        if(opt=="--no-default-excludes"){
+            rules.useDefaultExcludes=false;
+            continue;
+        }
+        if(opt=="--dry-run"){
+            report.action.dryRun=true;
+            continue;
+        }
+        if(opt=="--exif-thumbnails"){
+            options.exifThumbnails=true;
+            continue;
+        }
+        if(opt=="--dirs" || opt=="--collapse-dirs"){
+            options.directoryGroups=true;
+            options.collapseDirectories=options.collapseDirectories || opt=="--collapse-dirs";
+            continue;
+        }
+        if(i+1>=argc){
+            std::cerr<<"Missing value for option "<<opt<<"\n";
+            return 1;
+        }
+        std::string value=std::string(argv[++i]);
+        try{
+            if(opt=="--exclude") rules.excludeGlobs.push_back(value);
+            else if(opt=="--include") rules.includeGlobs.push_back(value);
+            else if(opt=="--exclude-prefix") rules.excludePrefixes.push_back(value);
+            else if(opt=="--ext"){
+                for(const auto& ext: splitList(value)) rules.extensions.push_back(ext);
+            }
+            else if(opt=="--min-size") rules.minSize=std::stoull(value);
+            else if(opt=="--max-size") rules.maxSize=std::stoull(value);
+            else if(opt=="--threads") options.threads=(unsigned)std::stoul(value);
+            else if(opt=="--action"){
+                report.act=true;
+                if(value=="auto") report.action.mode=ActionOptions::Mode::Auto;
+                else if(value=="reflink") report.action.mode=ActionOptions::Mode::Reflink;
+                else if(value=="hardlink") report.action.mode=ActionOptions::Mode::Hardlink;
+                else{
+                    std::cerr<<"--action must be auto, reflink or hardlink. Found "<<value<<"\n";
+                    return 1;
+                }
+            }
+            else if(opt=="--hash"){
+                if(value=="blake3") options.hashMode=ScanOptions::HashMode::Blake3;
+                else if(value=="tiered") options.hashMode=ScanOptions::HashMode::Tiered;
+                else if(value=="fast") options.hashMode=ScanOptions::HashMode::Fast;
+                else{
+                    std::cerr<<"--hash must be blake3, tiered or fast. Found "<<value<<"\n";
+                    return 1;
+                }
+            }
+            else if(opt=="--image-hash"){
+                if(!parseImageHashes(value, options)){
+                    std::cerr<<"--image-hash must be [ahash|dhash|phash,]ahash|dhash|phash|phash256. Found "<<value<<"\n";
+                    return 1;
+                }
+            }
+            else if(opt=="--video-frames") options.videoFrames=std::stoi(value);
+            else if(opt=="--segment-seconds") options.videoSegmentSeconds=std::stoi(value);
+            else if(opt=="--prefilter-threshold") options.prefilterThreshold=std::stoi(value);
+            else if(opt=="--min-dedup-size") options.minDedupSize=std::stoull(value);
+            else if(opt=="--small-file-size") options.smallFileSize=std::stoull(value);
+            else if(opt=="--time-budget") options.timeBudgetSec=std::stod(value);
+            else if(opt=="--byte-budget") options.byteBudget=std::stoull(value);
+            else if(opt=="--chunk-size") options.chunkSize=std::stoull(value);
+            else if(opt=="--min-shared") options.chunkMinShared=std::stod(value);
+            else if(opt=="--sample") options.sampleFraction=std::stod(value);
+            else if(opt=="--seed") options.sampleSeed=std::stoull(value);
+            else if(opt=="--reference") options.referenceRoots.push_back(value);
+            else if(opt=="--index") report.indexFile=value;
+            else if(opt=="--shard") report.shardFile=value;
+            else if(opt=="--shard-name") report.shardName=value;
+            else if(opt=="--work-list") report.workList=value;
+            else if(opt=="--format") report.format=value;
+            else if(opt=="--output") report.outputFile=value;
+            else if(opt=="--metrics"){
+                report.metricsFile=value;
+                options.collectMetrics=true;
+            }
+            else if(opt=="--trace"){
+                report.traceFile=value;
+                options.collectTrace=true;
+            }
+            else{
+                std::cerr<<"Unknown option "<<opt<<"\n";
+                return 1;
+            }
+        }
+        catch(const std::exception&){
+            std::cerr<<"Invalid value for option "<<opt<<": "<<value<<"\n";
+            return 1;
+        }
+    }
+
+    report.action.threads=options.threads;
+    //Files are only changed on the word of BLAKE3, a fast hash can be made to collide.
+    if(report.act && options.hashMode==ScanOptions::HashMode::Fast){
+        std::cerr<<"--action needs hashes confirmed by BLAKE3; use --hash tiered or blake3 instead of fast\n";
+        return 1;
+    }
+    //A budgeted scan ranks and hashes candidate groups itself, with BLAKE3 and file by file.
+    const bool budgeted=options.timeBudgetSec>0 || options.byteBudget>0;
+    if(budgeted && options.hashMode!=ScanOptions::HashMode::Blake3){
+        std::cerr<<"--time-budget and --byte-budget hash with BLAKE3 only; drop --hash tiered or fast\n";
+        return 1;
+    }
+    if(budgeted && options.directoryGroups){
+        std::cerr<<"--dirs and --collapse-dirs can't be combined with --time-budget or --byte-budget\n";
+        return 1;
+    }
+
     if(mode=="dedup"){
-        Manager::findExactDuplicates(argv[2], follow_symlinks);
+        Manager::findExactDuplicates(options, report);
     }
     else if(mode=="img"){
-        Manager::findSimilarImages(argv[2], follow_symlinks);
+        Manager::findSimilarImages(options, report);
     }
     else if(mode=="vid"){
-        Manager::findSimilarVideos(argv[2], follow_symlinks);
+        Manager::findSimilarVideos(options, report);
+    }
+    else if(mode=="all"){
+        Manager::findAll(options, report);
+    }
+    else if(mode=="cross"){
+        Manager::findCrossTreeDuplicates(options, report);
+    }
+    else if(mode=="shard"){
+        Manager::writeShard(options, report);
+    }
+    else if(mode=="merge"){
+        Manager::mergeShards(inputs, report);
+    }
+    else if(mode=="complete"){
+        Manager::completeShard(options, report);
+    }
+    else if(mode=="watch"){
+        Manager::watch(options, report);
+    }
+    else if(mode=="chunk"){
+        Manager::findChunkDuplicates(options, report);
+    }
+    else if(mode=="estimate"){
+        Manager::estimate(options, report);
+    }
+    else if(mode=="index"){
+        Manager::buildIndex(options, report);
+    }
+    else if(mode=="query"){
+        Manager::query(inputs, report);
     }
     else{
         std::cout<<"Invalid input"<<"\n";
@@ -42,6 +281,6 @@ int main(int argc, char* argv[]) {
 
 /*
 To compile use
-g++ main.cpp FileTree.cpp FileInfo.cpp Utility.cpp Checksum.cpp BKTree.cpp Manager.cpp 
-$(pkg-config --cflags --libs opencv4) -lblake3 -o output
-*/
\ No newline at end of file
+make
+which builds the engine as libdedup.a and links this frontend (main.cpp, Manager.cpp) against it.
+*/